@@ -0,0 +1,443 @@
+#pragma once
+
+/*
+ * ColumnarMaker -- a drop-in replacement of the CAFAna `CSVMaker` that saves
+ * the exported variables in the `lstm_ee` binary columnar format instead of
+ * the csv text.
+ *
+ * Each slice level variable is stored as a single float32 column. Each prong
+ * level (multi) variable is stored in a CSR form: a float32 column of values
+ * of all prongs of all slices, plus an uint64 array of offsets of size
+ * (N_SLICES + 1), such that prongs of slice `i` are located in the range
+ * values[offsets[i]:offsets[i+1]].
+ *
+ * File layout (all values are little-endian):
+ *
+ *     char     magic[8]     = "LSTMEECF"
+ *     uint32   version      = 1
+ *     uint32   n_columns
+ *     uint64   n_rows
+ *     n_columns x {
+ *         uint32   kind         (0 -- slice variable, 1 -- prong variable)
+ *         uint32   name_length
+ *         uint64   data_offset  (byte offset of float32 values)
+ *         uint64   data_size    (number of float32 values)
+ *         uint64   index_offset (byte offset of uint64 offsets, 0 for slice)
+ *         char     name[name_length]
+ *     }
+ *     data blocks, each aligned at 64 bytes
+ *
+ * The format is read by `lstm_ee.data.data_loader.ColumnarLoader`.
+ *
+ * The number of slices is not known until the end of the loop. Therefore,
+ * while looping, each column is streamed into a separate temporary file
+ * (named by the column number, since variable names may contain '/') and
+ * the temporary files are stitched together in the end by `Go`.
+ *
+ * `MakeColumnarMaker` creates a ColumnarMaker that can be driven by the
+ * sharded export driver `scripts/data/export_sharded.py`. If the environment
+ * variable LSTM_EE_EXPORT_FILELIST is set, then the dataset definition of
+ * the exporter is replaced by the list of files it points to (one file per
+ * line). Likewise, LSTM_EE_EXPORT_OUTPUT overrides the output file name.
+ *
+ * `RunExporter` runs an exporter with either ColumnarMaker or the CAFAna
+ * CSVMaker, depending on the export format: "lcol" (default) or "csv".
+ * The format is selected by the exporter macro argument or by the
+ * LSTM_EE_EXPORT_FORMAT environment variable.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CAFAna/Analysis/CSVMaker.h"
+#include "CAFAna/Core/Cut.h"
+#include "CAFAna/Core/MultiVar.h"
+#include "CAFAna/Core/SpectrumLoader.h"
+#include "CAFAna/Core/Var.h"
+
+#include "StandardRecord/Proxy/SRProxy.h"
+
+#include "TruthKinematics.h"
+
+namespace ana
+{
+
+class ColumnarMaker : public SpectrumLoader
+{
+public:
+    static constexpr uint32_t VERSION   = 1;
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    static const char* magic() { return "LSTMEECF"; }
+
+    enum ColumnKind : uint32_t { kSliceColumn = 0, kProngColumn = 1 };
+
+    ColumnarMaker(const std::string &wildcard, const std::string &outname)
+      : SpectrumLoader(wildcard),
+        fOutName(outname),
+        fCut(kNoCut),
+        fNRows(0)
+    { }
+
+    ColumnarMaker(
+        const std::vector<std::string> &fnames, const std::string &outname
+    )
+      : SpectrumLoader(fnames),
+        fOutName(outname),
+        fCut(kNoCut),
+        fNRows(0)
+    { }
+
+    ~ColumnarMaker() { cleanup(); }
+
+    /* Values are always stored as float32. Kept for CSVMaker compatibility */
+    void setPrecision(int) { }
+
+    void setCut(const Cut &cut) { fCut = cut; }
+
+    void addVar(const std::string &name, const Var &var)
+    {
+        fSliceVars.emplace_back(name, var);
+        fColumns.emplace_back(new Column(name, kSliceColumn, tmpName()));
+    }
+
+    void addVars(const std::vector<std::pair<std::string, Var>> &vars)
+    {
+        for (const auto &v : vars) {
+            addVar(v.first, v.second);
+        }
+    }
+
+    void addMultiVar(const std::string &name, const MultiVar &var)
+    {
+        fProngVars.emplace_back(name, var);
+        fProngColumns.emplace_back(
+            new Column(name, kProngColumn, tmpName())
+        );
+    }
+
+    void addMultiVars(
+        const std::vector<std::pair<std::string, MultiVar>> &vars
+    )
+    {
+        for (const auto &v : vars) {
+            addMultiVar(v.first, v.second);
+        }
+    }
+
+    void Go()
+    {
+        SpectrumLoader::Go();
+        finalize();
+    }
+
+protected:
+    struct Column
+    {
+        Column(const std::string &n, ColumnKind k, const std::string &tmp)
+          : name(n), kind(k), tmpValues(tmp), tmpIndex(tmp + ".idx"),
+            nValues(0)
+        {
+            values.open(tmpValues, std::ios::binary | std::ios::trunc);
+            if (kind == kProngColumn) {
+                index.open(tmpIndex, std::ios::binary | std::ios::trunc);
+                index.write((const char*)&nValues, sizeof(nValues));
+            }
+
+            if (! values || (kind == kProngColumn && ! index)) {
+                throw std::runtime_error(
+                    "ColumnarMaker: failed to open " + tmpValues
+                );
+            }
+        }
+
+        void push(float x)
+        {
+            values.write((const char*)&x, sizeof(x));
+            nValues++;
+        }
+
+        void push(const std::vector<double> &xs)
+        {
+            for (double x : xs) {
+                push((float)x);
+            }
+            index.write((const char*)&nValues, sizeof(nValues));
+        }
+
+        std::string   name;
+        ColumnKind    kind;
+        std::string   tmpValues;
+        std::string   tmpIndex;
+        std::ofstream values;
+        std::ofstream index;
+        uint64_t      nValues;
+    };
+
+    void HandleRecord(caf::SRProxy *sr) override
+    {
+        /* The record is not modified until all variables are evaluated */
+        TruthKinematicsScope scope;
+
+        if (! fCut(sr)) {
+            return;
+        }
+
+        for (size_t i = 0; i < fSliceVars.size(); i++) {
+            fColumns[i]->push((float)fSliceVars[i].second(sr));
+        }
+
+        for (size_t i = 0; i < fProngVars.size(); i++) {
+            fProngColumns[i]->push(fProngVars[i].second(sr));
+        }
+
+        fNRows++;
+    }
+
+    /* Name of the temporary file of the next column */
+    std::string tmpName() const
+    {
+        return fOutName + ".tmp."
+            + std::to_string(fColumns.size() + fProngColumns.size());
+    }
+
+    static void pad(std::ofstream &f)
+    {
+        static const char zeros[ALIGNMENT] = { 0 };
+        const uint64_t rem = (uint64_t)f.tellp() % ALIGNMENT;
+
+        if (rem != 0) {
+            f.write(zeros, ALIGNMENT - rem);
+        }
+    }
+
+    static uint64_t append(std::ofstream &dst, const std::string &src)
+    {
+        pad(dst);
+        const uint64_t offset = (uint64_t)dst.tellp();
+
+        std::ifstream f(src, std::ios::binary);
+        if (f.peek() != std::ifstream::traits_type::eof()) {
+            dst << f.rdbuf();
+        }
+
+        return offset;
+    }
+
+    void finalize()
+    {
+        std::vector<Column*> columns;
+        for (auto &c : fColumns)      { columns.push_back(c.get()); }
+        for (auto &c : fProngColumns) { columns.push_back(c.get()); }
+
+        for (auto *c : columns) {
+            c->values.close();
+            if (c->kind == kProngColumn) {
+                c->index.close();
+            }
+        }
+
+        std::ofstream out(fOutName, std::ios::binary | std::ios::trunc);
+        if (! out) {
+            throw std::runtime_error(
+                "ColumnarMaker: failed to open " + fOutName
+            );
+        }
+
+        const uint32_t nColumns = columns.size();
+
+        /* Header is written twice: first as a placeholder, then for real */
+        std::vector<uint64_t> dataOffsets(columns.size(), 0);
+        std::vector<uint64_t> indexOffsets(columns.size(), 0);
+
+        writeHeader(out, columns, dataOffsets, indexOffsets, nColumns);
+
+        for (size_t i = 0; i < columns.size(); i++) {
+            dataOffsets[i] = append(out, columns[i]->tmpValues);
+            if (columns[i]->kind == kProngColumn) {
+                indexOffsets[i] = append(out, columns[i]->tmpIndex);
+            }
+        }
+
+        out.seekp(0);
+        writeHeader(out, columns, dataOffsets, indexOffsets, nColumns);
+        out.close();
+
+        cleanup();
+
+        std::cout << "ColumnarMaker: saved " << fNRows << " slices to "
+                  << fOutName << std::endl;
+    }
+
+    void writeHeader(
+        std::ofstream               &out,
+        const std::vector<Column*>  &columns,
+        const std::vector<uint64_t> &dataOffsets,
+        const std::vector<uint64_t> &indexOffsets,
+        uint32_t                     nColumns
+    )
+    {
+        const uint32_t version = VERSION;
+
+        out.write(magic(), 8);
+        out.write((const char*)&version,  sizeof(version));
+        out.write((const char*)&nColumns, sizeof(nColumns));
+        out.write((const char*)&fNRows,   sizeof(fNRows));
+
+        for (size_t i = 0; i < columns.size(); i++) {
+            const uint32_t kind    = columns[i]->kind;
+            const uint32_t nameLen = columns[i]->name.size();
+
+            out.write((const char*)&kind,            sizeof(kind));
+            out.write((const char*)&nameLen,         sizeof(nameLen));
+            out.write((const char*)&dataOffsets[i],  sizeof(uint64_t));
+            out.write((const char*)&columns[i]->nValues, sizeof(uint64_t));
+            out.write((const char*)&indexOffsets[i], sizeof(uint64_t));
+            out.write(columns[i]->name.data(), nameLen);
+        }
+    }
+
+    void cleanup()
+    {
+        for (auto *cs : { &fColumns, &fProngColumns }) {
+            for (auto &c : *cs) {
+                std::remove(c->tmpValues.c_str());
+                std::remove(c->tmpIndex.c_str());
+            }
+        }
+    }
+
+    std::string fOutName;
+    Cut         fCut;
+    uint64_t    fNRows;
+
+    std::vector<std::pair<std::string, Var>>      fSliceVars;
+    std::vector<std::pair<std::string, MultiVar>> fProngVars;
+
+    std::vector<std::unique_ptr<Column>> fColumns;
+    std::vector<std::unique_ptr<Column>> fProngColumns;
+};
+
+/* Read list of files (one per line, blank lines are ignored) from `path` */
+inline std::vector<std::string> ReadFileList(const std::string &path)
+{
+    std::ifstream f(path);
+    if (! f) {
+        throw std::runtime_error("ColumnarMaker: failed to open " + path);
+    }
+
+    std::vector<std::string> result;
+    std::string line;
+
+    while (std::getline(f, line)) {
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            continue;
+        }
+
+        const size_t end = line.find_last_not_of(" \t\r");
+        result.push_back(line.substr(begin, end - begin + 1));
+    }
+
+    return result;
+}
+
+/*
+ * Create ColumnarMaker over the dataset `wildcard` saving into `outname`,
+ * unless they are overridden by the sharded export driver through the
+ * LSTM_EE_EXPORT_FILELIST and LSTM_EE_EXPORT_OUTPUT environment variables.
+ */
+inline std::unique_ptr<ColumnarMaker> MakeColumnarMaker(
+    const std::string &wildcard, const std::string &outname
+)
+{
+    const char *filelist = std::getenv("LSTM_EE_EXPORT_FILELIST");
+    const char *output   = std::getenv("LSTM_EE_EXPORT_OUTPUT");
+
+    const std::string path = (output != nullptr) ? output : outname;
+
+    if (filelist == nullptr) {
+        return std::unique_ptr<ColumnarMaker>(
+            new ColumnarMaker(wildcard, path)
+        );
+    }
+
+    const std::vector<std::string> fnames = ReadFileList(filelist);
+    if (fnames.empty()) {
+        throw std::runtime_error(
+            std::string("ColumnarMaker: empty file list ") + filelist
+        );
+    }
+
+    return std::unique_ptr<ColumnarMaker>(new ColumnarMaker(fnames, path));
+}
+
+/*
+ * Return export format `format`. If it is empty, then the format is taken
+ * from the LSTM_EE_EXPORT_FORMAT environment variable, "lcol" by default.
+ */
+inline std::string GetExportFormat(const std::string &format = "")
+{
+    if (! format.empty()) {
+        return format;
+    }
+
+    const char *env = std::getenv("LSTM_EE_EXPORT_FORMAT");
+
+    return ((env != nullptr) && (*env != '\0')) ? env : "lcol";
+}
+
+/*
+ * Run exporter over the dataset `wildcard` saving into `stem` + ".lcol" with
+ * ColumnarMaker, or into `stem` + ".csv" with the CAFAna CSVMaker, depending
+ * on the export format (c.f. GetExportFormat). `configure` is called with
+ * the maker to add variables and cuts, e.g.
+ *
+ *     RunExporter(DATA, "dataset_lstm_ee_fd_fhc_nonswap", format,
+ *         [] (auto &maker) { maker.addVars(kSliceVarDefs); ... }
+ *     );
+ */
+template<typename Configure>
+void RunExporter(
+    const std::string &wildcard,
+    const std::string &stem,
+    const std::string &format,
+    Configure          configure
+)
+{
+    const std::string fmt = GetExportFormat(format);
+
+    if (fmt == "lcol") {
+        auto maker = MakeColumnarMaker(wildcard, stem + ".lcol");
+        configure(*maker);
+        maker->Go();
+        return;
+    }
+
+    if (fmt != "csv") {
+        throw std::runtime_error("RunExporter: unknown export format " + fmt);
+    }
+
+    /* CSVMaker loops over a wildcard only */
+    if (std::getenv("LSTM_EE_EXPORT_FILELIST") != nullptr) {
+        throw std::runtime_error(
+            "RunExporter: LSTM_EE_EXPORT_FILELIST requires the lcol format"
+        );
+    }
+
+    const char *output = std::getenv("LSTM_EE_EXPORT_OUTPUT");
+
+    CSVMaker maker(wildcard, (output != nullptr) ? output : stem + ".csv");
+    configure(maker);
+    maker.Go();
+}
+
+}
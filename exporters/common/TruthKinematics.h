@@ -0,0 +1,212 @@
+#pragma once
+
+/*
+ * TruthKinematics -- a summary of the true final state kinematics of the
+ * neutrino interaction `sr->mc.nu[0]`.
+ *
+ * The list of the final state particles `sr->mc.nu[0].prim` is walked only
+ * once per record and the result is memoized. The truth variables of the
+ * exporters are then cheap accessors into the memoized summary, e.g.
+ *
+ *     { "trueTotMomX_all",
+ *       TruthKinematicsVar(
+ *           [] (const TruthKinematics &k) { return k.all.px; }
+ *       ) },
+ *
+ * Final state particles with |pdg| >= 1000000000 (nuclei and nuclear
+ * remnants) are excluded from all sums and counts.
+ *
+ * The summary is memoized only within a `TruthKinematicsScope`, which
+ * promises that the record is not modified until the scope is closed. The
+ * exporter makers (c.f. ColumnarMaker.h) open a new scope for each record in
+ * `HandleRecord`. Outside of any scope (e.g. when the Vars are used to fill
+ * Spectra with SystShifts, which modify `prim` momenta in place) the summary
+ * is recomputed on every call. Identity of the record (address, run, event,
+ * ...) cannot be used as the memo key, since it is not changed by the shifts.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+
+#include "CAFAna/Core/Var.h"
+
+#include "StandardRecord/Proxy/SRProxy.h"
+
+namespace ana
+{
+
+struct FourMomentum
+{
+    double px = 0;
+    double py = 0;
+    double pz = 0;
+    double E  = 0;
+
+    double mag() const { return std::sqrt(px * px + py * py + pz * pz); }
+
+    template<typename P>
+    void add(const P &p, double sign = 1)
+    {
+        px += sign * double(p.px);
+        py += sign * double(p.py);
+        pz += sign * double(p.pz);
+        E  += sign * double(p.E);
+    }
+};
+
+struct TruthKinematics
+{
+    static constexpr int kPdgNeutron   = 2112;
+    static constexpr int kPdgProton    = 2212;
+    static constexpr int kPdgPiCharged = 211;
+    static constexpr int kPdgPi0       = 111;
+    static constexpr int kPdgPhoton    = 22;
+    static constexpr int kPdgNucleus   = 1000000000;
+
+    /* Sum over all final state particles */
+    FourMomentum all;
+    /* Sum over all final state particles, but neutrons */
+    FourMomentum noNeutrons;
+    /* Sum over all final state particles, but the primary lepton prim[0] */
+    FourMomentum hadronic;
+    /* Difference between neutrino and primary lepton four momenta */
+    FourMomentum hadSystem;
+
+    /* Multiplicities of the final state particles */
+    int nParticles  = 0;
+    int nProtons    = 0;
+    int nNeutrons   = 0;
+    int nPiCharged  = 0;
+    int nPi0        = 0;
+    int nPhotons    = 0;
+    int nLeptons    = 0;
+    int nOther      = 0;
+
+    void fill(const caf::SRProxy *sr)
+    {
+        *this = TruthKinematics();
+
+        const auto &nu   = sr->mc.nu[0];
+        const auto &prim = nu.prim;
+
+        hadSystem.add(nu.p);
+        if (! prim.empty()) {
+            hadSystem.add(prim[0].p, -1);
+        }
+
+        const size_t nPrim = prim.size();
+
+        for (size_t i = 0; i < nPrim; i++) {
+            const auto &particle = prim[i];
+            const int   pdg      = particle.pdg;
+
+            if (std::abs(pdg) >= kPdgNucleus) {
+                continue;
+            }
+
+            all.add(particle.p);
+
+            if (pdg != kPdgNeutron) {
+                noNeutrons.add(particle.p);
+            }
+
+            if (i > 0) {
+                hadronic.add(particle.p);
+            }
+
+            count(pdg);
+        }
+    }
+
+private:
+    void count(int pdg)
+    {
+        nParticles++;
+
+        switch (std::abs(pdg)) {
+        case kPdgProton:    nProtons++;   break;
+        case kPdgNeutron:   nNeutrons++;  break;
+        case kPdgPiCharged: nPiCharged++; break;
+        case kPdgPi0:       nPi0++;       break;
+        case kPdgPhoton:    nPhotons++;   break;
+        case 11: case 12: case 13: case 14: case 15: case 16:
+            nLeptons++;
+            break;
+        default:
+            nOther++;
+        }
+    }
+};
+
+/*
+ * TruthKinematicsScope -- while alive, TruthKinematics of each record are
+ * computed only once (per thread). Records must not be modified while the
+ * scope is open, e.g.
+ *
+ *     void HandleRecord(caf::SRProxy *sr) override
+ *     {
+ *         TruthKinematicsScope scope;
+ *         ... evaluate Vars on sr ...
+ *     }
+ */
+class TruthKinematicsScope
+{
+public:
+    TruthKinematicsScope() : fPrev(current())
+    {
+        thread_local uint64_t counter = 0;
+        current() = ++counter;
+    }
+
+    ~TruthKinematicsScope() { current() = fPrev; }
+
+    TruthKinematicsScope(const TruthKinematicsScope&) = delete;
+    TruthKinematicsScope& operator=(const TruthKinematicsScope&) = delete;
+
+    /* Generation of the innermost open scope, 0 if there is none */
+    static uint64_t& current()
+    {
+        thread_local uint64_t generation = 0;
+        return generation;
+    }
+
+private:
+    uint64_t fPrev;
+};
+
+/*
+ * Return TruthKinematics of the record `sr`. Memoized within the current
+ * TruthKinematicsScope only. The reference is valid until the next call.
+ */
+inline const TruthKinematics& GetTruthKinematics(const caf::SRProxy *sr)
+{
+    thread_local const caf::SRProxy *lastSr         = nullptr;
+    thread_local uint64_t            lastGeneration = 0;
+    thread_local TruthKinematics     lastValue;
+
+    const uint64_t generation = TruthKinematicsScope::current();
+
+    if ((generation == 0) || (generation != lastGeneration) || (sr != lastSr))
+    {
+        lastValue.fill(sr);
+        lastSr         = sr;
+        lastGeneration = generation;
+    }
+
+    return lastValue;
+}
+
+/* Create a Var that is an accessor into the memoized TruthKinematics */
+inline Var TruthKinematicsVar(
+    const std::function<double(const TruthKinematics&)> &accessor
+)
+{
+    return Var(
+        [accessor] (const caf::SRProxy *sr) -> double
+        { return accessor(GetTruthKinematics(sr)); }
+    );
+}
+
+}
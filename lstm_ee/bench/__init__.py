@@ -0,0 +1,22 @@
+"""
+Benchmarks of the `lstm_ee` data pipeline hot paths.
+
+This module contains a benchmark runner that times stages of the data
+pipeline (data loading, batch construction, batch decorators, caches and
+energy predictions) on synthetic datasets, and saves timings, throughputs and
+memory usage into a machine readable json file, that can be compared against
+a baseline to find performance regressions.
+"""
+
+from .bench      import (
+    BenchContext, StageTimer, SkipBenchmark, compare_results, format_results,
+    format_comparison, load_results, prepare_data, run_benchmarks,
+    save_results
+)
+from .benchmarks import BENCHMARKS
+
+__all__ = [
+    'BENCHMARKS', 'BenchContext', 'StageTimer', 'SkipBenchmark',
+    'compare_results', 'format_results', 'format_comparison', 'load_results',
+    'prepare_data', 'run_benchmarks', 'save_results'
+]
@@ -0,0 +1,574 @@
+"""
+Benchmark runner, timers and result bookkeeping.
+"""
+
+import contextlib
+import hashlib
+import json
+import logging
+import multiprocessing
+import os
+import platform
+import resource
+import subprocess
+import tempfile
+import time
+import traceback
+
+from collections import OrderedDict
+
+import numpy as np
+
+from lstm_ee.data.synthetic import make_synthetic_data, save_synthetic_data
+
+LOGGER = logging.getLogger('lstm_ee.bench')
+
+RESULTS_VERSION = 1
+FORMATS         = [ 'csv', 'hdf', 'lcol' ]
+
+STATUS_OK      = 'ok'
+STATUS_SKIPPED = 'skipped'
+STATUS_FAILED  = 'failed'
+
+class SkipBenchmark(Exception):
+    """Exception raised by a benchmark that cannot run in this environment"""
+
+class StageTimer:
+    """A collection of wall clock timings of the benchmark stages.
+
+    Examples
+    --------
+    >>> timer = StageTimer()
+    >>> with timer.stage('read', n_slices):
+    ...     read_data()
+    """
+
+    def __init__(self):
+        self.stages = OrderedDict()
+
+    @contextlib.contextmanager
+    def stage(self, name, slices):
+        """Time execution of the stage `name` that processes `slices` slices"""
+        start = time.perf_counter()
+        yield
+        seconds = time.perf_counter() - start
+
+        self.stages[name] = { 'seconds' : seconds, 'slices' : int(slices) }
+
+def _read_proc_status():
+    """Return dict of memory usage fields of /proc/self/status in MiB"""
+    result = {}
+
+    try:
+        with open('/proc/self/status', 'rt') as f:
+            for line in f:
+                key, _, value = line.partition(':')
+
+                if key in [ 'VmRSS', 'VmHWM' ]:
+                    result[key] = int(value.split()[0]) / 1024
+    except OSError:
+        pass
+
+    return result
+
+def get_rss_mb():
+    """Return current resident set size of the process in MiB"""
+    return _read_proc_status().get('VmRSS', None)
+
+def get_peak_rss_mb():
+    """Return peak resident set size of the process in MiB"""
+    status = _read_proc_status()
+
+    if 'VmHWM' in status:
+        return status['VmHWM']
+
+    # ru_maxrss is in KiB on Linux
+    return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+
+def get_peak_children_rss_mb():
+    """Return the largest peak resident set size of child processes in MiB"""
+    return resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss / 1024
+
+class BenchContext:
+    """Configuration and shared state of the benchmarks.
+
+    Parameters
+    ----------
+    paths : dict
+        Dictionary { FORMAT : PATH } of the synthetic dataset files.
+    config : dict
+        Dictionary with the variables of the dataset: 'vars_input_slice',
+        'vars_input_png3d', 'vars_input_png2d', 'var_target_total',
+        'var_target_primary'.
+    n_slices : int
+        Number of slices in the dataset.
+    batch_size : int, optional
+        Batch size of the data generators. Default: 1024.
+    max_prongs : int or None, optional
+        Maximum number of prongs of the data generators. Default: None.
+    workers : int or None, optional
+        Number of parallel workers of the caches and native kernels.
+        If None, the number of CPUs will be used. Default: None.
+    pipeline_format : str or None, optional
+        Format of the dataset used by the benchmarks of the data generator
+        stack. If None, the first available of 'lcol', 'hdf', 'csv' is used.
+        Default: None.
+    tmpdir : str or None, optional
+        Directory for the temporary files of the benchmarks. Default: None.
+    seed : int, optional
+        Seed of the shuffling and noise. Default: 0.
+    """
+
+    # pylint: disable=too-many-instance-attributes
+    def __init__(
+        self, paths, config, n_slices,
+        batch_size      = 1024,
+        max_prongs      = None,
+        workers         = None,
+        pipeline_format = None,
+        tmpdir          = None,
+        seed            = 0,
+    ):
+        self.paths      = paths
+        self.config     = config
+        self.n_slices   = n_slices
+        self.batch_size = batch_size
+        self.max_prongs = max_prongs
+        self.workers    = workers or os.cpu_count() or 1
+        self.tmpdir     = tmpdir
+        self.seed       = seed
+
+        if pipeline_format is None:
+            pipeline_format = next(
+                (x for x in [ 'lcol', 'hdf', 'csv' ] if x in paths), None
+            )
+
+        self.pipeline_format = pipeline_format
+
+    @property
+    def vars_input_slice(self):
+        """Slice level input variables"""
+        return self.config.get('vars_input_slice', None)
+
+    @property
+    def vars_input_png3d(self):
+        """3D prong level input variables"""
+        return self.config.get('vars_input_png3d', None)
+
+    @property
+    def vars_input_png2d(self):
+        """2D prong level input variables"""
+        return self.config.get('vars_input_png2d', None)
+
+    def make_loader(self, fmt = None):
+        """Create `IDataLoader` of the synthetic dataset in format `fmt`"""
+        # pylint: disable=import-outside-toplevel
+        from lstm_ee.data.data_loader import (
+            CSVLoader, ColumnarLoader, HDFLoader
+        )
+
+        fmt = fmt or self.pipeline_format
+
+        if fmt not in self.paths:
+            raise SkipBenchmark("Dataset in '%s' format is not available" % fmt)
+
+        if fmt == 'csv':
+            return CSVLoader(self.paths[fmt])
+        if fmt == 'hdf':
+            return HDFLoader(self.paths[fmt])
+        if fmt == 'lcol':
+            return ColumnarLoader(self.paths[fmt])
+
+        raise ValueError("Unknown dataset format: %s" % fmt)
+
+    def make_generator(self, data_loader = None, shuffle = True):
+        """Create `DataGenerator` of the synthetic dataset"""
+        # pylint: disable=import-outside-toplevel
+        from lstm_ee.data.data_generator import DataGenerator
+        from lstm_ee.data.data_loader    import DataShuffle
+
+        if data_loader is None:
+            data_loader = self.make_loader()
+
+        if shuffle:
+            data_loader = DataShuffle(data_loader, self.seed)
+
+        return DataGenerator(
+            data_loader,
+            batch_size         = self.batch_size,
+            max_prongs         = self.max_prongs,
+            vars_input_slice   = self.vars_input_slice,
+            vars_input_png3d   = self.vars_input_png3d,
+            vars_input_png2d   = self.vars_input_png2d,
+            var_target_total   = self.config.get('var_target_total', None),
+            var_target_primary = self.config.get('var_target_primary', None),
+        )
+
+def _config_hash(config, n_slices, seed):
+    config = json.dumps(
+        { 'config' : config, 'n_slices' : n_slices, 'seed' : seed },
+        sort_keys = True
+    )
+
+    return hashlib.sha1(config.encode('utf-8')).hexdigest()[:12]
+
+def _generate_data(paths, config, n_slices, seed):
+    LOGGER.info("Generating synthetic dataset with %d slices", n_slices)
+    data = make_synthetic_data(n_slices, seed = seed, **config)
+
+    for (fmt, path) in paths.items():
+        LOGGER.info("Saving synthetic dataset: %s", path)
+
+        # Save into a temporary file, so that interrupted runs are not reused
+        tmp_path = path + '.tmp'
+        save_synthetic_data(data, tmp_path, fmt)
+        os.replace(tmp_path, path)
+
+def prepare_data(datadir, config, n_slices, formats = None, seed = 0):
+    """Create synthetic dataset files unless they already exist.
+
+    Parameters
+    ----------
+    datadir : str
+        Directory where the dataset files are saved.
+    config : dict
+        Dataset variables. Passed as keyword arguments to
+        `make_synthetic_data`.
+    n_slices : int
+        Number of slices.
+    formats : list of str or None, optional
+        Formats of the dataset files. If None, all formats are created.
+        Default: None.
+    seed : int, optional
+        Seed of the synthetic data generator. Default: 0.
+
+    Returns
+    -------
+    dict
+        Dictionary { FORMAT : PATH } of the dataset files.
+
+    Notes
+    -----
+    File names are derived from a hash of the dataset configuration, so the
+    files are reused by subsequent runs with the same configuration.
+    """
+    formats = formats or FORMATS
+    stem    = os.path.join(
+        datadir, 'synthetic_%s' % _config_hash(config, n_slices, seed)
+    )
+    paths   = { fmt : '%s.%s' % (stem, fmt) for fmt in formats }
+    missing = [ fmt for fmt in formats if not os.path.exists(paths[fmt]) ]
+
+    if not missing:
+        return paths
+
+    os.makedirs(datadir, exist_ok = True)
+
+    # Dataset is generated in a child process, so that the memory it takes
+    # does not count towards the RSS of the benchmark processes
+    process = multiprocessing.get_context('fork').Process(
+        target = _generate_data,
+        args   = (
+            { fmt : paths[fmt] for fmt in missing }, config, n_slices, seed
+        )
+    )
+    process.start()
+    process.join()
+
+    if process.exitcode != 0:
+        raise RuntimeError("Failed to generate synthetic dataset")
+
+    return paths
+
+def _summarize(stages):
+    result = OrderedDict()
+
+    for (name, stage) in stages.items():
+        result[name] = {
+            'seconds'      : stage['seconds'],
+            'slices'       : stage['slices'],
+            'slices_per_s' : (
+                stage['slices'] / stage['seconds']
+                    if stage['seconds'] > 0 else None
+            ),
+        }
+
+    return result
+
+def _run_benchmark(func, ctx, repeat):
+    """Run benchmark `func` `repeat` times and return its result dict"""
+    result = OrderedDict([
+        ('status',               STATUS_OK),
+        ('reason',               None),
+        ('seconds',              None),
+        ('rss_start_mb',         get_rss_mb()),
+        ('peak_rss_mb',          None),
+        ('peak_rss_children_mb', None),
+        ('stages',               OrderedDict()),
+    ])
+
+    stages = OrderedDict()
+
+    try:
+        for _ in range(repeat):
+            timer = StageTimer()
+
+            with tempfile.TemporaryDirectory(
+                prefix = 'lstm_ee_bench_', dir = ctx.tmpdir
+            ) as tmpdir:
+                func(ctx, timer, tmpdir)
+
+            # The fastest of the repeated runs is the least noisy estimate
+            for (name, stage) in timer.stages.items():
+                if (
+                       (name not in stages)
+                    or (stage['seconds'] < stages[name]['seconds'])
+                ):
+                    stages[name] = stage
+
+    except SkipBenchmark as e:
+        result['status'] = STATUS_SKIPPED
+        result['reason'] = str(e)
+
+    except Exception: # pylint: disable=broad-except
+        result['status'] = STATUS_FAILED
+        result['reason'] = traceback.format_exc()
+
+    result['stages']               = _summarize(stages)
+    result['seconds']              = sum(x['seconds'] for x in stages.values())
+    result['peak_rss_mb']          = get_peak_rss_mb()
+    result['peak_rss_children_mb'] = get_peak_children_rss_mb()
+
+    return result
+
+def _child_main(conn, func, ctx, repeat):
+    try:
+        conn.send(_run_benchmark(func, ctx, repeat))
+    finally:
+        conn.close()
+
+def _run_isolated(func, ctx, repeat):
+    """Run benchmark in a forked process, so that peak RSS is its own"""
+    mp_ctx = multiprocessing.get_context('fork')
+    reader, writer = mp_ctx.Pipe(duplex = False)
+
+    process = mp_ctx.Process(
+        target = _child_main, args = (writer, func, ctx, repeat)
+    )
+    process.start()
+    writer.close()
+
+    try:
+        result = reader.recv()
+    except EOFError:
+        result = OrderedDict([
+            ('status',  STATUS_FAILED),
+            ('reason',  None),
+            ('seconds', None),
+            ('stages',  OrderedDict()),
+        ])
+
+    process.join()
+
+    if process.exitcode != 0:
+        result['status'] = STATUS_FAILED
+        result['reason'] = "%sBenchmark process exited with code %s" % (
+            result['reason'] or '', process.exitcode
+        )
+
+    return result
+
+def _get_git_commit():
+    root = os.path.dirname(os.path.dirname(os.path.dirname(
+        os.path.abspath(__file__)
+    )))
+
+    try:
+        return subprocess.check_output(
+            [ 'git', 'rev-parse', 'HEAD' ], cwd = root,
+            stderr = subprocess.DEVNULL
+        ).decode('utf-8').strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+def get_metadata(ctx, repeat):
+    """Collect description of the machine and the benchmark configuration"""
+    return OrderedDict([
+        ('version',         RESULTS_VERSION),
+        ('time',            time.strftime('%Y-%m-%dT%H:%M:%S%z')),
+        ('git_commit',      _get_git_commit()),
+        ('hostname',        platform.node()),
+        ('platform',        platform.platform()),
+        ('python',          platform.python_version()),
+        ('numpy',           np.__version__),
+        ('cpu_count',       os.cpu_count()),
+        ('n_slices',        ctx.n_slices),
+        ('batch_size',      ctx.batch_size),
+        ('max_prongs',      ctx.max_prongs),
+        ('workers',         ctx.workers),
+        ('pipeline_format', ctx.pipeline_format),
+        ('repeat',          repeat),
+    ])
+
+def run_benchmarks(ctx, benchmarks, repeat = 1, isolate = True):
+    """Run benchmarks and collect their results.
+
+    Parameters
+    ----------
+    ctx : BenchContext
+        Benchmark configuration.
+    benchmarks : dict
+        Dictionary { NAME : FUNC } of benchmarks to run. Each benchmark is
+        a function FUNC(ctx, timer, tmpdir) that times its stages with the
+        `StageTimer` `timer`, and may raise `SkipBenchmark`.
+    repeat : int, optional
+        Number of times each benchmark is run. For each stage the fastest
+        time is reported. Default: 1.
+    isolate : bool, optional
+        If True, each benchmark is run in a separate forked process, such
+        that the reported peak RSS is not affected by other benchmarks.
+        Default: True.
+
+    Returns
+    -------
+    dict
+        Benchmark results of the form
+        { 'meta' : METADATA, 'benchmarks' : { NAME : RESULT } }, where
+        each RESULT holds 'status', 'reason', total 'seconds', memory usage
+        ('rss_start_mb', 'peak_rss_mb', 'peak_rss_children_mb') and 'stages'
+        with 'seconds', 'slices' and 'slices_per_s' of each stage.
+    """
+    results = OrderedDict()
+
+    for (name, func) in benchmarks.items():
+        LOGGER.info("Running benchmark: %s", name)
+
+        if isolate:
+            result = _run_isolated(func, ctx, repeat)
+        else:
+            result = _run_benchmark(func, ctx, repeat)
+
+        if result['status'] == STATUS_FAILED:
+            LOGGER.error("Benchmark '%s' failed: %s", name, result['reason'])
+
+        results[name] = result
+
+    return OrderedDict([
+        ('meta',       get_metadata(ctx, repeat)),
+        ('benchmarks', results),
+    ])
+
+def save_results(results, path):
+    """Save benchmark `results` into a json file `path`"""
+    with open(path, 'wt') as f:
+        json.dump(results, f, indent = 4)
+
+def load_results(path):
+    """Load benchmark results saved by `save_results`"""
+    with open(path, 'rt') as f:
+        return json.load(f, object_pairs_hook = OrderedDict)
+
+def compare_results(baseline, current, threshold = 0.1):
+    """Compare benchmark results against a baseline.
+
+    Parameters
+    ----------
+    baseline : dict
+        Baseline benchmark results.
+    current : dict
+        Current benchmark results.
+    threshold : float, optional
+        Relative change of a stage time or peak RSS above which it is
+        considered to be a regression. Default: 0.1.
+
+    Returns
+    -------
+    list of dict
+        List of changes of the stages that ran successfully in both results.
+        Each change holds 'benchmark', 'stage' (None for the peak RSS),
+        'metric' ('seconds' or 'peak_rss_mb'), 'baseline', 'current', relative
+        'change' and 'regression' flag.
+    """
+    result = []
+
+    def add_change(bench, stage, metric, null, test):
+        if (null is None) or (test is None) or (null <= 0):
+            return
+
+        change = (test - null) / null
+
+        result.append(OrderedDict([
+            ('benchmark',  bench),
+            ('stage',      stage),
+            ('metric',     metric),
+            ('baseline',   null),
+            ('current',    test),
+            ('change',     change),
+            ('regression', change > threshold),
+        ]))
+
+    for (bench, test) in current['benchmarks'].items():
+        null = baseline['benchmarks'].get(bench, None)
+
+        if (
+               (null is None)
+            or (null['status'] != STATUS_OK)
+            or (test['status'] != STATUS_OK)
+        ):
+            continue
+
+        for (stage, test_stage) in test['stages'].items():
+            if stage in null['stages']:
+                add_change(
+                    bench, stage, 'seconds',
+                    null['stages'][stage]['seconds'], test_stage['seconds']
+                )
+
+        add_change(
+            bench, None, 'peak_rss_mb',
+            null.get('peak_rss_mb'), test.get('peak_rss_mb')
+        )
+
+    return result
+
+def _fmt(value, spec):
+    return '-' if value is None else (spec % value)
+
+def format_results(results):
+    """Format benchmark `results` as a human readable table"""
+    lines = [ '%-24s %-24s %10s %14s %10s' % (
+        'benchmark', 'stage', 'seconds', 'slices/s', 'peak MiB'
+    ) ]
+
+    for (bench, result) in results['benchmarks'].items():
+        if result['status'] != STATUS_OK:
+            reason = (result['reason'] or '').strip().splitlines()
+            lines.append('%-24s %s: %s' % (
+                bench, result['status'], reason[-1] if reason else ''
+            ))
+            continue
+
+        for (stage, values) in result['stages'].items():
+            lines.append('%-24s %-24s %10s %14s %10s' % (
+                bench, stage,
+                _fmt(values['seconds'],      '%.3f'),
+                _fmt(values['slices_per_s'], '%.0f'),
+                _fmt(result['peak_rss_mb'],  '%.0f'),
+            ))
+
+    return '\n'.join(lines)
+
+def format_comparison(changes):
+    """Format changes returned by `compare_results` as a table"""
+    lines = [ '%-24s %-24s %12s %12s %9s' % (
+        'benchmark', 'stage', 'baseline', 'current', 'change'
+    ) ]
+
+    for change in changes:
+        lines.append('%-24s %-24s %12.3f %12.3f %+8.1f%%%s' % (
+            change['benchmark'], change['stage'] or change['metric'],
+            change['baseline'], change['current'], 100 * change['change'],
+            '  REGRESSION' if change['regression'] else ''
+        ))
+
+    return '\n'.join(lines)
@@ -0,0 +1,454 @@
+"""
+Benchmarks of the data pipeline stages.
+
+Each benchmark is a function `benchmark(ctx, timer, tmpdir)` that times its
+stages with the `StageTimer` `timer` (c.f. `run_benchmarks`). Stages of a
+benchmark are either consecutive steps (e.g. filling and reading a cache), or
+alternative implementations of the same step (e.g. python and native kernels).
+"""
+
+import os
+
+from collections import OrderedDict
+from types import SimpleNamespace
+
+import numpy as np
+
+from lstm_ee.data.data_generator import (
+    DataBatchTransform, DataDiskCache, DataNANMask, DataNoise,
+    DataProngSorter, MultiprocessedCache
+)
+from lstm_ee.data.data_generator.funcs.funcs_varr import (
+    c_join_varr_arrays, join_csr_arrays, join_varr_arrays, unpack_varr_arrays
+)
+from lstm_ee.data.data_loader import DictLoader
+
+from .bench import SkipBenchmark
+
+DEF_NOISE = {
+    'noise'        : 'discrete',
+    'noise_kwargs' : { 'values' : [ -0.2, 0, 0.2 ] },
+}
+
+# Layer sizes of the network used to benchmark predictions. They follow the
+# production `lstm_v3` training configurations.
+MODEL_LSTM_UNITS  = 32
+MODEL_LAYERS_PRE  = [ 128, 128, 128 ]
+MODEL_LAYERS_POST = [ 128, 128, 128 ]
+
+def _energy_vars(variables):
+    """Select calorimetric energy variables from `variables`"""
+    return [ v for v in (variables or []) if v.lower().endswith('cale') ]
+
+def get_prong_sorters(ctx):
+    """Sort prongs by decreasing calorimetric energy, if it is available"""
+    result = {}
+
+    for (input_name, variables) in [
+        ('input_png3d', ctx.vars_input_png3d),
+        ('input_png2d', ctx.vars_input_png2d),
+    ]:
+        energy = _energy_vars(variables)
+        if energy:
+            result[input_name] = '-' + energy[-1]
+
+    return result
+
+def get_noise(ctx):
+    """Discrete noise of calorimetric energies, like in the training configs"""
+    return {
+        **DEF_NOISE,
+        'affected_vars_slice' : _energy_vars(ctx.vars_input_slice),
+        'affected_vars_png3d' : _energy_vars(ctx.vars_input_png3d),
+        'affected_vars_png2d' : _energy_vars(ctx.vars_input_png2d),
+    }
+
+def _batch_indices(ctx, shuffle = False):
+    index = np.arange(ctx.n_slices)
+
+    if shuffle:
+        np.random.RandomState(ctx.seed).shuffle(index)
+
+    return [
+        index[start:start + ctx.batch_size]
+            for start in range(0, ctx.n_slices, ctx.batch_size)
+    ]
+
+def _iterate(dgen):
+    """Construct all batches of `dgen`"""
+    for index in range(len(dgen)):
+        dgen[index] # pylint: disable=pointless-statement
+
+def _read_batches(ctx, data_loader, batches):
+    """Read batches `batches` of all input variables from `data_loader`"""
+    vars_slice = ctx.vars_input_slice or []
+    vars_varr  = (ctx.vars_input_png3d or []) + (ctx.vars_input_png2d or [])
+
+    for index in batches:
+        for var in vars_slice:
+            data_loader.get(var, index)
+
+        for var in vars_varr:
+            if data_loader.has_csr:
+                data_loader.get_csr(var, index)
+            else:
+                data_loader.get(var, index)
+
+def _bench_loader(fmt, ctx, timer):
+    with timer.stage('open', ctx.n_slices):
+        data_loader = ctx.make_loader(fmt)
+
+    with timer.stage('read_sequential', ctx.n_slices):
+        _read_batches(ctx, data_loader, _batch_indices(ctx, False))
+
+    # Reopen, so that shuffled reads do not benefit from the loader caches
+    data_loader = ctx.make_loader(fmt)
+
+    with timer.stage('read_shuffled', ctx.n_slices):
+        _read_batches(ctx, data_loader, _batch_indices(ctx, True))
+
+def bench_load_csv(ctx, timer, _tmpdir):
+    """Parse csv file and read batches of all input variables"""
+    _bench_loader('csv', ctx, timer)
+
+def bench_load_hdf(ctx, timer, _tmpdir):
+    """Open hdf file and read batches of all input variables"""
+    _bench_loader('hdf', ctx, timer)
+
+def bench_load_hdf_uncached(ctx, timer, _tmpdir):
+    """Read shuffled batches of hdf file that is larger than the block cache.
+
+    Stage `read_blocks` always reads whole blocks, stage `read_sparse` reads
+    sparse rows of the blocks directly.
+    """
+    # pylint: disable=import-outside-toplevel
+    from lstm_ee.data.data_loader.hdf_loader import (
+        DEF_SPARSE_RATIO, HDFLoader
+    )
+
+    if 'hdf' not in ctx.paths:
+        raise SkipBenchmark("Dataset in 'hdf' format is not available")
+
+    # Compressed file size is a lower bound of the decompressed data size
+    cache_size = os.path.getsize(ctx.paths['hdf']) // 8
+
+    for (stage, sparse_ratio) in [
+        ('read_blocks', None), ('read_sparse', DEF_SPARSE_RATIO)
+    ]:
+        data_loader = HDFLoader(
+            ctx.paths['hdf'],
+            chunk_cache_size = cache_size,
+            sparse_ratio     = sparse_ratio
+        )
+
+        with timer.stage(stage, ctx.n_slices):
+            _read_batches(ctx, data_loader, _batch_indices(ctx, True))
+
+def bench_load_columnar(ctx, timer, _tmpdir):
+    """Open columnar file and read batches of all input variables"""
+    _bench_loader('lcol', ctx, timer)
+
+def _check_varr(ctx):
+    if not ctx.vars_input_png3d:
+        raise SkipBenchmark("No 3D prong variables")
+
+def bench_join_varr(ctx, timer, _tmpdir):
+    """Join batches of 3D prong variables into padded arrays"""
+    _check_varr(ctx)
+
+    data_loader = ctx.make_loader()
+    variables   = ctx.vars_input_png3d
+    batches     = _batch_indices(ctx, True)
+
+    varr_batches = [
+        [ data_loader.get(v, index) for v in variables ] for index in batches
+    ]
+
+    with timer.stage('join_varr_arrays', ctx.n_slices):
+        for batch in varr_batches:
+            join_varr_arrays(batch, ctx.max_prongs)
+
+    with timer.stage('c_join_varr_arrays', ctx.n_slices):
+        for batch in varr_batches:
+            c_join_varr_arrays(batch, ctx.max_prongs)
+
+    if not data_loader.has_csr:
+        return
+
+    csr_batches = [
+        [ data_loader.get_csr(v, index) for v in variables ]
+            for index in batches
+    ]
+
+    with timer.stage('join_csr_arrays', ctx.n_slices):
+        for batch in csr_batches:
+            join_csr_arrays(batch, ctx.max_prongs)
+
+def bench_unpack_varr(ctx, timer, _tmpdir):
+    """Unpack 3D prong variables from data loaders into padded arrays"""
+    _check_varr(ctx)
+
+    data_loader = ctx.make_loader()
+    variables   = ctx.vars_input_png3d
+    batches     = _batch_indices(ctx, True)
+
+    dict_loader = DictLoader({
+        v : data_loader.get(v, None) for v in variables
+    })
+
+    for (name, loader) in [
+        ('unpack_varr',     dict_loader),
+        ('unpack_varr_csr', data_loader),
+    ]:
+        if (loader is data_loader) and (not loader.has_csr):
+            continue
+
+        with timer.stage(name, ctx.n_slices):
+            for index in batches:
+                unpack_varr_arrays(loader, variables, index, ctx.max_prongs)
+
+def bench_data_generator(ctx, timer, _tmpdir):
+    """Construct shuffled batches with `DataGenerator`"""
+    dgen = ctx.make_generator()
+
+    with timer.stage('batches', ctx.n_slices):
+        _iterate(dgen)
+
+def bench_prong_sort(ctx, timer, _tmpdir):
+    """Sort prongs with a chain of `DataProngSorter` and with the fused kernel
+
+    Stage 'base' times construction of batches without sorting.
+    """
+    prong_sorters = get_prong_sorters(ctx)
+
+    if not prong_sorters:
+        raise SkipBenchmark("No prong energy variables to sort by")
+
+    with timer.stage('base', ctx.n_slices):
+        _iterate(ctx.make_generator())
+
+    dgen = ctx.make_generator()
+
+    for (input_name, sort_type) in prong_sorters.items():
+        dgen = DataProngSorter(
+            dgen, sort_type, input_name, getattr(dgen, 'vars_' + input_name)
+        )
+
+    with timer.stage('prong_sorter', ctx.n_slices):
+        _iterate(dgen)
+
+    dgen = DataBatchTransform(ctx.make_generator(), prong_sorters, mask = None)
+
+    with timer.stage('fused', ctx.n_slices):
+        _iterate(dgen)
+
+def bench_noise_mask(ctx, timer, _tmpdir):
+    """Apply noise and NaN mask with a chain of decorators and fused kernel
+
+    Stage 'base' times construction of batches without transformations.
+    """
+    noise = get_noise(ctx)
+
+    with timer.stage('base', ctx.n_slices):
+        _iterate(ctx.make_generator())
+
+    np.random.seed(ctx.seed)
+    dgen = DataNANMask(DataNoise(ctx.make_generator(), **noise))
+
+    with timer.stage('noise_mask', ctx.n_slices):
+        _iterate(dgen)
+
+    np.random.seed(ctx.seed)
+    dgen = DataBatchTransform(ctx.make_generator(), noise = noise)
+
+    with timer.stage('fused', ctx.n_slices):
+        _iterate(dgen)
+
+def bench_disk_cache(ctx, timer, tmpdir):
+    """Fill `DataDiskCache` and read all batches back"""
+    dgen = DataDiskCache(
+        ctx.make_generator(), tmpdir, batch_size = ctx.batch_size
+    )
+
+    with timer.stage('fill', ctx.n_slices):
+        _iterate(dgen)
+
+    with timer.stage('read', ctx.n_slices):
+        _iterate(dgen)
+
+def bench_multiprocessed_cache(ctx, timer, tmpdir):
+    """Precompute batches with `MultiprocessedCache` and read them back"""
+    dgen = MultiprocessedCache(ctx.make_generator(), ctx.workers, tmpdir)
+
+    with timer.stage('precompute', ctx.n_slices):
+        dgen[0] # pylint: disable=pointless-statement
+
+    with timer.stage('read', ctx.n_slices):
+        _iterate(dgen)
+
+    del dgen
+
+def make_bench_flat_model(ctx, seed = 0):
+    """Create a `FlatModel` with random weights and `lstm_v3` structure"""
+    # pylint: disable=import-outside-toplevel
+    from lstm_ee.inference import FlatModel, InputSpec
+    from lstm_ee.inference.flat_model import (
+        ACTIVATIONS, INPUT_PNG2D, INPUT_PNG3D, INPUT_SLICE, LAYER_CONCATENATE,
+        LAYER_DENSE, LAYER_INPUT, LAYER_LSTM, LAYER_MASKING
+    )
+
+    # pylint: disable=too-many-locals
+    prg = np.random.RandomState(seed)
+    act = ACTIVATIONS
+
+    def weights(*shape):
+        return prg.normal(scale = 1 / np.sqrt(shape[0]), size = shape)
+
+    def dense_stack(name, layer, n_in, sizes):
+        for (idx, n_out) in enumerate(sizes):
+            layer = model.add_layer(
+                LAYER_DENSE, '%s-%d' % (name, idx), [ layer ], [ act['relu'] ],
+                [ weights(n_in, n_out), weights(n_out) ]
+            )
+            n_in = n_out
+
+        return (layer, n_in)
+
+    def lstm(name, layer, n_in, params):
+        units = MODEL_LSTM_UNITS
+        return model.add_layer(
+            LAYER_LSTM, name, [ layer ], [ units ] + params,
+            [ weights(n_in, 4 * units), weights(units, 4 * units),
+              weights(4 * units) ]
+        )
+
+    sorters = get_prong_sorters(ctx)
+    inputs  = {}
+    merged  = []
+    n_merged = 0
+
+    model = FlatModel(
+        layers = [], inputs = inputs, outputs = {},
+        max_prongs = ctx.max_prongs
+    )
+
+    if ctx.vars_input_slice:
+        inputs[INPUT_SLICE] = InputSpec(ctx.vars_input_slice, None, False)
+        merged.append(
+            model.add_layer(LAYER_INPUT, 'input_slice', [], [ INPUT_SLICE ])
+        )
+        n_merged += len(ctx.vars_input_slice)
+
+    for (kind, name, variables) in [
+        (INPUT_PNG3D, 'input_png3d', ctx.vars_input_png3d),
+        (INPUT_PNG2D, 'input_png2d', ctx.vars_input_png2d),
+    ]:
+        if not variables:
+            continue
+
+        sort_var_idx = None
+        if name in sorters:
+            sort_var_idx = variables.index(sorters[name][1:])
+
+        inputs[kind] = InputSpec(variables, sort_var_idx, False)
+
+        layer = model.add_layer(LAYER_INPUT, name, [], [ kind ])
+        layer = model.add_layer(
+            LAYER_MASKING, name + '-mask', [ layer ], [], [ [0] ]
+        )
+        layer, n_in = dense_stack(
+            name + '-pre', layer, len(variables), MODEL_LAYERS_PRE
+        )
+        layer = lstm(
+            name + '-lstm', layer, n_in,
+            [ act['tanh'], act['hard_sigmoid'], 0, 0, 0 ]
+        )
+
+        merged.append(layer)
+        n_merged += MODEL_LSTM_UNITS
+
+    layer = model.add_layer(LAYER_CONCATENATE, 'merged', merged)
+    layer, n_in = dense_stack('post', layer, n_merged, MODEL_LAYERS_POST)
+
+    for output in [ 'target_total', 'target_primary' ]:
+        model.outputs[output] = model.add_layer(
+            LAYER_DENSE, output, [ layer ], [ act['linear'] ],
+            [ weights(n_in, 1), weights(1) ]
+        )
+
+    return model
+
+def bench_predict_native(ctx, timer, tmpdir):
+    """Predict energies with the native inference engine"""
+    # pylint: disable=import-outside-toplevel
+    from lstm_ee.inference import NativeModel
+
+    path = os.path.join(tmpdir, 'model.bin')
+    make_bench_flat_model(ctx).save(path)
+
+    data_loader = ctx.make_loader()
+
+    with timer.stage('load_model', ctx.n_slices):
+        model = NativeModel(path, ctx.workers)
+
+    with timer.stage('predict', ctx.n_slices):
+        for index in _batch_indices(ctx, False):
+            model.predict_data_loader(data_loader, index)
+
+def bench_predict_energies(ctx, timer, _tmpdir):
+    """Predict energies of an untrained `lstm_v3` `keras` model"""
+    # pylint: disable=import-outside-toplevel
+    try:
+        from lstm_ee.data.data_generator.keras_sequence import KerasSequence
+        from lstm_ee.eval.predict import predict_energies
+        from lstm_ee.train.setup  import select_model
+    except ImportError as e:
+        raise SkipBenchmark("keras is not available: %s" % e)
+
+    args = SimpleNamespace(
+        model = {
+            'name'   : 'lstm_v3',
+            'kwargs' : {
+                'lstm_units2d' : MODEL_LSTM_UNITS,
+                'lstm_units3d' : MODEL_LSTM_UNITS,
+                'layers_pre'   : MODEL_LAYERS_PRE,
+                'layers_post'  : MODEL_LAYERS_POST,
+            },
+        },
+        regularizer        = None,
+        max_prongs         = ctx.max_prongs,
+        vars_input_slice   = ctx.vars_input_slice,
+        vars_input_png3d   = ctx.vars_input_png3d,
+        vars_input_png2d   = ctx.vars_input_png2d,
+        var_target_total   = ctx.config.get('var_target_total', None),
+        var_target_primary = ctx.config.get('var_target_primary', None),
+        cache              = True,
+        concurrency        = None,
+        workers            = None,
+    )
+
+    with timer.stage('build_model', ctx.n_slices):
+        model = select_model(args)
+
+    dgen = KerasSequence(DataBatchTransform(
+        ctx.make_generator(shuffle = False), get_prong_sorters(ctx)
+    ))
+
+    with timer.stage('predict', ctx.n_slices):
+        predict_energies(args, dgen, model)
+
+BENCHMARKS = OrderedDict([
+    ('load_csv',             bench_load_csv),
+    ('load_hdf',             bench_load_hdf),
+    ('load_hdf_uncached',    bench_load_hdf_uncached),
+    ('load_columnar',        bench_load_columnar),
+    ('join_varr',            bench_join_varr),
+    ('unpack_varr',          bench_unpack_varr),
+    ('data_generator',       bench_data_generator),
+    ('prong_sort',           bench_prong_sort),
+    ('noise_mask',           bench_noise_mask),
+    ('disk_cache',           bench_disk_cache),
+    ('multiprocessed_cache', bench_multiprocessed_cache),
+    ('predict_native',       bench_predict_native),
+    ('predict_energies',     bench_predict_energies),
+])
@@ -9,22 +9,35 @@ import os
 import numpy as np
 
 from lstm_ee.data.data_loader import (
-    CSVLoader, HDFLoader, DictLoader, DataShuffle, DataSlice
+    CSVLoader, ColumnarLoader, HDFLoader, DictLoader, DataShuffle, DataSlice
 )
 from lstm_ee.data.data_generator import (
-    DataCache, DataDiskCache, DataGenerator, DataNANMask, DataNoise,
-    DataProngSorter, DataWeight, MultiprocessedCache, MultithreadedCache
+    DataBatchTransform, DataCache, DataDiskCache, DataGenerator, DataNANMask,
+    DataNoise, DataProngSorter, DataWeight, MultiprocessedCache,
+    MultithreadedCache
+)
+from lstm_ee.data.data_generator.funcs.weights      import (
+    DEF_FLAT_VAR, flat_weights
 )
-from lstm_ee.data.data_generator.funcs.weights      import flat_weights
 
-H5_EXTS = [ 'h5', 'hdf', 'hdf5' ]
-LOGGER  = logging.getLogger('lstm_ee.data')
+H5_EXTS       = [ 'h5', 'hdf', 'hdf5' ]
+COLUMNAR_EXTS = [ 'lcol' ]
+LOGGER        = logging.getLogger('lstm_ee.data')
 
-def guess_data_loader(path):
+def guess_data_loader(path, variables = None):
     """Find appropriate DataLoader based on a file path
 
     This function tries to guess proper instance of `IDataLoader` based on a
     file extension.
+
+    Parameters
+    ----------
+    path : str or dict
+        File path from which dataset will be loaded.
+    variables : list of str or None, optional
+        Variables that are going to be used. DataLoaders that need to parse
+        the dataset (e.g. `CSVLoader`) will parse only these variables
+        upfront. If None, all variables will be parsed.
     """
     if isinstance(path, dict):
         return DictLoader(path)
@@ -34,7 +47,11 @@ def guess_data_loader(path):
             if path.endswith(ext):
                 return HDFLoader(path)
 
-        return CSVLoader(path)
+        for ext in COLUMNAR_EXTS:
+            if path.endswith(ext):
+                return ColumnarLoader(path)
+
+        return CSVLoader(path, variables)
 
     raise RuntimeError("Unknown how to load data: %s" % (path))
 
@@ -78,7 +95,7 @@ def train_test_split(data_loader, test_size):
         DataSlice(data_loader, indices[n_train:]),
     ]
 
-def construct_data_loader(path, seed, test_size):
+def construct_data_loader(path, seed, test_size, variables = None):
     """Load dataset to DataLoader, shuffle it and split into train/test parts.
 
     Parameters
@@ -90,6 +107,8 @@ def construct_data_loader(path, seed, test_size):
     test_size : int or float or None
         Fraction of the dataset that will go to the test sample.
         C.f. `train_test_split` for the detailed description.
+    variables : list of str or None, optional
+        Variables that are going to be used. C.f. `guess_data_loader`.
 
     Returns
     -------
@@ -101,7 +120,7 @@ def construct_data_loader(path, seed, test_size):
     train_test_split
     """
 
-    data_loader = guess_data_loader(path)
+    data_loader = guess_data_loader(path, variables)
     data_loader = DataShuffle(data_loader, seed)
 
     return train_test_split(data_loader, test_size)
@@ -165,6 +184,32 @@ def get_weights(weights):
 
     return weights
 
+def get_weight_variables(weights):
+    """Get names of the variables that weights `weights` are calculated from.
+
+    Parameters
+    ----------
+    weights : dict or str or None
+        Weights specification. C.f. `get_weights`.
+
+    Returns
+    -------
+    list of str
+        Names of the variables that `DataWeight` will request from the
+        `IDataLoader` to calculate weights `weights`.
+    """
+
+    if weights is None:
+        return []
+
+    if isinstance(weights, str):
+        return [ weights ]
+
+    if weights['name'] == 'flat':
+        return [ weights.get('kwargs', {}).get('var', DEF_FLAT_VAR) ]
+
+    return []
+
 def add_cache_decorators(dgen_list, cache, concurrency, workers):
     """Add cache decorators to the DataGenerators from `dgen_list` list.
 
@@ -343,6 +388,61 @@ def add_prong_sorters(
 
     return dgen_list
 
+def add_batch_transforms(
+    dgen_list, prong_sorters, noise, vars_input_png2d, vars_input_png3d
+):
+    """Add prong sorting, noise and NaN masking to the DataGenerators.
+
+    If possible, all three transformations are performed by a single fused
+    `DataBatchTransform` decorator. Otherwise, (e.g. for randomized prong
+    order) a chain of `DataProngSorter`, `DataNoise` and `DataNANMask`
+    decorators is used.
+
+    Parameters
+    ----------
+    dgen_list : list of IDataGenerator
+        A list of DataGenerators to be decorated.
+    prong_sorters : dict or None
+        Prong sorting specifications. C.f. `add_prong_sorters`.
+    noise : list of dict or dict or None
+        Noise configuration. C.f. `add_noise`.
+    vars_input_png2d : list of str or None
+        Names of 2D prong level input variables that DataGenerators from
+        `dgen_list` will be generating batches for.
+    vars_input_png3d : list of str or None
+        Names of 3D prong level input variables that DataGenerators from
+        `dgen_list` will be generating batches for.
+
+    Returns
+    -------
+    list of IDataGenerator
+        Decorated DataGenerators.
+
+    See Also
+    --------
+    DataBatchTransform
+    add_prong_sorters
+    add_noise
+    """
+
+    if not DataBatchTransform.supports(prong_sorters):
+        dgen_list = add_prong_sorters(
+            dgen_list, prong_sorters, vars_input_png2d, vars_input_png3d
+        )
+        dgen_list = add_noise(dgen_list, noise)
+
+        return [ DataNANMask(x) for x in dgen_list ]
+
+    if noise is not None:
+        LOGGER.info(
+            "Adding noise: %s",
+            json.dumps(noise, sort_keys = True, indent = 4)
+        )
+
+    return [
+        DataBatchTransform(x, prong_sorters, noise) for x in dgen_list
+    ]
+
 def create_basic_data_generators(
     datadir            = None,
     dataset            = None,
@@ -356,6 +456,7 @@ def create_basic_data_generators(
     var_target_total   = None,
     var_target_primary = None,
     disk_cache         = None,
+    weights            = None,
 ):
     """
     Load dataset, shuffle, and create train/test DataGenerators.
@@ -390,6 +491,10 @@ def create_basic_data_generators(
         the event (e.g. lepton energy).
     disk_cache : bool or None
         If True then disk cache decorators will be used.
+    weights : dict or str or None, optional
+        Weights specification that will be applied to the DataGenerators by
+        `add_weights`. Only used to select variables that `CSVLoader` parses
+        upfront. C.f. `get_weight_variables`. Default: None.
 
     Returns
     -------
@@ -405,7 +510,19 @@ def create_basic_data_generators(
 
     LOGGER.info("Loading %s dataset from %s.", dataset, datadir)
     path = os.path.join(datadir, dataset)
-    data_loader_list = construct_data_loader(path, seed, test_size)
+
+    # Weights are frequently calculated from one of the targets
+    variables = list(dict.fromkeys(
+        v for v in (
+              (vars_input_slice or [])
+            + (vars_input_png3d or [])
+            + (vars_input_png2d or [])
+            + [ var_target_total, var_target_primary ]
+            + get_weight_variables(weights)
+        ) if v is not None
+    ))
+
+    data_loader_list = construct_data_loader(path, seed, test_size, variables)
 
     LOGGER.info(
           "Creating data generators with:\n"
@@ -517,25 +634,22 @@ def create_data_generators(
     create_basic_data_generators
     add_weights
     add_cache_decorators
-    add_prong_sorters
-    add_noise
+    add_batch_transforms
     """
 
 
     dgen_list = create_basic_data_generators(
         datadir, dataset, batch_size, max_prongs, seed, test_size,
         vars_input_slice, vars_input_png3d, vars_input_png2d,
-        var_target_total, var_target_primary, disk_cache
+        var_target_total, var_target_primary, disk_cache, weights
     )
 
     dgen_list = add_weights(dgen_list, batch_size, weights)
     dgen_list = add_cache_decorators(dgen_list, cache, concurrency, workers)
 
-    dgen_list = add_prong_sorters(
-        dgen_list, prong_sorters, vars_input_png2d, vars_input_png3d
+    dgen_list = add_batch_transforms(
+        dgen_list, prong_sorters, noise, vars_input_png2d, vars_input_png3d
     )
-    dgen_list = add_noise(dgen_list, noise)
-    dgen_list = [ DataNANMask(x) for x in dgen_list ]
 
     # pylint: disable = import-outside-toplevel
     from lstm_ee.data.data_generator.keras_sequence import KerasSequence
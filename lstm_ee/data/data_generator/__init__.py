@@ -8,6 +8,7 @@ This module also defines a number of transformations that modify data batches
 produced by the `DataGenerator` (following the Decorator Pattern).
 """
 
+from .data_batch_transform import DataBatchTransform
 from .data_cache           import DataCache
 from .data_disk_cache      import DataDiskCache
 from .data_generator       import DataGenerator
@@ -20,8 +21,8 @@ from .multiprocessed_cache import MultiprocessedCache
 from .multithreaded_cache  import MultithreadedCache
 
 __all__ = [
-    'DataCache', 'DataDiskCache', 'DataGenerator', 'DataNANMask', 'DataNoise',
-    'DataProngSorter', 'DataSmear', 'DataWeight', 'MultiprocessedCache',
-    'MultithreadedCache'
+    'DataBatchTransform', 'DataCache', 'DataDiskCache', 'DataGenerator',
+    'DataNANMask', 'DataNoise', 'DataProngSorter', 'DataSmear', 'DataWeight',
+    'MultiprocessedCache', 'MultithreadedCache'
 ]
 
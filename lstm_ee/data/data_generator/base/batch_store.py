@@ -0,0 +1,348 @@
+"""
+A definition of a memory mapped store of data batches.
+"""
+
+import fcntl
+import mmap
+import os
+import struct
+import threading
+
+import numpy as np
+
+STORE_MAGIC     = b'LSTMEEBS'
+STORE_VERSION   = 1
+STORE_ALIGNMENT = 64
+
+GROUP_INPUT  = 0
+GROUP_TARGET = 1
+GROUP_WEIGHT = 2
+
+HEADER_STRUCT = struct.Struct('<8sIIQ')
+END_STRUCT    = struct.Struct('<Q')
+END_OFFSET    = HEADER_STRUCT.size - END_STRUCT.size
+INDEX_STRUCT  = struct.Struct('<QQ')
+BATCH_STRUCT  = struct.Struct('<II')
+ARRAY_STRUCT  = struct.Struct('<IIIIQ')
+
+def writable(array):
+    """Return `array` if it is writable, or its writable copy otherwise.
+
+    Batches loaded from the `BatchStore` are read-only views into the shared
+    memory map. Decorators that modify batches inplace should call this
+    function first.
+    """
+    if array.flags.writeable:
+        return array
+
+    return array.copy()
+
+def _align(offset):
+    return offset + (-offset) % STORE_ALIGNMENT
+
+def _serialize_batch(batch):
+    """Serialize `batch` into a list of byte blocks. Return (blocks, size)"""
+    arrays = []
+
+    for (group, part) in zip((GROUP_INPUT, GROUP_TARGET), batch[:2]):
+        for name, values in part.items():
+            arrays.append((group, name.encode('utf-8'), values))
+
+    if len(batch) > 2:
+        for values in batch[2]:
+            arrays.append((GROUP_WEIGHT, b'', values))
+
+    arrays = [
+        (group, name, np.ascontiguousarray(values, dtype = '<f4'))
+            for (group, name, values) in arrays
+    ]
+
+    header_size = BATCH_STRUCT.size + sum(
+        ARRAY_STRUCT.size + 8 * values.ndim + len(name)
+            for (_, name, values) in arrays
+    )
+
+    descriptors = []
+    data_blocks = []
+    offset      = _align(header_size)
+
+    for (group, name, values) in arrays:
+        descriptors.append(ARRAY_STRUCT.pack(
+            group, len(name), values.ndim, 0, offset
+        ))
+        descriptors.append(struct.pack('<%dQ' % values.ndim, *values.shape))
+        descriptors.append(name)
+
+        data_blocks.append((offset, values))
+        offset = _align(offset + values.nbytes)
+
+    header = BATCH_STRUCT.pack(len(batch), len(arrays)) + b''.join(descriptors)
+    blocks = [ (0, header) ] + [
+        (offset, values.tobytes()) for (offset, values) in data_blocks
+    ]
+
+    return (blocks, offset)
+
+def _deserialize_batch(buf, start):
+    """Create batch of read-only views into `buf` at offset `start`"""
+    n_parts, n_arrays = BATCH_STRUCT.unpack_from(buf, start)
+    pos = start + BATCH_STRUCT.size
+
+    inputs  = {}
+    targets = {}
+    weights = []
+
+    for _ in range(n_arrays):
+        group, name_len, ndim, _, offset = ARRAY_STRUCT.unpack_from(buf, pos)
+        pos += ARRAY_STRUCT.size
+
+        shape = struct.unpack_from('<%dQ' % ndim, buf, pos)
+        pos  += 8 * ndim
+
+        name = bytes(buf[pos:pos + name_len]).decode('utf-8')
+        pos += name_len
+
+        values = np.frombuffer(
+            buf, dtype = '<f4', count = int(np.prod(shape, dtype = np.int64)),
+            offset = start + offset
+        ).reshape(shape)
+
+        if group == GROUP_INPUT:
+            inputs[name] = values
+        elif group == GROUP_TARGET:
+            targets[name] = values
+        else:
+            weights.append(values)
+
+    if n_parts > 2:
+        return (inputs, targets, weights)
+
+    return (inputs, targets)
+
+class BatchStore:
+    """A store of data batches in a memory mapped file.
+
+    `BatchStore` saves data batches in a binary file with a fixed layout,
+    and loads them as read-only `np.ndarray` views into a shared memory map
+    of the file, without copying or unpickling. Multiple processes may
+    save and load batches of the same store concurrently. Writes are
+    serialized with `flock`, and each batch is saved only once.
+
+    The file is grown geometrically (its size is at least doubled when it
+    runs out of space), so that the readers remap it only a logarithmic
+    number of times while the store is being filled. The unused tail of
+    the file is sparse.
+
+    The file layout is (all values are little-endian):
+
+    ::
+
+        char     magic[8]     = "LSTMEEBS"
+        uint32   version      = 1
+        uint32   n_batches
+        uint64   data_end     (end of the saved batches, 0 -- end of file)
+        n_batches x {
+            uint64   offset   (byte offset of the batch, 0 if not saved)
+            uint64   size     (size of the batch in bytes)
+        }
+        batches, each aligned at 64 bytes
+
+    where each batch is
+
+    ::
+
+        uint32   n_parts      (2 -- (inputs, targets), 3 -- with weights)
+        uint32   n_arrays
+        n_arrays x {
+            uint32   group        (0 -- input, 1 -- target, 2 -- weight)
+            uint32   name_length
+            uint32   ndim
+            uint32   reserved
+            uint64   data_offset  (relative to the batch start)
+            uint64   shape[ndim]
+            char     name[name_length]
+        }
+        float32 data blocks, each aligned at 64 bytes
+
+    Parameters
+    ----------
+    path : str
+        Path to the store file. It is created if it does not exist.
+        To share batches between processes through RAM only, place it on
+        a tmpfs (e.g. /dev/shm).
+    n_batches : int
+        Number of batches in the store.
+
+    Notes
+    -----
+    All values are stored as float32.
+    """
+
+    def __init__(self, path, n_batches):
+        self._path       = path
+        self._n_batches  = n_batches
+        self._fd         = None
+        self._pid        = None
+        self._mmap       = None
+        self._lock       = threading.Lock()
+        self._write_lock = threading.Lock()
+
+        self._open()
+
+    def _open(self):
+        # flock does not exclude processes that share the file descriptor,
+        # hence the forked processes reopen the file.
+        if (self._fd is not None) and (self._pid == os.getpid()):
+            return
+
+        self.close()
+
+        fd = os.open(self._path, os.O_RDWR | os.O_CREAT, 0o644)
+
+        try:
+            fcntl.flock(fd, fcntl.LOCK_EX)
+
+            try:
+                if os.fstat(fd).st_size == 0:
+                    os.pwrite(
+                        fd, HEADER_STRUCT.pack(
+                            STORE_MAGIC, STORE_VERSION, self._n_batches, 0
+                        ) + b'\0' * (INDEX_STRUCT.size * self._n_batches), 0
+                    )
+
+                magic, version, n_batches, _ = HEADER_STRUCT.unpack(
+                    os.pread(fd, HEADER_STRUCT.size, 0)
+                )
+            finally:
+                fcntl.flock(fd, fcntl.LOCK_UN)
+
+            if (magic != STORE_MAGIC) or (version != STORE_VERSION):
+                raise RuntimeError("Not a batch store file: %s" % self._path)
+
+            if n_batches != self._n_batches:
+                raise RuntimeError(
+                    "Batch store %s holds %d batches instead of %d" % (
+                        self._path, n_batches, self._n_batches
+                    )
+                )
+        except (OSError, RuntimeError, struct.error):
+            os.close(fd)
+            raise
+
+        self._fd   = fd
+        self._pid  = os.getpid()
+        self._mmap = None
+
+    def _index_offset(self, index):
+        if (index < 0) or (index >= self._n_batches):
+            raise IndexError("Batch index out of range: %d" % index)
+
+        return HEADER_STRUCT.size + INDEX_STRUCT.size * index
+
+    def _get_entry(self, index):
+        return INDEX_STRUCT.unpack(
+            os.pread(self._fd, INDEX_STRUCT.size, self._index_offset(index))
+        )
+
+    def _get_mmap(self, end):
+        """Return memory map that covers file up to the byte `end`"""
+        with self._lock:
+            if (self._mmap is None) or (len(self._mmap) < end):
+                self._mmap = mmap.mmap(
+                    self._fd, os.fstat(self._fd).st_size,
+                    access = mmap.ACCESS_READ
+                )
+
+            return self._mmap
+
+    def __len__(self):
+        return self._n_batches
+
+    @property
+    def path(self):
+        """Path to the store file"""
+        return self._path
+
+    def __contains__(self, index):
+        self._open()
+        return self._get_entry(index)[0] != 0
+
+    def get(self, index):
+        """Load batch `index` as read-only views. Return None if missing."""
+        self._open()
+        offset, size = self._get_entry(index)
+
+        if offset == 0:
+            return None
+
+        return _deserialize_batch(self._get_mmap(offset + size), offset)
+
+    def put(self, index, batch):
+        """Save `batch` at `index` unless it has been saved already"""
+        self._open()
+
+        blocks, size = _serialize_batch(batch)
+        index_offset = self._index_offset(index)
+
+        with self._write_lock:
+            fcntl.flock(self._fd, fcntl.LOCK_EX)
+
+            try:
+                if self._get_entry(index)[0] != 0:
+                    return
+
+                file_size = os.fstat(self._fd).st_size
+                data_end  = END_STRUCT.unpack(
+                    os.pread(self._fd, END_STRUCT.size, END_OFFSET)
+                )[0]
+
+                start = _align(data_end or file_size)
+                end   = start + _align(size)
+
+                if end > file_size:
+                    os.ftruncate(self._fd, max(end, 2 * file_size))
+
+                for (offset, data) in blocks:
+                    os.pwrite(self._fd, data, start + offset)
+
+                os.pwrite(
+                    self._fd, INDEX_STRUCT.pack(start, size), index_offset
+                )
+                os.pwrite(self._fd, END_STRUCT.pack(end), END_OFFSET)
+            finally:
+                fcntl.flock(self._fd, fcntl.LOCK_UN)
+
+    def close(self):
+        """Close the store file. It will be reopened on the next use."""
+        with self._lock:
+            self._mmap = None
+
+            if self._fd is not None:
+                os.close(self._fd)
+                self._fd = None
+
+    def __getstate__(self):
+        """Serialize object for pickle.
+
+        File descriptors and memory maps cannot be pickled, so they are
+        dropped and the file is reopened lazily at the first use.
+        """
+        state = self.__dict__.copy()
+
+        state['_fd']         = None
+        state['_pid']        = None
+        state['_mmap']       = None
+        state['_lock']       = None
+        state['_write_lock'] = None
+
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+
+        self._lock       = threading.Lock()
+        self._write_lock = threading.Lock()
+
+    def __del__(self):
+        if getattr(self, '_fd', None) is not None:
+            os.close(self._fd)
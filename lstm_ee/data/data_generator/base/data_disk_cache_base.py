@@ -8,8 +8,8 @@ import fcntl
 import hashlib
 import json
 import logging
-import pickle
-import tempfile
+
+from .batch_store import BatchStore
 
 LOGGER = logging.getLogger(
     'lstm_ee.data.data_generator.base.data_disk_cache_base'
@@ -22,6 +22,10 @@ class DataDiskCacheBase:
     than building them on the fly from the raw dataset. This decorator
     caches data batches constructed by the DataGenerator on a disk.
 
+    The batches are saved into a single `BatchStore` file, and are loaded
+    as read-only views into its memory map. Therefore, all processes that
+    use the same cache share a single copy of it in the OS page cache.
+
     Parameters
     ----------
     dgen : DataGenerator
@@ -44,6 +48,10 @@ class DataDiskCacheBase:
     -----
     Caches on the disk should be cleaned manually. They are stored under
     `datadir`/.cache
+
+    See Also
+    --------
+    BatchStore
     """
 
     def __init__(self, dgen, datadir, **kwargs):
@@ -53,6 +61,10 @@ class DataDiskCacheBase:
 
         self._init_cache_dir()
 
+        self._store = BatchStore(
+            os.path.join(self._cache_root, 'batches.lbs'), len(dgen)
+        )
+
     def _save_cache_config(self):
         """Save cache configuration to a disk if it is missing.
 
@@ -106,42 +118,16 @@ class DataDiskCacheBase:
 
         self._save_cache_config()
 
-    def _get_batch_fname(self, index):
-        return os.path.join(self._cache_root, 'batch_%d.pkl' % (index,))
-
-    def _load_batch(self, index):
-        batch_fname = self._get_batch_fname(index)
-
-        try:
-            with open(batch_fname, 'rb') as f:
-                batch = pickle.load(f)
-        except IOError:
-            return None
-
-        return batch
-
     def _fetch_batch(self, index):
         """Retrieves batch from the decorated object and saves it to disk."""
-        batch       = self._dgen[index]
-        batch_fname = self._get_batch_fname(index)
-
-        # To ensure atomicity of writes
-        with tempfile.NamedTemporaryFile(
-            'wb', dir = self._cache_root, delete = False
-        ) as f:
-            temp_fname = f.name
-            pickle.dump(batch, f)
-
-        os.rename(temp_fname, batch_fname)
-
-        return batch
+        self._store.put(index, self._dgen[index])
+        return self._store.get(index)
 
     def __getitem__(self, index):
-        batch = self._load_batch(index)
+        batch = self._store.get(index)
 
         if batch is None:
             LOGGER.debug("Cache miss. Fetching batch: %d", index)
             batch = self._fetch_batch(index)
 
         return batch
-
@@ -6,6 +6,7 @@ import logging
 from lstm_ee.data.data_generator.funcs.prong_sorter import (
     SingleVarProngSorter, RandomizedProngSorter
 )
+from .batch_store import writable
 
 LOGGER = logging.getLogger(
     'lstm_ee.data.data_generator.base.data_prong_sorter_base'
@@ -71,7 +72,10 @@ class DataProngSorterBase:
         if self._prong_sorter is None:
             return batch
 
-        self._prong_sorter(batch[0][self._input_name])
+        inputs = batch[0]
+        inputs[self._input_name] = writable(inputs[self._input_name])
+
+        self._prong_sorter(inputs[self._input_name])
 
         return batch
 
@@ -2,24 +2,124 @@
 A definition of a decorator that precomputes batches in concurrent processes.
 """
 
-import copy
+import atexit
+import glob
 import logging
+import os
+import re
+import tempfile
 
 from multiprocessing import Pool
 
+from .batch_store import BatchStore
+
 LOGGER = logging.getLogger(
     'lstm_ee.data.data_generator.base.multiprocessed_cache_base'
 )
 
+SHM_DIR = '/dev/shm'
+
+# Store files are named STORE_PREFIX<pid>_<random>.lbs, where pid is the pid
+# of the process that has created the store.
+STORE_PREFIX = 'lstm_ee_batches_'
+STORE_SUFFIX = '.lbs'
+
+# Cache that is being precomputed and its store. Inherited by the forked pool
+# workers, so that the decorated DataGenerator is not pickled for each task.
+_WORKER_CACHE = None
+_WORKER_STORE = None
+
+# Store files that have not been removed yet: { path : owner pid }
+_OWNED_STORES = {}
+
+def _remove_owned_stores():
+    """Remove store files of the caches that outlived the interpreter.
+
+    `__del__` is not guaranteed to run at the interpreter exit (e.g. when
+    the run is aborted by an exception), and the left over files in /dev/shm
+    would hold RAM until reboot.
+    """
+    for (path, pid) in list(_OWNED_STORES.items()):
+        if pid != os.getpid():
+            continue
+
+        try:
+            os.remove(path)
+        except FileNotFoundError:
+            pass
+
+        del _OWNED_STORES[path]
+
+atexit.register(_remove_owned_stores)
+
+def _is_process_alive(pid):
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        # Process of another user
+        return True
+
+    return True
+
+def remove_stale_stores(store_dir):
+    """Remove store files left in `store_dir` by the dead processes.
+
+    Neither `__del__` nor `atexit` handlers run when a process is killed by
+    a signal (e.g. SIGKILL), so its store file is never removed. This
+    function removes store files, which owner processes no longer exist.
+
+    Parameters
+    ----------
+    store_dir : str
+        Directory with the store files.
+
+    Returns
+    -------
+    list of str
+        Paths of the removed files.
+    """
+    result = []
+
+    for path in glob.glob(
+        os.path.join(store_dir, STORE_PREFIX + '*' + STORE_SUFFIX)
+    ):
+        match = re.match(
+            re.escape(STORE_PREFIX) + r'(\d+)_', os.path.basename(path)
+        )
+
+        if (match is None) or _is_process_alive(int(match.group(1))):
+            continue
+
+        try:
+            os.remove(path)
+        except (FileNotFoundError, PermissionError):
+            continue
+
+        LOGGER.info("Removed stale batch store: %s", path)
+        result.append(path)
+
+    return result
+
+def _init_worker(cache, store):
+    # pylint: disable=global-statement
+    global _WORKER_CACHE, _WORKER_STORE
+    _WORKER_CACHE = cache
+    _WORKER_STORE = store
+
+def _fetch_batch(index):
+    LOGGER.debug("Fetching batch: %d", index)
+    _WORKER_STORE.put(index, _WORKER_CACHE.base_dgen[index])
+
 class MultiprocessedCacheBase:
     """A decorator around DataGenerator to precompute batches in parallel.
 
     This decorator around DataGenerator will spawn multiple concurrent
     processes to generate batches from the decorated object on the first use.
-    The precomputed batches will be stored in the RAM cache.
-
-    This may eat all your RAM since each parallel process will get a copy of
-    the data.
+    The precomputed batches are saved by the worker processes directly into
+    a shared `BatchStore` and are returned as read-only views into it.
+    Thus, only a single copy of the precomputed batches is held in RAM.
 
     Parameters
     ----------
@@ -27,21 +127,103 @@ class MultiprocessedCacheBase:
         DataGenerator that creates batches to be precomputed and cached.
     workers : int
         Number of parallel processes to use.
+    store_dir : str or None, optional
+        Directory where the `BatchStore` file is created. If None, the
+        shared memory directory /dev/shm will be used if available.
+        The file is removed when the decorator is destroyed, or at the
+        interpreter exit at the latest. Default: None.
+
+    Notes
+    -----
+    A process that is killed by a signal cannot remove its store file.
+    Such stale files are removed by the next `MultiprocessedCacheBase` that
+    precomputes batches in the same `store_dir` (c.f. `remove_stale_stores`).
+
+    See Also
+    --------
+    BatchStore
     """
 
-    def __init__(self, dgen, workers = None):
-        self._dgen    = dgen
-        self._cache   = None
-        self._workers = workers
+    def __init__(self, dgen, workers = None, store_dir = None):
+        self._dgen      = dgen
+        self._store     = None
+        self._workers   = workers
+        self._store_dir = store_dir
+        self._owner     = None
+
+        if (self._store_dir is None) and os.path.isdir(SHM_DIR):
+            self._store_dir = SHM_DIR
+
+    @property
+    def store(self):
+        """`BatchStore` holding precomputed batches"""
+        return self._store
+
+    @property
+    def base_dgen(self):
+        """Decorated DataGenerator"""
+        return self._dgen
 
-    def __call__(self, index):
-        LOGGER.debug("Fetching batch: %d", index)
-        return self._dgen[index]
+    def _precompute(self):
+        remove_stale_stores(self._store_dir or tempfile.gettempdir())
+
+        fd, path = tempfile.mkstemp(
+            prefix = '%s%d_' % (STORE_PREFIX, os.getpid()),
+            suffix = STORE_SUFFIX, dir = self._store_dir
+        )
+        os.close(fd)
+
+        _OWNED_STORES[path] = os.getpid()
+        store = None
+
+        try:
+            store = BatchStore(path, len(self._dgen))
+
+            with Pool(
+                processes = self._workers,
+                initializer = _init_worker, initargs = (self, store)
+            ) as pool:
+                pool.map(_fetch_batch, range(len(self._dgen)))
+
+            missing = [ i for i in range(len(store)) if i not in store ]
+            if missing:
+                raise RuntimeError(
+                    "Failed to precompute batches: %s" % missing[:10]
+                )
+
+        except BaseException:
+            # The store will be recreated at the next use
+            if store is not None:
+                store.close()
+
+            del _OWNED_STORES[path]
+            os.remove(path)
+            raise
+
+        # Assigned only when all batches are saved, c.f. `__getitem__`
+        self._owner = os.getpid()
+        self._store = store
 
     def __getitem__(self, index):
-        if self._cache is None:
-            with Pool(processes = self._workers) as pool:
-                self._cache = pool.map(self, range(len(self)))
+        if self._store is None:
+            self._precompute()
+
+        return self._store.get(index)
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state['_owner'] = None
+        return state
+
+    def __del__(self):
+        # Only the process that has created the store removes it
+        if (getattr(self, '_owner', None) != os.getpid()) or (
+            self._store is None
+        ):
+            return
 
-        return copy.deepcopy(self._cache[index])
+        self._store.close()
 
+        # The store may have been removed at exit already
+        if _OWNED_STORES.pop(self._store.path, None) is not None:
+            os.remove(self._store.path)
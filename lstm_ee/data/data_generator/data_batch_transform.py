@@ -0,0 +1,178 @@
+"""
+A definition of a decorator that sorts prongs, adds noise and masks NaNs.
+"""
+
+import logging
+import numpy as np
+
+from lstm_ee.consts      import DEF_MASK
+from .idata_decorator    import IDataDecorator
+from .data_noise         import calc_var_indices
+from .funcs.noise        import select_noise
+from .funcs.prong_sorter import SingleVarProngSorter
+from .funcs.funcs_varr   import transform_varr_batch
+from .base.batch_store   import writable
+
+LOGGER = logging.getLogger('lstm_ee.data.data_generator.data_batch_transform')
+
+INPUTS = {
+    'input_slice' : ('vars_input_slice', 'affected_vars_slice'),
+    'input_png2d' : ('vars_input_png2d', 'affected_vars_png2d'),
+    'input_png3d' : ('vars_input_png3d', 'affected_vars_png3d'),
+}
+
+class DataBatchTransform(IDataDecorator):
+    """A decorator that fuses prong sorting, noise and NaN masking.
+
+    This decorator is equivalent to the chain of `DataProngSorter`,
+    `DataNoise` and `DataNANMask` decorators, but instead of walking each
+    batch once per decorator it performs all transformations in a single pass
+    over each batch row with a native kernel (c.f. `transform_varr_batch`).
+
+    The random noise is sampled in the same order as in the chain of
+    decorators. Therefore, both produce the same batches for the same seed.
+
+    Parameters
+    ----------
+    dgen : IDataGenerator
+        `IDataGenerator` to be decorated.
+    prong_sorters : dict or None, optional
+        Prong sorting specification of the form { INPUT_NAME : SORT_TYPE },
+        where SORT_TYPE is either None, or "+var_name", or "-var_name".
+        C.f. `DataProngSorter`. Randomized prong order is not supported.
+    noise : list of dict or dict or None, optional
+        Noise configuration. Each dict will be treated as keyword arguments of
+        the `DataNoise` constructor.
+    mask : float or None, optional
+        Value to replace NaNs in inputs with. If None, NaNs will be kept.
+        Default: `DEF_MASK`.
+
+    See Also
+    --------
+    DataProngSorter
+    DataNoise
+    DataNANMask
+    """
+
+    def __init__(
+        self, dgen,
+        prong_sorters = None,
+        noise         = None,
+        mask          = DEF_MASK,
+    ):
+        super(DataBatchTransform, self).__init__(dgen)
+
+        if not DataBatchTransform.supports(prong_sorters):
+            raise ValueError(
+                "Unsupported prong sorters: %s" % (prong_sorters)
+            )
+
+        self._mask    = mask
+        self._sorters = {}
+        self._noise   = []
+
+        self._init_sorters(prong_sorters or {})
+        self._init_noise(noise)
+
+    @staticmethod
+    def supports(prong_sorters):
+        """Check whether `prong_sorters` can be handled by the fused kernel"""
+        if prong_sorters is None:
+            return True
+
+        return all(
+            (v is None) or (isinstance(v, str) and v[:1] in [ '+', '-' ])
+                for v in prong_sorters.values()
+        )
+
+    def _init_sorters(self, prong_sorters):
+        for input_name, name in prong_sorters.items():
+            if input_name not in [ 'input_png2d', 'input_png3d' ]:
+                raise ValueError("Unknown prong input name '%s'" % input_name)
+
+            if name is None:
+                continue
+
+            LOGGER.info(
+                "Sorting prongs by '%s' order for '%s'", name, input_name
+            )
+
+            self._sorters[input_name] = SingleVarProngSorter(
+                name, getattr(self, INPUTS[input_name][0])
+            )
+
+    def _init_noise(self, noise):
+        if noise is None:
+            return
+
+        if not isinstance(noise, list):
+            noise = [ noise ]
+
+        for config in noise:
+            var_indices = {
+                input_name : calc_var_indices(
+                    getattr(self, vars_attr), config.get(affected_attr)
+                )
+                for (input_name, (vars_attr, affected_attr)) in INPUTS.items()
+            }
+
+            self._noise.append((
+                select_noise(
+                    config.get('noise'), **(config.get('noise_kwargs') or {})
+                ),
+                var_indices
+            ))
+
+    def _get_scales(self, inputs):
+        """Sample noise and convert it into multiplicative factors"""
+        scales = {}
+
+        if not self._noise:
+            return scales
+
+        batch_size = next(iter(inputs.values())).shape[0]
+
+        for (noise, var_indices) in self._noise:
+            values = noise.get(batch_size)
+
+            for input_name, var_idx in var_indices.items():
+                if (var_idx is None) or (input_name not in inputs):
+                    continue
+
+                if input_name not in scales:
+                    scales[input_name] = np.ones(
+                        (batch_size, inputs[input_name].shape[-1])
+                    )
+
+                scales[input_name][:, var_idx] *= (1 + values[:, np.newaxis])
+
+        return scales
+
+    def __getitem__(self, index):
+        batch  = self._dgen[index]
+        inputs = batch[0]
+        scales = self._get_scales(inputs)
+
+        for input_name in list(inputs.keys()):
+            values = writable(
+                np.ascontiguousarray(inputs[input_name], dtype=np.float32)
+            )
+            inputs[input_name] = values
+
+            if values.size == 0:
+                continue
+
+            if values.ndim == 2:
+                values = values.reshape((values.shape[0], 1, values.shape[1]))
+
+            sorter = self._sorters.get(input_name)
+
+            transform_varr_batch(
+                values,
+                sort_var_idx = None if sorter is None else sorter.var_idx,
+                ascending    = False if sorter is None else sorter.ascending,
+                scale        = scales.get(input_name),
+                mask         = self._mask,
+            )
+
+        return batch
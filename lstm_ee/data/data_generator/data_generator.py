@@ -186,13 +186,20 @@ class DataGenerator(IDataGenerator):
     def weights(self):
         return np.ones(len(self._data_loader))
 
-    def __getitem__(self, index):
+    def _get_batch_slice(self, index):
         start = index * self._batch_size
         end   = min((index + 1) * self._batch_size, len(self._data_loader))
 
-        data_slice    = np.arange(start, end)
+        return np.arange(start, end)
+
+    def __getitem__(self, index):
+        # Let slow DataLoaders read the next batch while this one is built
+        if index + 1 < len(self):
+            self._data_loader.prefetch(self._get_batch_slice(index + 1))
+
+        data_slice    = self._get_batch_slice(index)
         batch_data    = self.get_data(data_slice)
-        batch_weights = np.ones(end - start)
+        batch_weights = np.ones(len(data_slice))
 
         return batch_data + ( [batch_weights, ] * len(batch_data[1]), )
 
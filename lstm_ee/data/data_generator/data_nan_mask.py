@@ -5,7 +5,8 @@ A definition of a decorator that replaces NaN values in batches.
 import numpy as np
 
 from lstm_ee.consts   import DEF_MASK
-from .idata_decorator import IDataDecorator
+from .idata_decorator  import IDataDecorator
+from .base.batch_store import writable
 
 class DataNANMask(IDataDecorator):
     """A decorator around `IDataGenerator` that fills NaNs in input batches.
@@ -16,8 +17,12 @@ class DataNANMask(IDataDecorator):
     def __getitem__(self, index):
         batch  = self._dgen[index]
 
-        for data in batch[0].values():
+        inputs = batch[0]
+
+        for name in list(inputs.keys()):
+            data = writable(inputs[name])
             data[np.isnan(data)] = DEF_MASK
+            inputs[name] = data
 
         return batch
 
@@ -2,8 +2,9 @@
 A definition of a decorator that adds noise to input values.
 """
 
-from .idata_decorator import IDataDecorator
-from .funcs.noise import select_noise
+from .idata_decorator  import IDataDecorator
+from .funcs.noise      import select_noise
+from .base.batch_store import writable
 
 def calc_var_indices(input_vars, affected_vars):
     """Calculate indices of `affected_vars` in `input_vars`"""
@@ -95,6 +96,9 @@ class DataNoise(IDataDecorator):
         inputs     = batch_data[0]
         noise      = self._get_noise(inputs)#.ravel()
 
+        for name in list(inputs.keys()):
+            inputs[name] = writable(inputs[name])
+
         if self._vars_slice is not None:
             DataNoise._apply_noise(
                 inputs['input_slice'], self._vars_idx_slice, noise
@@ -6,6 +6,7 @@ import numpy as np
 
 from .idata_decorator import IDataDecorator
 from .data_noise      import calc_var_indices
+from .base.batch_store import writable
 
 class DataSmear(IDataDecorator):
     """A decorator around `IDataGenerator` that adds normal smearing to inputs.
@@ -77,6 +78,9 @@ class DataSmear(IDataDecorator):
         batch_data = self._dgen[index]
         inputs     = batch_data[0]
 
+        for name in list(inputs.keys()):
+            inputs[name] = writable(inputs[name])
+
         if self._vars_slice is not None:
             self._apply_smear(inputs['input_slice'], self._vars_idx_slice)
 
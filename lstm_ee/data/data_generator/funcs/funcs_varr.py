@@ -2,6 +2,10 @@
 Functions for working with batches of variable length arrays.
 """
 
+import concurrent.futures
+import os
+import threading
+
 import numpy as np
 
 import pyximport
@@ -11,7 +15,65 @@ pyximport.install(
 )
 
 # pylint: disable=import-error,wrong-import-position
-from .funcs_varr_opt import c_join_varr_arrays
+from .funcs_varr_opt import (
+    c_join_varr_arrays, c_transform_varr_batch, CSRJoin
+)
+
+# Number of threads used by the batch kernels
+WORKERS = os.cpu_count() or 1
+# Minimal number of rows for a batch to be split among multiple threads
+MIN_PARALLEL_ROWS = 256
+
+_EXECUTOR      = None
+_EXECUTOR_LOCK = threading.Lock()
+
+def _get_executor():
+    """Return thread pool that is shared by the batch kernels"""
+    # pylint: disable=global-statement
+    global _EXECUTOR
+
+    with _EXECUTOR_LOCK:
+        if _EXECUTOR is None:
+            _EXECUTOR = concurrent.futures.ThreadPoolExecutor(WORKERS)
+
+    return _EXECUTOR
+
+def _reset_executor():
+    """Drop thread pool inherited by a forked child.
+
+    Forked child inherits the executor object, but none of its threads, so
+    the work submitted to it would never complete. The lock may have been
+    held by another thread at the time of the fork as well.
+    """
+    # pylint: disable=global-statement
+    global _EXECUTOR, _EXECUTOR_LOCK
+
+    _EXECUTOR      = None
+    _EXECUTOR_LOCK = threading.Lock()
+
+os.register_at_fork(after_in_child = _reset_executor)
+
+def run_over_rows(func, n_rows):
+    """Call `func(row_start, row_end)` over [0, `n_rows`) in parallel threads.
+
+    The native batch kernels do not hold GIL, so splitting a batch into row
+    ranges and processing them in parallel threads gives a real speedup.
+    Small batches are processed in the calling thread.
+    """
+    n_tasks = min(WORKERS, n_rows // MIN_PARALLEL_ROWS)
+
+    if n_tasks <= 1:
+        func(0, n_rows)
+        return
+
+    bounds  = np.linspace(0, n_rows, n_tasks + 1).astype(int)
+    futures = [
+        _get_executor().submit(func, start, end)
+            for (start, end) in zip(bounds[:-1], bounds[1:])
+    ]
+
+    for f in futures:
+        f.result()
 
 def sort_unpacked_varr_arrays(unpacked_array, sort_var_idx, ascending = False):
     """Sort batch of variable length array variables inplace.
@@ -167,7 +229,82 @@ def unpack_varr_arrays(data_loader, variables, index, length_limit = None):
     join_varr_arrays
     """
 
+    if data_loader.has_csr:
+        return join_csr_arrays(
+            [ data_loader.get_csr(v, index) for v in variables ], length_limit
+        )
+
     return c_join_varr_arrays(
         [ data_loader.get(v, index) for v in variables ], length_limit
     )
 
+def join_csr_arrays(csr_list, length_limit = None):
+    """Join a list of variable length arrays in CSR form into a `np.ndarray`.
+
+    This function is an analog of `join_varr_arrays` for variable length
+    arrays stored in CSR form (c.f. `IDataLoader.get_csr`). The join is
+    performed by a native kernel in parallel threads.
+
+    Parameters
+    ----------
+    csr_list : list of (ndarray, ndarray)
+        List of (offsets, values) pairs, one for each variable.
+    length_limit : int or None, optional
+        If not None, the variable length dimension will be truncated by
+        `length_limit`.
+
+    Return
+    ------
+    ndarray, shape (N_SAMPLE, N_VARR, N_VAR)
+        Joined batches of variable length arrays.
+
+    See Also
+    --------
+    join_varr_arrays
+    """
+    if len(csr_list) == 0:
+        return None
+
+    join = CSRJoin(csr_list, length_limit)
+    run_over_rows(join, join.n_rows)
+
+    return join.result
+
+def transform_varr_batch(
+    values, sort_var_idx = None, ascending = False, scale = None, mask = None
+):
+    """Sort, scale and mask a batch of variable length arrays inplace.
+
+    This function fuses `sort_unpacked_varr_arrays`, multiplicative noise and
+    NaN masking into a single pass over the batch, performed by a native
+    kernel in parallel threads.
+
+    Parameters
+    ----------
+    values : ndarray, shape (N_SAMPLE, N_VARR, N_VAR)
+        A batch of variable length arrays joined into a single `np.ndarray`.
+        Must be a C-contiguous float32 array.
+    sort_var_idx : int or None, optional
+        Index of the variable in the third axis of `values` which values will
+        be used for sorting along the second axis. If None, no sorting will
+        be performed.
+    ascending : bool, optional
+        If True it will sort second dimension in ascending order, otherwise
+        in descending order. Default: False.
+    scale : ndarray, shape (N_SAMPLE, N_VAR) or None, optional
+        If not None, values will be multiplied by `scale`.
+    mask : float or None, optional
+        If not None, NaN values will be replaced by `mask`.
+
+    See Also
+    --------
+    sort_unpacked_varr_arrays
+    """
+
+    def transform_rows(start, end):
+        c_transform_varr_batch(
+            values, start, end, sort_var_idx, ascending, scale, mask
+        )
+
+    run_over_rows(transform_rows, values.shape[0])
+
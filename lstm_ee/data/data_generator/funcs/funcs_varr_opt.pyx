@@ -1,3 +1,4 @@
+# distutils: language = c++
 #cython: infer_types=True
 #cython: profile=False
 #cython: linetrace=False
@@ -9,7 +10,12 @@ cimport cython
 import  numpy as np
 cimport numpy as cnp
 
-from libc.math cimport NAN
+from libc.math   cimport NAN, isnan
+from libc.stdint cimport int64_t
+from libc.string cimport memcpy
+from libcpp.algorithm cimport sort
+from libcpp.pair      cimport pair
+from libcpp.vector    cimport vector
 
 ctypedef cnp.float32_t CTYPE
 DTYPE = np.float32
@@ -71,3 +77,248 @@ def c_join_varr_arrays(list raw_varr_list, length_limit = None):
 
     return result
 
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef void join_csr_rows(
+    Py_ssize_t row_start,
+    Py_ssize_t row_end,
+    Py_ssize_t n_pngs,
+    Py_ssize_t n_vars,
+    vector[const int64_t*] &offsets,
+    vector[const float*]   &values,
+    float *result
+) noexcept nogil:
+    cdef Py_ssize_t row_idx
+    cdef Py_ssize_t png_idx
+    cdef Py_ssize_t var_idx
+    cdef Py_ssize_t row_n_pngs
+    cdef int64_t    start
+    cdef float     *row
+
+    for row_idx in range(row_start, row_end):
+        row = result + row_idx * n_pngs * n_vars
+
+        for var_idx in range(n_vars):
+            start      = offsets[var_idx][row_idx]
+            row_n_pngs = min(n_pngs, offsets[var_idx][row_idx + 1] - start)
+
+            for png_idx in range(row_n_pngs):
+                row[png_idx * n_vars + var_idx] = values[var_idx][start + png_idx]
+
+            for png_idx in range(row_n_pngs, n_pngs):
+                row[png_idx * n_vars + var_idx] = NAN
+
+class CSRJoin:
+    """Join of variable length arrays in CSR form into a padded array.
+
+    C.f. `c_join_csr_arrays`. This object holds the prepared inputs, such that
+    the join can be split over row ranges and run in parallel threads.
+    """
+
+    def __init__(self, list csr_list, length_limit = None):
+        n_vars = len(csr_list)
+
+        self.offsets = [
+            np.ascontiguousarray(x[0], dtype = np.int64) for x in csr_list
+        ]
+        self.values  = [
+            np.ascontiguousarray(x[1], dtype = DTYPE) for x in csr_list
+        ]
+
+        if n_vars == 0:
+            self.n_rows = 0
+            self.n_pngs = 0
+        else:
+            self.n_rows = len(self.offsets[0]) - 1
+            if self.n_rows > 0:
+                self.n_pngs = int(np.max(np.diff(self.offsets[0])))
+            else:
+                self.n_pngs = 0
+
+        if length_limit is not None:
+            self.n_pngs = min(self.n_pngs, length_limit)
+
+        self.result = np.empty((self.n_rows, self.n_pngs, n_vars), dtype=DTYPE)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def __call__(self, Py_ssize_t row_start, Py_ssize_t row_end):
+        cdef vector[const int64_t*] offsets
+        cdef vector[const float*]   values
+        cdef cnp.ndarray arr
+        cdef cnp.ndarray result = self.result
+        cdef Py_ssize_t n_pngs  = self.n_pngs
+        cdef Py_ssize_t n_vars  = len(self.values)
+
+        for arr in self.offsets:
+            offsets.push_back(<const int64_t*>cnp.PyArray_DATA(arr))
+
+        for arr in self.values:
+            values.push_back(<const float*>cnp.PyArray_DATA(arr))
+
+        with nogil:
+            join_csr_rows(
+                row_start, row_end, n_pngs, n_vars, offsets, values,
+                <float*>cnp.PyArray_DATA(result)
+            )
+
+def c_join_csr_arrays(list csr_list, length_limit = None):
+    """Join a list of variable length arrays in CSR form into a `np.ndarray`.
+
+    This is an analog of `c_join_varr_arrays` for the variable length arrays
+    stored in CSR form, i.e. as a pair (offsets, values), such that values of
+    the i-th row are values[offsets[i]:offsets[i+1]]. Since values are held in
+    flat arrays, no python objects are touched during the join.
+
+    Parameters
+    ----------
+    csr_list : list of (ndarray, ndarray)
+        List of (offsets, values) pairs, one for each variable.
+    length_limit : int or None, optional
+        If not None, the variable length dimension will be truncated by
+        `length_limit`.
+
+    Returns
+    -------
+    ndarray, shape (N_SAMPLE, N_VARR, N_VAR)
+        Joined batches of variable length arrays.
+    """
+    if len(csr_list) == 0:
+        return None
+
+    join = CSRJoin(csr_list, length_limit)
+    join(0, join.n_rows)
+
+    return join.result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef void transform_rows(
+    float           *values,
+    Py_ssize_t       row_start,
+    Py_ssize_t       row_end,
+    Py_ssize_t       n_pngs,
+    Py_ssize_t       n_vars,
+    Py_ssize_t       sort_var_idx,
+    bint             ascending,
+    const double    *scale,
+    bint             use_mask,
+    float            mask
+) noexcept nogil:
+    cdef Py_ssize_t row_idx
+    cdef Py_ssize_t png_idx
+    cdef Py_ssize_t var_idx
+    cdef Py_ssize_t n_valid
+    cdef Py_ssize_t row_size = n_pngs * n_vars
+    cdef float     *row
+    cdef float      x
+    cdef vector[pair[float, Py_ssize_t]] keys
+    cdef vector[float] tmp
+
+    tmp.resize(row_size)
+
+    for row_idx in range(row_start, row_end):
+        row = values + row_idx * row_size
+
+        if sort_var_idx >= 0:
+            keys.clear()
+
+            for png_idx in range(n_pngs):
+                x = row[png_idx * n_vars + sort_var_idx]
+                if not isnan(x):
+                    keys.push_back(
+                        pair[float, Py_ssize_t](x if ascending else -x, png_idx)
+                    )
+
+            # ties are resolved by the original prong index
+            sort(keys.begin(), keys.end())
+
+            if row_size > 0:
+                memcpy(tmp.data(), row, row_size * sizeof(float))
+
+            n_valid = keys.size()
+
+            for png_idx in range(n_valid):
+                memcpy(
+                    row + png_idx * n_vars,
+                    tmp.data() + keys[png_idx].second * n_vars,
+                    n_vars * sizeof(float)
+                )
+
+            for png_idx in range(n_valid * n_vars, row_size):
+                row[png_idx] = NAN
+
+        for png_idx in range(n_pngs):
+            for var_idx in range(n_vars):
+                x = row[png_idx * n_vars + var_idx]
+
+                if scale != NULL:
+                    x = <float>(x * scale[row_idx * n_vars + var_idx])
+
+                if use_mask and isnan(x):
+                    x = mask
+
+                row[png_idx * n_vars + var_idx] = x
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def c_transform_varr_batch(
+    cnp.ndarray values,
+    Py_ssize_t  row_start,
+    Py_ssize_t  row_end,
+    sort_var_idx   = None,
+    bint ascending = False,
+    scale          = None,
+    mask           = None,
+):
+    """Sort, scale and mask batch of joined variable length arrays inplace.
+
+    All transformations are performed in a single pass over each row of
+    `values`, without holding GIL. Transformations are applied in the
+    following order:
+      1. Prongs (second axis) are sorted by values of the variable
+         `sort_var_idx`. Prongs with NaN values of this variable are dropped.
+      2. Values are multiplied by `scale`.
+      3. NaN values are replaced by `mask`.
+
+    Parameters
+    ----------
+    values : ndarray of float32, shape (N_SAMPLE, N_VARR, N_VAR)
+        C-contiguous batch to be transformed inplace.
+    row_start, row_end : int
+        Range of rows of `values` to transform.
+    sort_var_idx : int or None, optional
+        Index of the variable to sort prongs by. If None, prong order will not
+        be altered.
+    ascending : bool, optional
+        If True sort in ascending order, otherwise in descending order.
+    scale : ndarray of float64, shape (N_SAMPLE, N_VAR) or None, optional
+        Multiplicative factors for each sample and variable.
+    mask : float or None, optional
+        Value to replace NaNs with. If None, NaNs are kept.
+    """
+    cdef cnp.ndarray scale_arr
+    cdef const double *scale_ptr = NULL
+    cdef float     *values_ptr   = <float*>cnp.PyArray_DATA(values)
+    cdef Py_ssize_t n_pngs   = values.shape[1]
+    cdef Py_ssize_t n_vars   = values.shape[2]
+    cdef Py_ssize_t sort_idx = -1 if (sort_var_idx is None) else sort_var_idx
+    cdef bint       use_mask = (mask is not None)
+    cdef float      mask_val = 0 if (mask is None) else mask
+
+    if (values.dtype != DTYPE) or (not values.flags['C_CONTIGUOUS']):
+        raise ValueError("values must be a C-contiguous float32 array")
+
+    if scale is not None:
+        scale_arr = np.ascontiguousarray(scale, dtype = np.float64)
+        if (scale_arr.shape[0] != values.shape[0]) \
+                or (scale_arr.shape[1] != n_vars):
+            raise ValueError("scale shape does not match values")
+        scale_ptr = <const double*>cnp.PyArray_DATA(scale_arr)
+
+    with nogil:
+        transform_rows(
+            values_ptr, row_start, row_end, n_pngs, n_vars,
+            sort_idx, ascending, scale_ptr, use_mask, mask_val
+        )
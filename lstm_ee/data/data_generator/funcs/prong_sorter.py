@@ -51,6 +51,16 @@ class SingleVarProngSorter(ProngSorter):
 
         assert(self._var_idx >= 0)
 
+    @property
+    def var_idx(self):
+        """Index of the variable according to which prongs are sorted"""
+        return self._var_idx
+
+    @property
+    def ascending(self):
+        """Whether prongs are sorted in the ascending order"""
+        return self._asc
+
     def __call__(self, unpacked_prong_array):
         sort_unpacked_varr_arrays(
             unpacked_prong_array, self._var_idx, self._asc
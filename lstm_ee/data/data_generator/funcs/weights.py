@@ -4,8 +4,10 @@ Functions for calculating data weights.
 
 import numpy as np
 
+DEF_FLAT_VAR = 'trueE'
+
 def calc_flat_whist(
-    data_loader, var = 'trueE', bins = 50, range = (0, 5), clip = None
+    data_loader, var = DEF_FLAT_VAR, bins = 50, range = (0, 5), clip = None
 ):
     """Calculate normalized inverse of the `var` histogram.
 
@@ -56,7 +58,7 @@ def calc_flat_whist(
     return (wvalues, whist, bins)
 
 def flat_weights(
-    data_loader, var = 'trueE', bins = 50, range = (0, 5), clip = None
+    data_loader, var = DEF_FLAT_VAR, bins = 50, range = (0, 5), clip = None
 ):
     """Calculate weights that will make weighted histogram of `var` flat.
 
@@ -10,7 +10,7 @@ from .base.multiprocessed_cache_base import MultiprocessedCacheBase
 class MultiprocessedCache(MultiprocessedCacheBase, IDataDecorator):
     # pylint: disable=C0115
 
-    def __init__(self, dgen, workers = None):
+    def __init__(self, dgen, workers = None, store_dir = None):
         IDataDecorator         .__init__(self, dgen)
-        MultiprocessedCacheBase.__init__(self, dgen, workers)
+        MultiprocessedCacheBase.__init__(self, dgen, workers, store_dir)
 
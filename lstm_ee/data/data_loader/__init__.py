@@ -1,15 +1,17 @@
 """
-This module contains a number of objects for loading datasets from csv and hdf
-files. It also contains dataset transformations.
+This module contains a number of objects for loading datasets from csv, hdf and
+columnar files. It also contains dataset transformations.
 """
 
-from .csv_loader   import CSVLoader
-from .hdf_loader   import HDFLoader
-from .dict_loader  import DictLoader
-from .data_shuffle import DataShuffle
-from .data_slice   import DataSlice
+from .csv_loader      import CSVLoader
+from .columnar_loader import ColumnarLoader
+from .hdf_loader      import HDFLoader
+from .dict_loader     import DictLoader
+from .data_shuffle    import DataShuffle
+from .data_slice      import DataSlice
 
 __all__ = [
-    'CSVLoader', 'HDFLoader', 'DictLoader', 'DataShuffle', 'DataSlice'
+    'CSVLoader', 'ColumnarLoader', 'HDFLoader', 'DictLoader', 'DataShuffle',
+    'DataSlice'
 ]
 
@@ -0,0 +1,330 @@
+"""
+Definition of a ColumnarLoader for loading data from binary columnar files.
+"""
+
+import struct
+
+import numpy as np
+
+from .idata_loader    import IDataLoader
+from .funcs.funcs_csr import csr_to_varr, gather_csr
+
+COLUMNAR_MAGIC     = b'LSTMEECF'
+COLUMNAR_VERSION   = 1
+COLUMNAR_ALIGNMENT = 64
+
+KIND_SCALAR = 0
+KIND_VARR   = 1
+
+HEADER_STRUCT = struct.Struct('<8sIIQ')
+COLUMN_STRUCT = struct.Struct('<IIQQQ')
+
+class ColumnarLoader(IDataLoader):
+    """DataLoader for loading data from the binary columnar files.
+
+    The binary columnar file is a memory mappable alternative to the csv files
+    that can be produced directly by the exporters (c.f.
+    `exporters/common/ColumnarMaker.h`) or converted from other formats by
+    `save_columnar`.
+
+    Each slice level variable is stored as a contiguous float32 array. Each
+    prong level variable is stored in a CSR form: a contiguous float32 array
+    `values` of all prongs, and an uint64 array `offsets` of size (N + 1),
+    such that the prongs of the i-th slice are `values[offsets[i]:offsets[i+1]]`.
+
+    The file starts with a header:
+
+    ::
+
+        char     magic[8]     = "LSTMEECF"
+        uint32   version      = 1
+        uint32   n_columns
+        uint64   n_rows
+
+    that is followed by `n_columns` column descriptors:
+
+    ::
+
+        uint32   kind         (0 -- scalar, 1 -- variable length array)
+        uint32   name_length
+        uint64   data_offset  (byte offset of float32 values)
+        uint64   data_size    (number of float32 values)
+        uint64   index_offset (byte offset of uint64 offsets, 0 for scalars)
+        char     name[name_length]
+
+    All values are little-endian. Data blocks are aligned at 64 bytes.
+
+    Parameters
+    ----------
+    path : str
+        Path to the columnar file with the dataset.
+
+    Notes
+    -----
+    `ColumnarLoader` memory maps the file and returns views into it without
+    copying, whenever possible. Since the memory map is shared through the
+    OS page cache, the multiprocessing workers do not hold separate copies
+    of the dataset.
+    """
+
+    def __init__(self, path):
+        super(ColumnarLoader, self).__init__()
+
+        self._fname   = path
+        self._mmap    = None
+        self._columns = None
+
+        self._lazy_load()
+
+        self._variables = list(self._columns.keys())
+
+    def _lazy_load(self):
+        if self._mmap is not None:
+            return
+
+        self._mmap = np.memmap(self._fname, dtype = np.uint8, mode = 'r')
+        self._len, self._columns = parse_columnar_header(self._mmap)
+
+    def __getstate__(self):
+        """Serialize object for pickle.
+
+        This function is called when `ColumnarLoader` is serialized by
+        `pickle`.
+
+        Notes
+        -----
+        Memory map cannot be pickled, so we drop it from the pickled state
+        and remap the file lazily at the first use. The memory map of the
+        pickled object itself is kept.
+        """
+        state = self.__dict__.copy()
+
+        state['_mmap']    = None
+        state['_columns'] = None
+
+        return state
+
+    def variables(self):
+        return self._variables
+
+    def __len__(self):
+        return self._len
+
+    @property
+    def has_csr(self):
+        return True
+
+    def get_csr(self, var, index = None):
+        """Return values of the variable length array variable `var` as CSR.
+
+        Parameters
+        ----------
+        var : str
+            Name of the variable length array variable.
+        index : ndarray or None
+            If None, the views into the file will be returned.
+            Otherwise, only rows specified by `index` will be gathered.
+
+        Returns
+        -------
+        (ndarray, ndarray)
+            A pair of (offsets, values) arrays, such that values of the i-th
+            row are values[offsets[i]:offsets[i+1]].
+        """
+        self._lazy_load()
+
+        kind, values, offsets = self._columns[var]
+
+        if kind != KIND_VARR:
+            raise RuntimeError(
+                "Variable '%s' is not a variable length array" % var
+            )
+
+        return gather_csr(offsets, values, index)
+
+    def is_varr(self, var):
+        """Whether `var` is a variable length array variable"""
+        self._lazy_load()
+        return (self._columns[var][0] == KIND_VARR)
+
+    def get(self, var, index = None):
+        self._lazy_load()
+
+        if isinstance(var, list):
+            if len(var) != 1:
+                raise RuntimeError("Invalid var: %s" % var)
+            var = var[0]
+
+        kind, values, offsets = self._columns[var]
+
+        if kind == KIND_SCALAR:
+            if index is None:
+                return values
+
+            return values[index]
+
+        return csr_to_varr(offsets, values, index)
+
+def parse_columnar_header(buf):
+    """Parse header of the columnar file and create views of its columns.
+
+    Parameters
+    ----------
+    buf : ndarray of uint8
+        Contents of the columnar file (typically a `np.memmap`).
+
+    Returns
+    -------
+    (int, dict)
+        Number of rows and a dictionary of the form
+        { name : (kind, values, offsets) }, where `offsets` is None for
+        the scalar variables.
+    """
+    magic, version, n_columns, n_rows = HEADER_STRUCT.unpack_from(buf, 0)
+
+    if magic != COLUMNAR_MAGIC:
+        raise RuntimeError("Not a columnar lstm_ee file")
+
+    if version != COLUMNAR_VERSION:
+        raise RuntimeError("Unsupported columnar file version: %d" % version)
+
+    columns = {}
+    pos     = HEADER_STRUCT.size
+
+    for _ in range(n_columns):
+        kind, name_len, data_offset, data_size, index_offset = \
+            COLUMN_STRUCT.unpack_from(buf, pos)
+        pos += COLUMN_STRUCT.size
+
+        name = bytes(buf[pos:pos + name_len]).decode('utf-8')
+        pos += name_len
+
+        values = buf[data_offset:data_offset + 4 * data_size].view('<f4')
+
+        if kind == KIND_SCALAR:
+            offsets = None
+        elif kind == KIND_VARR:
+            offsets = buf[index_offset:index_offset + 8 * (n_rows + 1)]\
+                .view('<u8')
+        else:
+            raise RuntimeError("Unknown column kind: %d" % kind)
+
+        columns[name] = (kind, values, offsets)
+
+    return (n_rows, columns)
+
+def _write_aligned(f, data):
+    """Write `data` into `f` at the next aligned position. Return position."""
+    pad = (-f.tell()) % COLUMNAR_ALIGNMENT
+    f.write(b'\0' * pad)
+
+    offset = f.tell()
+    f.write(data.tobytes())
+
+    return offset
+
+def _write_csr_column(f, csr_list):
+    """Write concatenation of CSR arrays `csr_list` into `f`"""
+    n_rows  = sum(len(offsets) - 1 for (offsets, _) in csr_list)
+    offsets = np.zeros(n_rows + 1, dtype = '<u8')
+    row     = 0
+
+    for (src_offsets, src_values) in csr_list:
+        n = len(src_offsets) - 1
+        offsets[row + 1:row + n + 1] = (
+            offsets[row] + (src_offsets[1:] - src_offsets[0])
+        )
+        row += n
+
+    values = np.concatenate(
+        [ v[o[0]:o[-1]] for (o, v) in csr_list ]
+        or [ np.empty((0,), dtype = '<f4') ]
+    ).astype('<f4')
+
+    data_offset  = _write_aligned(f, values)
+    index_offset = _write_aligned(f, offsets)
+
+    return (KIND_VARR, data_offset, len(values), index_offset)
+
+def _write_column(f, var, data_loaders):
+    """Write values of `var` from `data_loaders` into `f`"""
+    if all(
+        isinstance(x, ColumnarLoader) and x.is_varr(var) for x in data_loaders
+    ):
+        # Fast path: concatenate CSR arrays without splitting them into rows
+        return _write_csr_column(
+            f, [ x.get_csr(var) for x in data_loaders ]
+        )
+
+    data_list = [ x.get(var) for x in data_loaders ]
+
+    if all(
+        np.issubdtype(x.dtype, np.number) and (x.ndim == 1) for x in data_list
+    ):
+        values = np.concatenate(data_list).astype('<f4')
+        offset = _write_aligned(f, values)
+
+        return (KIND_SCALAR, offset, len(values), 0)
+
+    rows    = [ row for data in data_list for row in data ]
+    lengths = np.array([ len(row) for row in rows ], dtype = np.uint64)
+
+    offsets = np.zeros(len(rows) + 1, dtype = '<u8')
+    np.cumsum(lengths, out = offsets[1:])
+
+    if rows:
+        values = np.concatenate(rows).astype('<f4')
+    else:
+        values = np.empty((0,), dtype = '<f4')
+
+    data_offset  = _write_aligned(f, values)
+    index_offset = _write_aligned(f, offsets)
+
+    return (KIND_VARR, data_offset, len(values), index_offset)
+
+def save_columnar(path, data_loaders):
+    """Save variables of `data_loaders` into a columnar file `path`.
+
+    Parameters
+    ----------
+    path : str
+        Path of the output file.
+    data_loaders : IDataLoader or list of IDataLoader
+        DataLoaders which values will be saved. If a list of DataLoaders is
+        given, then their values are concatenated in the list order.
+        All DataLoaders must have the same variables.
+
+    See Also
+    --------
+    ColumnarLoader
+    """
+    if not isinstance(data_loaders, (list, tuple)):
+        data_loaders = [ data_loaders ]
+
+    variables = list(data_loaders[0].variables())
+    n_rows    = sum(len(x) for x in data_loaders)
+    names     = [ v.encode('utf-8') for v in variables ]
+
+    header_size = HEADER_STRUCT.size + sum(
+        COLUMN_STRUCT.size + len(name) for name in names
+    )
+
+    with open(path, 'wb') as f:
+        f.write(b'\0' * header_size)
+
+        descriptors = [
+            _write_column(f, var, data_loaders) for var in variables
+        ]
+
+        f.seek(0)
+        f.write(HEADER_STRUCT.pack(
+            COLUMNAR_MAGIC, COLUMNAR_VERSION, len(variables), n_rows
+        ))
+
+        for name,(kind, data_offset, data_size, index_offset) \
+                in zip(names, descriptors):
+            f.write(COLUMN_STRUCT.pack(
+                kind, len(name), data_offset, data_size, index_offset
+            ))
+            f.write(name)
+
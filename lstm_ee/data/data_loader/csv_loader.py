@@ -2,80 +2,106 @@
 Definition of a CSVLoader object for loading datasets from csv files.
 """
 
+import logging
 import threading
 
-import pandas as pd
-import numpy  as np
+import numpy as np
 
-from .idata_loader import IDataLoader
+from .idata_loader    import IDataLoader
+from .funcs.funcs_csr import csr_to_varr, gather_csr
+from .funcs.funcs_csv import parse_csv
+
+LOGGER = logging.getLogger('lstm_ee.data.data_loader.csv_loader')
 
 class CSVLoader(IDataLoader):
     """DataLoader for loading data from the csv files.
 
-    This class is a wrapper around `pandas.DataFrame` to handle special csv
-    files that `lstm_ee` relies on.
-
     The `lstm_ee` uses both slice level and prong level data. The slice level
-    data can be easily fit in a `pandas.DataFrame`, since values for each
-    variable are just lists of scalars. However, the prong level data is a
-    list of variable length arrays (number of prongs varies for each slice).
+    data is simply a list of scalars for each variable. However, the prong
+    level data is a list of variable length arrays (number of prongs varies
+    for each slice).
 
     To store variable length arrays in the csv files, `lstm_ee` serializes them
-    as strings of the form "value0,value1,value2,...". Therefore, `CSVLoader`
-    is a wrapper around `pandas.DataFrame` such that when asked to return
-    values for a given variable by calling `get` function:
-       - if values are numeric -- it will return them unmodified, similar to
-         the `pandas.DataFrame`.
-       - if on the other hand values are strings, then it will try to
-         deserialize them as variable length arrays. The returned value
-         will be a numpy array of numpy arrays, with first dimension indexing
-         slices and second prongs.
+    as strings of the form "value0,value1,value2,...". `CSVLoader` parses
+    the csv file with a native multithreaded parser (c.f. `parse_csv`), such
+    that when asked to return values for a given variable by calling `get`
+    function:
+       - if values are scalars -- it will return a numpy array of them.
+       - if values are variable length arrays, then it will return a numpy
+         array of numpy arrays, with first dimension indexing slices and
+         second prongs.
+
+    Internally, variable length arrays are held in a flat CSR form, c.f.
+    `get_csr`.
 
     Parameters
     ----------
-    path : str
-        Path to the csv file with the dataset.
+    path : str or file
+        Path to the (possibly compressed) csv file with the dataset.
+    variables : list of str or None, optional
+        If not None, then only columns `variables` will be parsed at
+        construction. Values of other columns will be parsed on demand, when
+        requested by `get`. Default: None.
+    workers : int or None, optional
+        Number of threads used for parsing. If None, number of CPUs will be
+        used. Default: None.
 
     Notes
     -----
-    `CSVLoader` uses `threading.Lock` for accessing internal `pandas.DataFrame`
-    since otherwise access to `pandas.DataFrame` fails in the multithreading
-    setting.
+    `CSVLoader` uses `threading.Lock` to guard parsing of the columns on
+    demand.
 
-    Using `pandas.DataFrame` as a raw csv dataset holder produces HUGE overhead
-    in terms of RAM. Likely need more efficient container.
+    Parsing of each column, that was not requested at the construction,
+    requires a separate pass over the csv file. Therefore, you should specify
+    all columns that are going to be used in `variables`.
 
     Using `CSVLoader` for the multiprocessing data generation will result in
-    each worker having a separate copy of `CSVLoader` and correspondingly a
-    separate copy of the underlying `DataFrame`. This will further exacerbate
-    RAM problem.
-
-    Currently, unpacking serialized variable length array is the bottleneck in
-    data generation. This needs to be addressed somehow. Until it is addressed
-    you should use data generator caches.
+    each worker having a separate copy of the parsed data. Consider using
+    `ColumnarLoader` that does not suffer from this problem.
     """
-    # pylint: disable=no-self-use
 
-    def __init__(self, path):
+    def __init__(self, path, variables = None, workers = None):
         super(CSVLoader, self).__init__()
 
-        self._df = pd.read_csv(path)
+        self._fname   = path
+        self._workers = workers
+        self._lock    = threading.Lock()
+        self._data    = None
 
-        self._fname     = path
-        self._variables = list(self._df.columns)
-        self._len       = len(self._df)
-        self._lock      = threading.Lock()
+        self._variables, self._len, self._data = parse_csv(
+            path, variables, workers
+        )
+        self._parsed = list(self._data.keys())
 
     def variables(self):
         return self._variables
 
     def _lazy_load(self):
-        if self._df is None:
-            self._df = pd.read_csv(self._fname)
-
         if self._lock is None:
             self._lock = threading.Lock()
 
+        if self._data is None:
+            with self._lock:
+                if self._data is None:
+                    _, _, self._data = parse_csv(
+                        self._fname, self._parsed, self._workers
+                    )
+
+    def _get_column(self, var):
+        """Return (values, offsets) of the column `var`. Parse if needed."""
+        self._lazy_load()
+
+        if var not in self._data:
+            with self._lock:
+                if var not in self._data:
+                    LOGGER.info("Parsing csv column '%s' on demand", var)
+                    _, _, data = parse_csv(self._fname, [ var ], self._workers)
+
+                    self._data.update(data)
+                    self._parsed.append(var)
+
+        return self._data[var]
+
     def __getstate__(self):
         """Serialize object for pickle.
 
@@ -85,65 +111,72 @@ class CSVLoader(IDataLoader):
         -----
         Pickling is required for multiprocessing.
 
-        Pickling the entire `pandas.DataFrame` that `CSVLoader` holds is
-        inefficient, and does not always work (sometimes it is too large to be
-        pickled). Therefore, when pickling we first drop the `DataFrame` and
-        reload it later lazily at first use.
+        Pickling the entire parsed dataset that `CSVLoader` holds is
+        inefficient. Therefore, we drop the parsed data from the pickled state
+        and reparse it lazily at first use. The parsed data of the pickled
+        object itself is kept.
 
         `threading.Lock` that `CSVLoader` is using cannot be pickled. So we
         also drop it and create when it is used.
         """
+        state = self.__dict__.copy()
 
-        if self._df is not None:
-            self._df = None
+        state['_data'] = None
+        state['_lock'] = None
 
-        if self._lock is not None:
-            self._lock = None
+        return state
 
-        return self.__dict__
+    @property
+    def has_csr(self):
+        return True
 
-    def _convert_varr_series(self, s, dtype):
-        """Deserialize a sequence of variable length arrays"""
+    def get_csr(self, var, index = None):
+        """Return values of the variable length array variable `var` as CSR.
 
-        def convert_varrstr_to_varr(x, dtype):
-            if pd.isnull(x):
-                return np.empty((0,), dtype = dtype)
+        Parameters
+        ----------
+        var : str
+            Name of the variable length array variable.
+        index : ndarray or None
+            If None, all rows will be returned. Otherwise, only rows specified
+            by `index` will be gathered.
 
-            if isinstance(x, str):
-                return np.array(
-                    [ float(y) for y in x.split(',') ], dtype = dtype
-                )
+        Returns
+        -------
+        (ndarray, ndarray)
+            A pair of (offsets, values) arrays, such that values of the i-th
+            row are values[offsets[i]:offsets[i+1]].
+        """
+        values, offsets = self._get_column(var)
 
-            return np.array([ x ], dtype = dtype)
+        if offsets is None:
+            # Column without multi-valued fields. Empty fields are NaNs.
+            if index is not None:
+                values = values[index]
 
-        return s.apply(
-            lambda x, dtype = dtype : convert_varrstr_to_varr(x, dtype)
-        )
+            mask    = ~np.isnan(values)
+            offsets = np.zeros(len(values) + 1, dtype = np.int64)
+            np.cumsum(mask, out = offsets[1:])
 
-    def get(self, var, index = None):
-        self._lazy_load()
+            return (offsets, values[mask].astype(np.float32))
 
+        return gather_csr(offsets, values, index)
+
+    def get(self, var, index = None):
         if isinstance(var, list):
             if len(var) != 1:
                 raise RuntimeError("Invalid var: %s" % var)
             var = var[0]
 
-        with self._lock:
-            if index is None:
-                s = pd.Series(self._df.loc[:, var])
-            else:
-                s = self._df.loc[index, var]
+        values, offsets = self._get_column(var)
 
-        if np.issubdtype(s.dtype, np.number):
-            result = s
-        else:
-            result = self._convert_varr_series(s, np.float32)
+        if offsets is None:
+            if index is None:
+                return values
 
-        if isinstance(result, (pd.Series, pd.DataFrame)):
-            result = result.values
+            return values[index]
 
-        return result
+        return csr_to_varr(offsets, values, index)
 
     def __len__(self):
         return self._len
-
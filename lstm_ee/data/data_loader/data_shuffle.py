@@ -42,3 +42,15 @@ class DataShuffle(IDataLoaderDecorator):
 
         return self._data_loader.get(var, base_index)
 
+    def get_csr(self, var, index = None):
+
+        if index is None:
+            base_index = self._indices
+        else:
+            base_index = self._indices[index]
+
+        return self._data_loader.get_csr(var, base_index)
+
+    def prefetch(self, index):
+        self._data_loader.prefetch(self._indices[index])
+
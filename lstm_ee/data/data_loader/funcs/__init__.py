@@ -0,0 +1,3 @@
+"""
+A collection of helper functions for the DataLoader classes
+"""
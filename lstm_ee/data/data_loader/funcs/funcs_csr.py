@@ -0,0 +1,122 @@
+"""
+Functions for working with variable length arrays stored in CSR form.
+
+CSR form of variable length arrays is a pair of arrays (offsets, values), such
+that values of the i-th variable length array are values[offsets[i]:offsets[i+1]].
+"""
+
+import numpy as np
+
+def gather_csr(offsets, values, index):
+    """Select rows `index` of variable length arrays stored in CSR form.
+
+    Parameters
+    ----------
+    offsets : ndarray, shape (N + 1,)
+        Offsets of variable length arrays.
+    values : ndarray
+        Values of all variable length arrays.
+    index : ndarray or None
+        Rows to select. If None, (`offsets`, `values`) are returned unmodified.
+
+    Returns
+    -------
+    (ndarray, ndarray)
+        Selected variable length arrays in CSR form.
+    """
+    if index is None:
+        return (offsets, values)
+
+    index  = np.asarray(index)
+    starts = offsets[:-1][index].astype(np.int64)
+    ends   = offsets[1:][index].astype(np.int64)
+
+    result_offsets = np.zeros(len(index) + 1, dtype = np.int64)
+    np.cumsum(ends - starts, out = result_offsets[1:])
+
+    gather_index = (
+          np.repeat(starts - result_offsets[:-1], ends - starts)
+        + np.arange(result_offsets[-1])
+    )
+
+    return (result_offsets, values[gather_index])
+
+def csr_to_varr(offsets, values, index = None):
+    """Convert variable length arrays in CSR form to array of arrays.
+
+    Parameters
+    ----------
+    offsets : ndarray, shape (N + 1,)
+        Offsets of variable length arrays.
+    values : ndarray
+        Values of all variable length arrays.
+    index : int or ndarray or None
+        Rows to convert. If None, all rows will be converted.
+
+    Returns
+    -------
+    ndarray
+        If `index` is int then a single variable length array. Otherwise,
+        a `np.ndarray` of variable length arrays (views into `values`).
+    """
+    if np.isscalar(index):
+        return values[offsets[index]:offsets[index + 1]]
+
+    if index is None:
+        starts = offsets[:-1]
+        ends   = offsets[1:]
+    else:
+        index  = np.asarray(index)
+        starts = offsets[:-1][index]
+        ends   = offsets[1:][index]
+
+    result = np.empty(len(starts), dtype = object)
+
+    for idx,(start,end) in enumerate(zip(starts, ends)):
+        result[idx] = values[start:end]
+
+    return result
+
+def stack_csr(csr_list):
+    """Stack a list of variable length arrays in CSR form into a 2D CSR.
+
+    Parameters
+    ----------
+    csr_list : list of (ndarray, ndarray)
+        List of (offsets, values) pairs of variable length arrays with the
+        same number of rows.
+
+    Returns
+    -------
+    (ndarray, ndarray)
+        A pair of (offsets, values), where `values` has a shape
+        (N_VALUES, len(`csr_list`)) and values of the i-th row are
+        values[offsets[i]:offsets[i+1], :].
+        If variable length arrays of the same row have different lengths,
+        then the shorter arrays are padded by NaNs.
+    """
+    lengths = np.max(
+        [ np.diff(offsets.astype(np.int64)) for (offsets, _) in csr_list ],
+        axis = 0
+    )
+
+    result_offsets = np.zeros(len(lengths) + 1, dtype = np.uint64)
+    np.cumsum(lengths, out = result_offsets[1:])
+
+    result = np.full(
+        (int(result_offsets[-1]), len(csr_list)), np.nan, dtype = np.float32
+    )
+
+    for var_idx,(offsets, values) in enumerate(csr_list):
+        offsets = offsets.astype(np.int64)
+        counts  = np.diff(offsets)
+        rows    = np.repeat(np.arange(len(counts)), counts)
+
+        dst = (
+              result_offsets[:-1].astype(np.int64)[rows]
+            + np.arange(offsets[0], offsets[-1]) - offsets[:-1][rows]
+        )
+
+        result[dst, var_idx] = values[offsets[0]:offsets[-1]]
+
+    return (result_offsets, result)
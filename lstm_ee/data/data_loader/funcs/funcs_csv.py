@@ -0,0 +1,243 @@
+"""
+Functions for parsing `lstm_ee` csv files.
+"""
+
+import bz2
+import concurrent.futures
+import csv
+import gzip
+import io
+import lzma
+import os
+
+import numpy as np
+
+import pyximport
+pyximport.install(
+    language_level = 3,
+    setup_args     = { "include_dirs" : [ np.get_include() ] }
+)
+
+# pylint: disable=import-error,wrong-import-position
+from .funcs_csv_opt import c_parse_csv_chunk
+
+CHUNK_SIZE = 16 * 1024 * 1024
+
+COMPRESSED_OPENERS = {
+    '.gz'   : gzip.open,
+    '.bz2'  : bz2.open,
+    '.xz'   : lzma.open,
+    '.lzma' : lzma.open,
+}
+
+def open_csv(path):
+    """Open (possibly compressed) csv file `path` for binary reading.
+
+    If `path` is a file object then it will be rewound and returned as is.
+    """
+    if not isinstance(path, str):
+        if path.seekable():
+            path.seek(0)
+        return path
+
+    for ext, opener in COMPRESSED_OPENERS.items():
+        if path.endswith(ext):
+            return opener(path, 'rb')
+
+    return open(path, 'rb')
+
+def read_chunks(f, chunk_size = CHUNK_SIZE):
+    """Read file `f` in chunks that contain only complete lines."""
+    remainder = b''
+
+    while True:
+        data = f.read(chunk_size)
+
+        if isinstance(data, str):
+            data = data.encode('utf-8')
+
+        if not data:
+            break
+
+        data = remainder + data
+        split_pos = data.rfind(b'\n') + 1
+
+        if split_pos == 0:
+            remainder = data
+            continue
+
+        remainder = data[split_pos:]
+        yield data[:split_pos]
+
+    if remainder:
+        yield remainder + b'\n'
+
+def parse_header(f):
+    """Read header line of a csv file `f` and return list of column names."""
+    line = f.readline()
+
+    if isinstance(line, bytes):
+        line = line.decode('utf-8')
+
+    return next(csv.reader(io.StringIO(line)))
+
+def _merge_column_parts(parts):
+    """Merge per chunk (values, counts, quoted) of a column into a column.
+
+    The `parts` list is consumed, such that each part is released as soon as
+    it is merged.
+    """
+    quoted = any(x[2] for x in parts)
+    n_rows = sum(len(x[1]) for x in parts)
+
+    if (not quoted) and all(np.all(x[1] <= 1) for x in parts):
+        # Scalar column
+        result = np.full(n_rows, np.nan, dtype = np.float64)
+        start  = 0
+
+        while parts:
+            values, counts, _ = parts.pop(0)
+            result[start:start + len(counts)][counts == 1] = values
+            start += len(counts)
+
+        return (result, None)
+
+    offsets = np.zeros(n_rows + 1, dtype = np.int64)
+    np.cumsum(
+        np.concatenate([ x[1] for x in parts ]), out = offsets[1:]
+    )
+
+    values = np.empty(offsets[-1], dtype = np.float32)
+    start  = 0
+
+    while parts:
+        part = parts.pop(0)[0]
+        values[start:start + len(part)] = part
+        start += len(part)
+
+    return (values, offsets)
+
+def _collect_chunk(result, parts, n_rows, columns):
+    """Add parsed chunk `result` to the per column `parts`.
+
+    Raises `ValueError` if the chunk holds a value that is not a number.
+    """
+    n_chunk, chunk_parts, error = result
+
+    if error is not None:
+        row, col, value = error
+        # Lines are counted from 1 and include the header
+        raise ValueError(
+            "Failed to parse csv line %d, column '%s': '%s' is not a number"
+            % (n_rows + row + 2, columns[col], value)
+        )
+
+    for (column_parts, part) in zip(parts, chunk_parts):
+        column_parts.append(part)
+
+    return n_rows + n_chunk
+
+def parse_csv(path, variables = None, workers = None, chunk_size = CHUNK_SIZE):
+    """Parse `lstm_ee` csv file into flat arrays.
+
+    The csv file is read sequentially in chunks of `chunk_size` bytes. The
+    chunks are parsed in parallel by `workers` threads by the native parser
+    `c_parse_csv_chunk`.
+
+    A column is considered to hold variable length arrays if any of its
+    fields is quoted (e.g. "1,2" or ""). The classification relies on the
+    field syntax rather than on the number of values, so that a column where
+    each slice has at most one prong is still parsed as variable length
+    arrays. Such columns are returned in the CSR form: float32 `values` of all
+    rows and int64 `offsets` of size (N + 1). Within them an empty field holds
+    zero values, while "nan" holds a single NaN value. The remaining columns
+    are returned as float64 arrays with empty fields replaced by NaNs.
+
+    Parsed chunks are merged into the per column parts as soon as they are
+    ready, and the columns are merged one by one, releasing their parts.
+    Therefore, the peak memory usage is close to the size of the parsed data
+    plus the size of the largest column.
+
+    Fields holding values that are not numbers (e.g. "abc" or "1x") are
+    treated as errors.
+
+    Parameters
+    ----------
+    path : str or file
+        Path to the (possibly compressed) csv file, or a file object.
+    variables : list of str or None, optional
+        Names of columns to parse. If None, all columns will be parsed.
+    workers : int or None, optional
+        Number of parsing threads. If None, number of CPUs will be used.
+    chunk_size : int, optional
+        Size of chunks in bytes.
+
+    Returns
+    -------
+    (list of str, int, dict)
+        List of all column names in the file, number of rows and a dictionary
+        { name : (values, offsets) }, where `offsets` is None for the scalar
+        columns.
+
+    Raises
+    ------
+    ValueError
+        If any of the parsed fields holds a value that is not a number.
+    """
+    if workers is None:
+        workers = os.cpu_count() or 1
+
+    f = open_csv(path)
+
+    try:
+        columns = parse_header(f)
+
+        if variables is None:
+            variables = columns
+
+        unknown = set(variables) - set(columns)
+        if unknown:
+            raise KeyError("Unknown variables: %s" % sorted(unknown))
+
+        column_map = np.full(len(columns), -1, dtype = np.int32)
+        for idx,var in enumerate(variables):
+            column_map[columns.index(var)] = idx
+
+        parts  = [ [] for _ in variables ]
+        n_rows = 0
+
+        with concurrent.futures.ThreadPoolExecutor(workers) as executor:
+            pending = []
+
+            try:
+                for chunk in read_chunks(f, chunk_size):
+                    pending.append(executor.submit(
+                        c_parse_csv_chunk, chunk, column_map, len(variables)
+                    ))
+
+                    # Limit number of chunks held in RAM
+                    while len(pending) > 2 * workers:
+                        n_rows = _collect_chunk(
+                            pending.pop(0).result(), parts, n_rows, columns
+                        )
+
+                while pending:
+                    n_rows = _collect_chunk(
+                        pending.pop(0).result(), parts, n_rows, columns
+                    )
+
+            finally:
+                for x in pending:
+                    x.cancel()
+
+    finally:
+        if f is not path:
+            f.close()
+
+    empty  = (np.empty((0,)), np.empty((0,), dtype = np.int32), False)
+    result = {}
+
+    for idx,var in enumerate(variables):
+        result[var] = _merge_column_parts(parts[idx] or [ empty ])
+
+    return (columns, n_rows, result)
@@ -0,0 +1,270 @@
+# distutils: language = c++
+#cython: infer_types=True
+#cython: profile=False
+#cython: linetrace=False
+#cython: nonecheck=False
+#cython: initializedcheck=False
+
+cimport cython
+
+import  numpy as np
+cimport numpy as cnp
+
+from libc.math   cimport NAN
+from libc.stdint cimport int32_t
+from libc.stdlib cimport strtod
+from libcpp.vector cimport vector
+
+cdef inline bint is_field_end(char c) nogil:
+    return (c == b',') or (c == b'\n') or (c == b'\r') or (c == 0)
+
+cdef inline bint is_value_end(char c) nogil:
+    return (c == b',') or (c == b'"') or (c == b'\n') or (c == b'\r') or (c == 0)
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef const char* parse_field(
+    const char *p, vector[double] *values, int32_t *count, bint keep,
+    const char **bad
+) nogil:
+    """Parse single csv field starting at `p`. Return pointer past the field.
+
+    The field can either be a plain number, or a quoted comma separated list of
+    numbers. If `keep` is False then the field is skipped. If the field holds
+    a value that is not a number, then `bad` is set to point to this value and
+    NULL is returned.
+    """
+    cdef char    *endp
+    cdef bint     quoted = (p[0] == b'"')
+    cdef double   value
+
+    count[0] = 0
+
+    if quoted:
+        p += 1
+
+    while True:
+        while p[0] == b' ':
+            p += 1
+
+        if quoted and (p[0] == b'"'):
+            p += 1
+            break
+
+        if (not quoted) and is_field_end(p[0]):
+            break
+
+        if p[0] == b'\n' or p[0] == 0:
+            # unterminated quote
+            break
+
+        if keep:
+            value = strtod(p, &endp)
+
+            while endp[0] == b' ':
+                endp += 1
+
+            if (endp == p) or (not is_value_end(endp[0])):
+                bad[0] = p
+                return NULL
+
+            values.push_back(value)
+            count[0] += 1
+
+            p = endp
+
+        while not is_value_end(p[0]):
+            p += 1
+
+        if quoted and (p[0] == b','):
+            p += 1
+
+    while not is_field_end(p[0]):
+        p += 1
+
+    return p
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef Py_ssize_t parse_chunk(
+    const char *p,
+    const char *end,
+    const int  *column_map,
+    Py_ssize_t  n_map,
+    vector[vector[double]]  &values,
+    vector[vector[int32_t]] &counts,
+    vector[char]            &quoted,
+    const char            **bad,
+    Py_ssize_t             *bad_col,
+) nogil:
+    """Parse all lines of a csv chunk in [p, end). Return number of rows.
+
+    `quoted[i]` is set if any field of the output column `i` is quoted.
+    Parsing stops at the first value that is not a number. Then `bad` and
+    `bad_col` are set to this value and its csv column index, and the index of
+    its row is returned.
+    """
+    cdef Py_ssize_t n_rows = 0
+    cdef Py_ssize_t n_out  = counts.size()
+    cdef Py_ssize_t col
+    cdef Py_ssize_t out
+    cdef int32_t    count
+
+    while p < end:
+        if (p[0] == b'\n') or (p[0] == b'\r'):
+            p += 1
+            continue
+
+        col = 0
+
+        while True:
+            out = column_map[col] if (col < n_map) else -1
+
+            if out >= 0:
+                if p[0] == b'"':
+                    quoted[out] = 1
+
+                p = parse_field(p, &values[out], &count, True, bad)
+
+                if p == NULL:
+                    bad_col[0] = col
+                    return n_rows
+
+                counts[out].push_back(count)
+            else:
+                p = parse_field(p, NULL, &count, False, bad)
+
+            col += 1
+
+            if p[0] != b',':
+                break
+
+            p += 1
+
+        # Columns missing in this row
+        for out in range(n_out):
+            if <Py_ssize_t>counts[out].size() <= n_rows:
+                counts[out].push_back(0)
+
+        n_rows += 1
+
+        while (p < end) and (p[0] != b'\n'):
+            p += 1
+
+    return n_rows
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef cnp.ndarray vector_to_array(vector[double] &vec, bint single):
+    """Copy `vec` into float32 array if `single` else into float64 array"""
+    cdef cnp.ndarray result = np.empty(
+        vec.size(), dtype = (np.float32 if single else np.float64)
+    )
+    cdef float[::1]  result32
+    cdef double[::1] result64
+    cdef Py_ssize_t  i
+
+    if single:
+        result32 = result
+        for i in range(<Py_ssize_t>vec.size()):
+            result32[i] = <float>vec[i]
+    else:
+        result64 = result
+        for i in range(<Py_ssize_t>vec.size()):
+            result64[i] = vec[i]
+
+    vector[double]().swap(vec)
+
+    return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef cnp.ndarray counts_to_array(vector[int32_t] &vec):
+    cdef cnp.ndarray[cnp.int32_t, ndim=1] result = np.empty(
+        vec.size(), dtype = np.int32
+    )
+    cdef Py_ssize_t i
+
+    for i in range(<Py_ssize_t>vec.size()):
+        result[i] = vec[i]
+
+    vector[int32_t]().swap(vec)
+
+    return result
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def c_parse_csv_chunk(bytes chunk, int[::1] column_map, Py_ssize_t n_out):
+    """Parse a chunk of csv lines into flat per-column buffers.
+
+    This function does not hold GIL while parsing, so multiple chunks can be
+    parsed in parallel threads.
+
+    Parameters
+    ----------
+    chunk : bytes
+        Complete csv lines (without header) to be parsed.
+    column_map : ndarray of int32
+        Maps csv column index to the output column index. Columns with
+        negative output indices will be skipped.
+    n_out : int
+        Number of output columns.
+
+    Returns
+    -------
+    (int, list of (ndarray, ndarray, bool), tuple or None)
+        Number of parsed rows, a list of (values, counts, quoted) tuples,
+        one for each output column, and an error. `values` holds values of
+        all rows, `counts` holds int32 number of values in each row and
+        `quoted` is True if any field of the column in this chunk is quoted.
+        To save memory, `values` of the quoted columns are converted to
+        float32 (the precision of the variable length arrays), others are
+        kept as float64. If the chunk holds a value that is not a number, then
+        parsing stops and error is a tuple (row, column, value), where `row`
+        is the index of row in this chunk, `column` is the csv column index
+        and `value` is the offending value. Otherwise, error is None.
+    """
+    cdef vector[vector[double]]  values
+    cdef vector[vector[int32_t]] counts
+    cdef vector[char]            quoted
+    cdef const char *p   = chunk
+    cdef const char *end = p + len(chunk)
+    cdef const char *bad = NULL
+    cdef const char *bad_end
+    cdef Py_ssize_t bad_col = -1
+    cdef Py_ssize_t n_map   = column_map.shape[0]
+    cdef Py_ssize_t n_rows  = 0
+
+    values.resize(n_out)
+    counts.resize(n_out)
+    quoted.resize(n_out, 0)
+
+    with nogil:
+        n_rows = parse_chunk(
+            p, end, &column_map[0], n_map, values, counts, quoted,
+            &bad, &bad_col
+        )
+
+    if bad != NULL:
+        bad_end = bad
+        while not is_value_end(bad_end[0]):
+            bad_end += 1
+
+        return (
+            n_rows, None,
+            (n_rows, bad_col, bad[:bad_end - bad].decode('utf-8', 'replace'))
+        )
+
+    return (
+        n_rows,
+        [
+            (
+                vector_to_array(values[i], quoted[i]),
+                counts_to_array(counts[i]),
+                bool(quoted[i])
+            )
+                for i in range(n_out)
+        ],
+        None
+    )
+
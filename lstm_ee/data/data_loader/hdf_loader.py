@@ -2,10 +2,107 @@
 Definition of the DataLoader for working with HDF files.
 """
 
+import os
+import threading
+
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor
+
 import tables
 import numpy as np
 
-from .idata_loader import IDataLoader
+from .idata_loader    import IDataLoader
+from .funcs.funcs_csr import csr_to_varr, gather_csr
+
+DEF_CHUNK_CACHE_SIZE = 256 * 1024 * 1024
+DEF_BLOCK_ROWS       = 4096
+DEF_SPARSE_RATIO     = 64
+
+def concatenate_csr(csr_list):
+    """Concatenate rows of variable length arrays stored in CSR form"""
+    counts  = [ len(offsets) - 1 for (offsets, _) in csr_list ]
+    offsets = np.zeros(sum(counts) + 1, dtype = np.int64)
+    values  = []
+    start   = 0
+
+    for (count, (part_offsets, part_values)) in zip(counts, csr_list):
+        part_offsets = part_offsets.astype(np.int64)
+
+        offsets[start + 1:start + count + 1] = (
+            offsets[start] + part_offsets[1:] - part_offsets[0]
+        )
+        values.append(part_values[part_offsets[0]:part_offsets[-1]])
+
+        start += count
+
+    if not values:
+        return (offsets, np.empty(0, dtype = np.float32))
+
+    return (offsets, np.concatenate(values))
+
+def to_row_index(index):
+    """Convert integer or boolean `index` into an array of row numbers"""
+    index = np.asarray(index)
+
+    if index.dtype == np.bool_:
+        return np.flatnonzero(index)
+
+    return index.astype(np.int64, copy = False)
+
+class BlockCache:
+    """A thread safe LRU cache of decompressed blocks bounded by size in bytes.
+
+    Parameters
+    ----------
+    max_size : int
+        Maximum total size of the cached blocks in bytes.
+    """
+
+    def __init__(self, max_size):
+        self._max_size = max_size
+        self._size     = 0
+        self._blocks   = OrderedDict()
+        self._lock     = threading.Lock()
+
+    @staticmethod
+    def _block_size(block):
+        if isinstance(block, tuple):
+            return sum(x.nbytes for x in block)
+
+        return block.nbytes
+
+    def get(self, key):
+        """Return block `key` and mark it as recently used. None if missing"""
+        with self._lock:
+            block = self._blocks.get(key, None)
+
+            if block is not None:
+                self._blocks.move_to_end(key)
+
+            return block
+
+    def __contains__(self, key):
+        with self._lock:
+            return (key in self._blocks)
+
+    def put(self, key, block):
+        """Save `block` under `key` evicting least recently used blocks"""
+        size = self._block_size(block)
+
+        with self._lock:
+            if key in self._blocks:
+                return
+
+            self._blocks[key] = block
+            self._size += size
+
+            # Always keep the most recent block, even if it is too large
+            while (self._size > self._max_size) and (len(self._blocks) > 1):
+                _, evicted  = self._blocks.popitem(last = False)
+                self._size -= self._block_size(evicted)
+
+    def __len__(self):
+        return len(self._blocks)
 
 class HDFLoader(IDataLoader):
     """DataLoader for loading data from the HDF files.
@@ -17,38 +114,111 @@ class HDFLoader(IDataLoader):
     Each array can either be 1D array of scalars (slice data), or a 1D array of
     variable length arrays (prong data).
 
+    Rows are never read from the file one by one. Instead, each array is
+    split into blocks of consecutive rows aligned with the hdf5 chunks, and
+    requested rows are sorted and grouped by block, so that each block is
+    read and decompressed only once. Decompressed blocks are kept in an LRU
+    cache. Blocks needed by the rows passed to `prefetch` are read in a
+    background thread. Rows are always returned in the requested order.
+
+    Reading a whole block is wasteful when only a few of its rows are
+    requested, e.g. for the shuffled batches of a dataset that is larger than
+    the cache, where blocks are evicted before their other rows are used.
+    Therefore, if a block is not cached and fewer than
+    `block_rows / sparse_ratio` of its rows are requested, then only these
+    rows are read (in the sorted order) and they are not cached.
+
     Parameters
     ----------
     path : str
         Path to the hdf file with the dataset.
+    chunk_cache_size : int, optional
+        Maximum size in bytes of the decompressed blocks kept in RAM.
+        Default: 256 MiB.
+    block_rows : int, optional
+        Minimal number of rows in a block. The block size is rounded up to
+        a multiple of the hdf5 chunk size. Default: 4096.
+    prefetch : bool, optional
+        Whether to read blocks requested by `prefetch` in a background
+        thread. Default: True.
+    sparse_ratio : int or None, optional
+        Rows of a block that is not cached are read directly, if their
+        number multiplied by `sparse_ratio` is less than the number of rows
+        in the block. If None, whole blocks are always read. Default: 64.
 
     Notes
     -----
-    HDF5 files have absolutely terrible random access performance. You should
-    consider using parallelization when working with HDF5 files.
+    HDF5 files have poor random access performance, so the blocks should be
+    large enough to amortize the decompression of a chunk, and the cache
+    should be large enough to hold a sizable fraction of the dataset when
+    the data are shuffled. Variable length arrays are held in the CSR form
+    (c.f. `get_csr`).
 
     Also, quite surprisingly, xz compressed CSV files take much less disk space
     than the compressed HDF files using internal HDF compressors.
     """
 
-    def __init__(self, path):
-        # pylint: disable=unused-argument
+    # pylint: disable=too-many-instance-attributes
+    def __init__(
+        self, path,
+        chunk_cache_size = DEF_CHUNK_CACHE_SIZE,
+        block_rows       = DEF_BLOCK_ROWS,
+        prefetch         = True,
+        sparse_ratio     = DEF_SPARSE_RATIO,
+    ):
+        # pylint: disable=too-many-arguments
         super(HDFLoader, self).__init__()
 
-        self._fname = path
-        self._f     = tables.open_file(path, 'r')
+        self._fname            = path
+        self._chunk_cache_size = chunk_cache_size
+        self._min_block_rows   = block_rows
+        self._prefetch         = prefetch
+        self._sparse_ratio     = sparse_ratio
+
+        self._f         = None
+        self._pid       = None
+        self._cache     = None
+        self._io_lock   = None
+        self._executor  = None
+        self._used_vars = OrderedDict()
+
+        self._lazy_load()
 
         nodes = self._f.list_nodes('/')
-        self._variables = [ node.name for node in nodes ]
+        self._variables  = [ node.name for node in nodes ]
+        self._is_varr    = {
+            node.name : isinstance(node, tables.VLArray) for node in nodes
+        }
+        self._block_rows = {
+            node.name : self._get_block_rows(node) for node in nodes
+        }
 
         if not self._variables:
             self._len = 0
         else:
             self._len = len(nodes[0])
 
+    def _get_block_rows(self, node):
+        chunk_rows = getattr(node, 'chunkshape', None)
+
+        if not chunk_rows:
+            return self._min_block_rows
+
+        chunk_rows = int(chunk_rows[0])
+        n_chunks   = max(1, -(-self._min_block_rows // chunk_rows))
+
+        return n_chunks * chunk_rows
+
     def _lazy_load(self):
-        if self._f is None:
-            self._f = tables.open_file(self._fname, 'r')
+        # File handles and threads are not inherited by the forked processes
+        if (self._f is not None) and (self._pid == os.getpid()):
+            return
+
+        self._f        = tables.open_file(self._fname, 'r')
+        self._pid      = os.getpid()
+        self._cache    = BlockCache(self._chunk_cache_size)
+        self._io_lock  = threading.Lock()
+        self._executor = None
 
     def __getstate__(self):
         """Serialize object for pickle.
@@ -59,15 +229,19 @@ class HDFLoader(IDataLoader):
         -----
         Pickling is required for multiprocessing.
 
-        Internal `tables.File` object cannot be pickled, so we first drop it
-        and then reload when needed on the first use.
+        Internal `tables.File` object, cache, locks and the prefetching thread
+        cannot be pickled, so we drop them and then recreate when needed on
+        the first use.
         """
+        state = self.__dict__.copy()
 
-        if self._f is not None:
-            self._f.close()
-            self._f = None
+        state['_f']        = None
+        state['_pid']      = None
+        state['_cache']    = None
+        state['_io_lock']  = None
+        state['_executor'] = None
 
-        return self.__dict__
+        return state
 
     def variables(self):
         return self._variables
@@ -75,13 +249,229 @@ class HDFLoader(IDataLoader):
     def __len__(self):
         return self._len
 
+    @property
+    def has_csr(self):
+        return True
+
+    def _read_rows(self, var, start, end):
+        """Read rows [start, end) of `var`. Must be called under `_io_lock`"""
+        return self._convert_rows(
+            var, self._f.get_node('/' + var).read(start, end)
+        )
+
+    def _read_points(self, var, index):
+        """Read sorted unique rows `index` of `var` bypassing the cache"""
+        with self._io_lock:
+            node = self._f.get_node('/' + var)
+
+            if self._is_varr[var]:
+                rows = node[index.tolist()]
+            else:
+                rows = node[index]
+
+            return self._convert_rows(var, rows)
+
+    def _convert_rows(self, var, rows):
+        """Convert rows read from `var` into scalars or CSR pair"""
+        if not self._is_varr[var]:
+            return np.asarray(rows)
+
+        offsets = np.zeros(len(rows) + 1, dtype = np.int64)
+        np.cumsum([ len(x) for x in rows ], out = offsets[1:])
+
+        if not rows:
+            return (offsets, np.empty(0, dtype = np.float32))
+
+        return (offsets, np.concatenate(rows))
+
+    def _get_block(self, var, block):
+        key    = (var, block)
+        result = self._cache.get(key)
+
+        if result is not None:
+            return result
+
+        with self._io_lock:
+            # Block may have been read by the prefetching thread meanwhile
+            result = self._cache.get(key)
+
+            if result is None:
+                rows   = self._block_rows[var]
+                result = self._read_rows(
+                    var, block * rows, min((block + 1) * rows, self._len)
+                )
+                self._cache.put(key, result)
+
+        return result
+
+    def _is_sparse(self, var, n_rows):
+        """Check whether reading `n_rows` rows of a block should be direct"""
+        return (self._sparse_ratio is not None) and (
+            n_rows * self._sparse_ratio < self._block_rows[var]
+        )
+
+    def _get_sparse(self, var, block, rows):
+        """Return rows of `block`, or None, if the block should be read.
+
+        Returns a pair (values, index), such that the values of `rows` are
+        values[index] (or CSR rows `index` of values for `var` of variable
+        length arrays).
+        """
+        if (var, block) in self._cache:
+            return None
+
+        unique, inverse = np.unique(rows, return_inverse = True)
+
+        if not self._is_sparse(var, len(unique)):
+            return None
+
+        return (self._read_points(var, unique), inverse)
+
+    def _group_by_block(self, var, index):
+        """Group `index` by blocks. Yield (block, positions in `index`)"""
+        blocks = index // self._block_rows[var]
+        order  = np.argsort(blocks, kind = 'stable')
+        blocks = blocks[order]
+
+        if len(order) == 0:
+            return
+
+        starts = np.concatenate(([ 0 ], np.flatnonzero(np.diff(blocks)) + 1))
+        ends   = np.append(starts[1:], len(order))
+
+        for (start, end) in zip(starts, ends):
+            yield (int(blocks[start]), order[start:end])
+
+    def _get_scalars(self, var, index):
+        rows   = self._block_rows[var]
+        result = None
+
+        for (block, positions) in self._group_by_block(var, index):
+            sparse = self._get_sparse(var, block, index[positions])
+
+            if sparse is None:
+                values = self._get_block(var, block)
+                local  = index[positions] - block * rows
+            else:
+                values, local = sparse
+
+            if result is None:
+                result = np.empty(len(index), dtype = values.dtype)
+
+            result[positions] = values[local]
+
+        if result is None:
+            with self._io_lock:
+                dtype = self._f.get_node('/' + var).dtype
+
+            result = np.empty(0, dtype = dtype)
+
+        return result
+
+    def _get_varrs(self, var, index):
+        rows  = self._block_rows[var]
+        parts = []
+        order = []
+
+        for (block, positions) in self._group_by_block(var, index):
+            sparse = self._get_sparse(var, block, index[positions])
+
+            if sparse is None:
+                offsets, values = self._get_block(var, block)
+                local = index[positions] - block * rows
+            else:
+                (offsets, values), local = sparse
+
+            parts.append(gather_csr(offsets, values, local))
+            order.append(positions)
+
+        if not parts:
+            return (
+                np.zeros(1, dtype = np.int64), np.empty(0, dtype = np.float32)
+            )
+
+        # Restore the requested order of rows
+        order   = np.concatenate(order)
+        inverse = np.empty_like(order)
+        inverse[order] = np.arange(len(order))
+
+        return gather_csr(*concatenate_csr(parts), inverse)
+
+    def _get(self, var, index):
+        """Return values of `var`: scalars or (offsets, values) CSR pair"""
+        self._lazy_load()
+        self._used_vars[var] = True
+
+        if index is None:
+            with self._io_lock:
+                return self._read_rows(var, 0, self._len)
+
+        index = to_row_index(index)
+
+        if self._is_varr[var]:
+            return self._get_varrs(var, index)
+
+        return self._get_scalars(var, index)
+
+    def get_csr(self, var, index = None):
+        if not self._is_varr[var]:
+            raise RuntimeError(
+                "Variable '%s' is not a variable length array" % var
+            )
+
+        return self._get(var, index)
+
     def get(self, var, index = None):
+        if np.isscalar(index):
+            result = self.get(var, [ index ])
+            return result[0]
+
+        result = self._get(var, index)
+
+        if self._is_varr[var]:
+            return csr_to_varr(*result)
+
+        return result
+
+    def _prefetch_blocks(self, keys):
+        for (var, block) in keys:
+            self._get_block(var, block)
+
+    def prefetch(self, index):
+        """Read blocks holding rows `index` in a background thread.
+
+        Only blocks of the variables that have been requested previously
+        are read. Blocks that would be read directly, because only a few of
+        their rows are requested, are skipped.
+        """
+        if (not self._prefetch) or (not self._used_vars):
+            return
+
         self._lazy_load()
 
-        node = self._f.get_node('/' + var)
+        index = np.unique(to_row_index(index))
+        keys  = []
 
-        if index is None:
-            return np.array(node[:])
-        else:
-            return np.array(node[index])
+        for var in self._used_vars:
+            blocks, counts = np.unique(
+                index // self._block_rows[var], return_counts = True
+            )
+
+            keys += [
+                (var, int(block))
+                    for (block, count) in zip(blocks, counts)
+                    if (not self._is_sparse(var, count))
+                        and ((var, int(block)) not in self._cache)
+            ]
+
+        if not keys:
+            return
+
+        if self._executor is None:
+            self._executor = ThreadPoolExecutor(max_workers = 1)
+
+        self._executor.submit(self._prefetch_blocks, keys)
 
+    def __del__(self):
+        if getattr(self, '_executor', None) is not None:
+            self._executor.shutdown(wait = False)
@@ -2,6 +2,8 @@
 Definition of a DataLoader Interface.
 """
 
+import numpy as np
+
 class IDataLoader():
     """An interface for DataLoader object.
 
@@ -45,6 +47,56 @@ class IDataLoader():
         """
         raise NotImplementedError
 
+    @property
+    def has_csr(self):
+        """Whether variable length arrays are natively held in CSR form.
+
+        If True, then `get_csr` is cheap and should be preferred over `get`
+        for variable length arrays.
+        """
+        return False
+
+    def get_csr(self, var, index = None):
+        """Return values of a variable length array variable `var` as CSR.
+
+        This default implementation converts values returned by `get`.
+
+        Parameters
+        ----------
+        var : str
+            Name of the variable to retrieve values for.
+        index : ndarray or None
+            If `index` is None this function will return all values for the
+            variable `var`.
+            Otherwise, it will return only values specified by `index`.
+
+        Returns
+        -------
+        (ndarray, ndarray)
+            A pair of (offsets, values) arrays, such that values of the i-th
+            row are values[offsets[i]:offsets[i+1]].
+        """
+        rows    = self.get(var, index)
+        offsets = np.zeros(len(rows) + 1, dtype = np.int64)
+        np.cumsum([ len(x) for x in rows ], out = offsets[1:])
+
+        if offsets[-1] == 0:
+            return (offsets, np.empty((0,), dtype = np.float32))
+
+        return (offsets, np.concatenate(rows).astype(np.float32))
+
+    def prefetch(self, index):
+        """Hint that rows `index` will be requested soon.
+
+        DataLoaders with slow random access may start loading these rows in
+        background. This default implementation does nothing.
+
+        Parameters
+        ----------
+        index : ndarray
+            Rows that will be requested soon.
+        """
+
     def __len__(self):
         raise NotImplementedError
 
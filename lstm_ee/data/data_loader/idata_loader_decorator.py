@@ -17,6 +17,16 @@ class IDataLoaderDecorator(IDataLoader):
     def get(self, var, index = None):
         return self._data_loader.get(var, index)
 
+    @property
+    def has_csr(self):
+        return self._data_loader.has_csr
+
+    def get_csr(self, var, index = None):
+        return self._data_loader.get_csr(var, index)
+
+    def prefetch(self, index):
+        self._data_loader.prefetch(index)
+
     def __len__(self):
         return len(self._data_loader)
 
@@ -0,0 +1,429 @@
+"""
+Driver that runs an exporter over shards of a file list in parallel and
+merges the per-shard outputs.
+"""
+
+import hashlib
+import json
+import logging
+import os
+import re
+import shlex
+import subprocess
+import time
+
+from concurrent.futures import ThreadPoolExecutor, wait, FIRST_COMPLETED
+
+from .data_loader.columnar_loader import ColumnarLoader, save_columnar
+
+LOGGER = logging.getLogger('lstm_ee.data.sharded_export')
+
+ENV_FILELIST = 'LSTM_EE_EXPORT_FILELIST'
+ENV_OUTPUT   = 'LSTM_EE_EXPORT_OUTPUT'
+ENV_FORMAT   = 'LSTM_EE_EXPORT_FORMAT'
+
+DEFAULT_COMMAND = 'cafe -bq {macro}'
+
+RE_LOCAL_INCLUDE = re.compile(r'^\s*#\s*include\s+"([^"]+)"', re.MULTILINE)
+
+STATE_PENDING = 'pending'
+STATE_RUNNING = 'running'
+STATE_DONE    = 'done'
+STATE_FAILED  = 'failed'
+
+def split_shards(files, n_shards):
+    """Split list of `files` into `n_shards` contiguous balanced shards.
+
+    Parameters
+    ----------
+    files : list of str
+        List of files to be split.
+    n_shards : int
+        Number of shards. It is capped by the number of files.
+
+    Returns
+    -------
+    list of list of str
+        Shards of files. Concatenation of shards gives back `files`.
+    """
+    n_shards = max(1, min(n_shards, len(files)))
+    result   = []
+    start    = 0
+
+    for idx in range(n_shards):
+        end = start + (len(files) - start) // (n_shards - idx)
+        result.append(list(files[start:end]))
+        start = end
+
+    return result
+
+def read_file_list(path):
+    """Read list of files from a text file `path` (one file per line)."""
+    with open(path, 'rt') as f:
+        return [ x.strip() for x in f if x.strip() ]
+
+def hash_macro(path):
+    """Calculate digest of the macro `path` and of its local includes.
+
+    Local includes are the `#include "..."` files that can be found relative
+    to the directory of the including file (e.g. "../common/ColumnarMaker.h").
+    They are followed recursively. Other includes (e.g. CAFAna headers) are
+    ignored.
+
+    Parameters
+    ----------
+    path : str
+        Path to the exporter macro.
+
+    Returns
+    -------
+    str
+        Hex digest of the macro and its local includes.
+    """
+    digest  = hashlib.sha1()
+    pending = [ os.path.abspath(path) ]
+    visited = set()
+
+    while pending:
+        fname = pending.pop(0)
+
+        if fname in visited:
+            continue
+
+        visited.add(fname)
+
+        with open(fname, 'rb') as f:
+            contents = f.read()
+
+        digest.update(fname.encode('utf-8') + b'\0')
+        digest.update(hashlib.sha1(contents).digest())
+
+        for include in RE_LOCAL_INCLUDE.findall(
+            contents.decode('utf-8', 'replace')
+        ):
+            include = os.path.normpath(
+                os.path.join(os.path.dirname(fname), include)
+            )
+
+            if os.path.isfile(include):
+                pending.append(include)
+
+    return digest.hexdigest()
+
+class Shard:
+    """A single shard of the sharded export.
+
+    Parameters
+    ----------
+    index : int
+        Shard index.
+    files : list of str
+        Files of the shard.
+    outdir : str
+        Directory where the shard outputs are stored.
+    command : str
+        Worker command of the export (used to key the shard outputs).
+    macro_digest : str or None, optional
+        Digest of the exporter macro and its includes (c.f. `hash_macro`),
+        used to key the shard outputs. Default: None.
+    """
+
+    def __init__(self, index, files, outdir, command, macro_digest = None):
+        self.index  = index
+        self.files  = files
+        self.state  = STATE_PENDING
+        self.time   = 0
+        self.digest = hashlib.sha1(
+            json.dumps([ command, files, macro_digest ]).encode('utf-8')
+        ).hexdigest()
+
+        prefix = os.path.join(outdir, 'shard_%04d' % index)
+
+        self.path_filelist = prefix + '.files'
+        self.path_output   = prefix + '.lcol'
+        self.path_partial  = prefix + '.part.lcol'
+        self.path_log      = prefix + '.log'
+        self.path_done     = prefix + '.done'
+
+    def is_complete(self):
+        """Check whether shard output exists and matches the shard inputs"""
+        if not os.path.exists(self.path_output):
+            return False
+
+        try:
+            with open(self.path_done, 'rt') as f:
+                return (json.load(f)['digest'] == self.digest)
+        except (IOError, ValueError, KeyError):
+            return False
+
+    def last_log_line(self):
+        """Return the last non empty line of the shard log"""
+        try:
+            with open(self.path_log, 'rb') as f:
+                f.seek(max(0, os.fstat(f.fileno()).st_size - 4096))
+                lines = f.read().replace(b'\r', b'\n').split(b'\n')
+        except IOError:
+            return ''
+
+        lines = [ x.strip() for x in lines if x.strip() ]
+        return lines[-1].decode('utf-8', 'replace') if lines else ''
+
+    def __str__(self):
+        return 'shard %d (%d files)' % (self.index, len(self.files))
+
+class ShardedExport:
+    """Run an exporter over shards of a file list in parallel worker processes.
+
+    The list of input files is sorted and split into contiguous shards. Each
+    shard is exported by a separate worker process that runs `command`. The
+    worker receives its shard through the environment variables:
+        - LSTM_EE_EXPORT_FILELIST -- path to the list of shard files
+        - LSTM_EE_EXPORT_OUTPUT   -- path to the shard output file
+        - LSTM_EE_EXPORT_FORMAT   -- always 'lcol'
+    which are honored by the exporters that create their `ColumnarMaker` with
+    `MakeColumnarMaker` or `RunExporter` (c.f.
+    `exporters/common/ColumnarMaker.h`).
+
+    Finished shards are recorded in `outdir`, so that a failed or interrupted
+    export can be resumed and only the unfinished shards are rerun. Shards
+    are rerun if the files, the command, the macro or the headers that the
+    macro includes by a relative path have changed.
+    The merged output is concatenated in the shard order, which makes its row
+    order reproducible and identical to the export of the sorted file list by
+    a single process.
+
+    Parameters
+    ----------
+    files : list of str
+        List of input files.
+    outdir : str
+        Directory where the shard file lists, outputs and logs are stored.
+    n_shards : int
+        Number of shards to split the `files` into.
+    macro : str or None, optional
+        Path to the exporter macro. Default: None.
+    command : str, optional
+        Worker command. It may contain placeholders {macro}, {filelist},
+        {output} and {shard} that are substituted by the macro path, the
+        shard file list, the shard output and the shard index respectively.
+        Default: 'cafe -bq {macro}'.
+    workers : int or None, optional
+        Number of parallel worker processes. If None, it will be equal to the
+        number of CPU cores. Default: None.
+    retries : int, optional
+        Number of times a failed shard is retried. Default: 0.
+    progress_interval : float, optional
+        Interval in seconds between the progress reports. Default: 60.
+    """
+
+    # pylint: disable=too-many-instance-attributes
+    def __init__(
+        self, files, outdir, n_shards,
+        macro             = None,
+        command           = DEFAULT_COMMAND,
+        workers           = None,
+        retries           = 0,
+        progress_interval = 60,
+    ):
+        # pylint: disable=too-many-arguments
+        if not files:
+            raise RuntimeError("Empty list of input files")
+
+        self._outdir   = os.path.abspath(outdir)
+        self._macro    = None if macro is None else os.path.abspath(macro)
+        self._command  = command
+        self._workers  = workers or os.cpu_count() or 1
+        self._retries  = retries
+        self._interval = progress_interval
+
+        files = sorted(
+            x if '://' in x else os.path.abspath(x) for x in files
+        )
+
+        # Shard outputs are invalidated by changes of the macro or headers
+        macro_digest = None if macro is None else hash_macro(self._macro)
+
+        self._shards = [
+            Shard(
+                idx, shard_files, self._outdir, self._format_command(),
+                macro_digest
+            )
+            for (idx, shard_files) in enumerate(split_shards(files, n_shards))
+        ]
+
+    @property
+    def shards(self):
+        """List of export shards"""
+        return self._shards
+
+    def _format_command(self, shard = None):
+        return self._command.format(
+            macro    = self._macro or '',
+            filelist = '' if shard is None else shard.path_filelist,
+            output   = '' if shard is None else shard.path_partial,
+            shard    = '' if shard is None else shard.index,
+        )
+
+    def _run_shard(self, shard):
+        with open(shard.path_filelist, 'wt') as f:
+            f.write('\n'.join(shard.files) + '\n')
+
+        env = dict(os.environ)
+        env[ENV_FILELIST] = shard.path_filelist
+        env[ENV_OUTPUT]   = shard.path_partial
+        env[ENV_FORMAT]   = 'lcol'
+
+        command = shlex.split(self._format_command(shard))
+
+        for attempt in range(self._retries + 1):
+            if os.path.exists(shard.path_partial):
+                os.remove(shard.path_partial)
+
+            start = time.time()
+
+            with open(shard.path_log, 'wb') as log:
+                returncode = subprocess.call(
+                    command, stdout = log, stderr = subprocess.STDOUT,
+                    env = env, cwd = self._outdir
+                )
+
+            shard.time = time.time() - start
+
+            if (returncode == 0) and os.path.exists(shard.path_partial):
+                os.replace(shard.path_partial, shard.path_output)
+
+                with open(shard.path_done, 'wt') as f:
+                    json.dump(
+                        { 'digest' : shard.digest, 'time' : shard.time }, f
+                    )
+
+                return True
+
+            LOGGER.warning(
+                "%s failed (attempt %d of %d, exit code %d). See %s",
+                shard, attempt + 1, self._retries + 1, returncode,
+                shard.path_log
+            )
+
+        return False
+
+    def _report_progress(self, start):
+        counts = { state : 0 for state in
+            [ STATE_PENDING, STATE_RUNNING, STATE_DONE, STATE_FAILED ] }
+
+        for shard in self._shards:
+            counts[shard.state] += 1
+
+        LOGGER.info(
+            "Progress: %d done, %d running, %d pending, %d failed. "
+            "Elapsed %.0fs",
+            counts[STATE_DONE], counts[STATE_RUNNING], counts[STATE_PENDING],
+            counts[STATE_FAILED], time.time() - start
+        )
+
+        for shard in self._shards:
+            if shard.state == STATE_RUNNING:
+                LOGGER.info("  %s: %s", shard, shard.last_log_line())
+
+    def run(self, resume = True):
+        """Export all shards.
+
+        Parameters
+        ----------
+        resume : bool, optional
+            If True, the shards that were completed by a previous run (with
+            the same files, command and macro) are not rerun. Default: True.
+
+        Returns
+        -------
+        list of str
+            Paths of the shard outputs in the shard order.
+
+        Raises
+        ------
+        RuntimeError
+            If any of the shards has failed. Rerunning the export with
+            `resume` enabled will retry only the failed shards.
+        """
+        os.makedirs(self._outdir, exist_ok = True)
+
+        shards = []
+
+        for shard in self._shards:
+            if resume and shard.is_complete():
+                shard.state = STATE_DONE
+                LOGGER.info("%s is complete already. Skipping", shard)
+            else:
+                if os.path.exists(shard.path_done):
+                    os.remove(shard.path_done)
+
+                shard.state = STATE_PENDING
+                shards.append(shard)
+
+        start = time.time()
+
+        with ThreadPoolExecutor(max_workers = self._workers) as executor:
+            futures = {}
+
+            for shard in shards:
+                futures[executor.submit(self._run_shard_wrapper, shard)] \
+                    = shard
+
+            pending = set(futures)
+
+            while pending:
+                done, pending = wait(
+                    pending, timeout = self._interval,
+                    return_when = FIRST_COMPLETED
+                )
+
+                for future in done:
+                    shard = futures[future]
+
+                    if future.result():
+                        shard.state = STATE_DONE
+                        LOGGER.info("%s done in %.1fs", shard, shard.time)
+                    else:
+                        shard.state = STATE_FAILED
+                        LOGGER.error("%s failed. See %s", shard, shard.path_log)
+
+                if not done:
+                    self._report_progress(start)
+
+        self._report_progress(start)
+
+        failed = [ x for x in self._shards if x.state != STATE_DONE ]
+        if failed:
+            raise RuntimeError(
+                "Export of %d shards has failed: %s" % (
+                    len(failed), ', '.join(str(x.index) for x in failed)
+                )
+            )
+
+        return [ x.path_output for x in self._shards ]
+
+    def _run_shard_wrapper(self, shard):
+        shard.state = STATE_RUNNING
+
+        try:
+            return self._run_shard(shard)
+        except (OSError, ValueError) as e:
+            LOGGER.error("%s: %s", shard, e)
+            return False
+
+    def merge(self, path):
+        """Merge outputs of all shards into a single columnar file `path`"""
+        merge_shards([ x.path_output for x in self._shards ], path)
+
+def merge_shards(paths, output):
+    """Concatenate columnar files `paths` into `output` in the given order.
+
+    Shards without any rows (e.g. when all slices of a shard were rejected by
+    the cuts) are skipped.
+    """
+    loaders = [ ColumnarLoader(x) for x in paths ]
+    loaders = [ x for x in loaders if len(x) > 0 ] or loaders[:1]
+
+    tmp = output + '.part'
+    save_columnar(tmp, loaders)
+    os.replace(tmp, output)
@@ -0,0 +1,249 @@
+"""
+Generator of synthetic datasets shaped like the exporter outputs.
+"""
+
+import csv
+import warnings
+
+import numpy as np
+import tables
+
+from .data_loader.dict_loader     import DictLoader
+from .data_loader.columnar_loader import save_columnar
+
+DEF_PRESET     = 'numu_v3'
+DEF_VAR_WEIGHT = 'weight'
+
+def sample_prong_counts(prg, n_slices, mean, min_count, max_count):
+    """Sample numbers of prongs per slice.
+
+    Prong multiplicities of the exporter outputs have long tails, so they
+    are sampled from a negative binomial distribution (overdispersed
+    Poisson) shifted by `min_count` and truncated at `max_count`.
+    """
+    mean = max(mean - min_count, 1e-3)
+
+    # Negative binomial with variance = 2 * mean
+    n_success = mean
+    p_success = n_success / (n_success + mean)
+
+    counts = min_count + prg.negative_binomial(n_success, p_success, n_slices)
+
+    return np.minimum(counts, max_count)
+
+def _sample_values(prg, var, size):
+    """Sample values of a variable `var` with a plausible distribution"""
+    name = var.split('.')[-1]
+
+    if name in [ 'x', 'y', 'z' ] and '.dir.' in var:
+        return prg.uniform(-1, 1, size)
+
+    if name.endswith('id') or name == 'pid':
+        return prg.uniform(0, 1, size)
+
+    if name.startswith('n') or name in [ 'lowGain', 'coarseTiming' ]:
+        return np.floor(prg.gamma(2, 10, size))
+
+    return prg.gamma(2, 0.5, size)
+
+def make_synthetic_data(
+    n_slices,
+    vars_input_slice   = None,
+    vars_input_png3d   = None,
+    vars_input_png2d   = None,
+    var_target_total   = None,
+    var_target_primary = None,
+    var_weight         = DEF_VAR_WEIGHT,
+    mean_png3d         = 3.0,
+    mean_png2d         = 1.5,
+    max_prongs         = 20,
+    nan_fraction       = 0.01,
+    seed               = 0,
+):
+    """Create a synthetic dataset with the structure of the exporter outputs.
+
+    Parameters
+    ----------
+    n_slices : int
+        Number of slices.
+    vars_input_slice : list of str or None, optional
+        Names of the slice level variables. Default: None.
+    vars_input_png3d : list of str or None, optional
+        Names of the 3D prong level variables. Default: None.
+    vars_input_png2d : list of str or None, optional
+        Names of the 2D prong level variables. Default: None.
+    var_target_total : str or None, optional
+        Name of the true total energy variable. Default: None.
+    var_target_primary : str or None, optional
+        Name of the true primary energy variable. Default: None.
+    var_weight : str or None, optional
+        Name of the weight variable. Default: 'weight'.
+    mean_png3d : float, optional
+        Mean number of 3D prongs per slice. Each slice has at least one 3D
+        prong. Default: 3.
+    mean_png2d : float, optional
+        Mean number of 2D prongs per slice. Default: 1.5.
+    max_prongs : int, optional
+        Maximum number of prongs of each type per slice. Default: 20.
+    nan_fraction : float, optional
+        Fraction of the prong values that are NaN (e.g. failed fits).
+        Default: 0.01.
+    seed : int, optional
+        Seed of the random number generator. Default: 0.
+
+    Returns
+    -------
+    dict
+        Dictionary where keys are variable names and values are either
+        `ndarray` of float32 scalars (slice level variables), or `ndarray`
+        of float32 `ndarray` (prong level variables). It can be passed to the
+        `DictLoader` or saved with `save_synthetic_data`.
+    """
+    # pylint: disable=too-many-arguments
+    # pylint: disable=too-many-locals
+    prg    = np.random.RandomState(seed)
+    result = {}
+
+    for var in (vars_input_slice or []):
+        result[var] = _sample_values(prg, var, n_slices).astype(np.float32)
+
+    for (variables, mean, min_count) in [
+        (vars_input_png3d, mean_png3d, 1),
+        (vars_input_png2d, mean_png2d, 0),
+    ]:
+        if not variables:
+            continue
+
+        counts  = sample_prong_counts(
+            prg, n_slices, mean, min_count, max_prongs
+        )
+        offsets = np.concatenate(([ 0 ], np.cumsum(counts)))
+
+        for var in variables:
+            values = _sample_values(prg, var, offsets[-1]).astype(np.float32)
+            values[prg.uniform(size = len(values)) < nan_fraction] = np.nan
+
+            result[var] = np.empty(n_slices, dtype = object)
+            result[var][:] = np.split(values, offsets[1:-1])
+
+    true_total = prg.gamma(4, 0.5, n_slices).astype(np.float32)
+
+    if var_target_total is not None:
+        result[var_target_total] = true_total
+
+    if var_target_primary is not None:
+        result[var_target_primary] = (
+            true_total * prg.uniform(0.2, 1, n_slices)
+        ).astype(np.float32)
+
+    if var_weight is not None:
+        result[var_weight] = prg.uniform(0.5, 1.5, n_slices).astype(np.float32)
+
+    return result
+
+def make_synthetic_preset_data(n_slices, preset = DEF_PRESET, **kwargs):
+    """Create a synthetic dataset with the variables of a training `preset`.
+
+    Parameters
+    ----------
+    n_slices : int
+        Number of slices.
+    preset : str, optional
+        Name of the training preset (c.f. `lstm_ee.presets.PRESETS_TRAIN`).
+        Default: 'numu_v3'.
+    **kwargs : dict
+        Additional arguments of `make_synthetic_data`.
+
+    Returns
+    -------
+    dict
+        Synthetic dataset. C.f. `make_synthetic_data`.
+    """
+    # pylint: disable=import-outside-toplevel
+    # Presets are imported lazily, since they depend on the plotting modules
+    from lstm_ee.presets import PRESETS_TRAIN
+
+    config = PRESETS_TRAIN[preset]
+
+    return make_synthetic_data(
+        n_slices,
+        vars_input_slice   = config.get('vars_input_slice'),
+        vars_input_png3d   = config.get('vars_input_png3d'),
+        vars_input_png2d   = config.get('vars_input_png2d'),
+        var_target_total   = config.get('var_target_total'),
+        var_target_primary = config.get('var_target_primary'),
+        **kwargs
+    )
+
+def _format_csv_column(values):
+    """Format column `values` as a list of csv strings"""
+    # float32 values are round tripped exactly by 9 significant digits
+    if values.dtype != object:
+        return [ '%.9g' % x for x in values.tolist() ]
+
+    lengths = [ len(x) for x in values ]
+    strings = [ '%.9g' % x for x in np.concatenate(values).tolist() ]
+    result  = []
+    start   = 0
+
+    # Prong fields are always quoted, so that the column is recognized as a
+    # prong level variable even if no slice has more than one prong
+    for length in lengths:
+        result.append('"%s"' % ",".join(strings[start:start + length]))
+        start += length
+
+    return result
+
+def _save_csv(data, path):
+    columns = list(data.keys())
+
+    with open(path, 'wt', newline = '') as f:
+        csv.writer(f).writerow(columns)
+
+        for row in zip(*[ _format_csv_column(data[c]) for c in columns ]):
+            f.write(",".join(row) + '\n')
+
+def _save_hdf(data, path):
+    filters = tables.Filters(complib = 'zlib', complevel = 5)
+
+    with warnings.catch_warnings(), \
+         tables.open_file(path, 'w', filters = filters) as f:
+        warnings.filterwarnings('ignore', category = tables.NaturalNameWarning)
+
+        for (var, values) in data.items():
+            if values.dtype != object:
+                f.create_carray('/', var, obj = values)
+                continue
+
+            node = f.create_vlarray(
+                '/', var, atom = tables.Float32Atom(shape = ()),
+                expectedrows = len(values)
+            )
+
+            for row in values:
+                node.append(row)
+
+def save_synthetic_data(data, path, fmt = None):
+    """Save synthetic dataset `data` into a file `path`.
+
+    Parameters
+    ----------
+    data : dict
+        Dataset created by `make_synthetic_data`.
+    path : str
+        Output path.
+    fmt : { 'csv', 'hdf', 'lcol', None }, optional
+        Output format. If None, it is guessed from the `path` extension.
+        Default: None.
+    """
+    if fmt is None:
+        fmt = path.rsplit('.', 1)[-1]
+
+    if fmt == 'csv':
+        _save_csv(data, path)
+    elif fmt in [ 'h5', 'hdf', 'hdf5' ]:
+        _save_hdf(data, path)
+    elif fmt == 'lcol':
+        save_columnar(path, DictLoader(data))
+    else:
+        raise ValueError("Unknown synthetic data format: %s" % fmt)
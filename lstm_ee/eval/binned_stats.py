@@ -1,9 +1,368 @@
 """
-Functions for calculating binned statistics.
+Functions and accumulators for calculating binned statistics.
 """
 
+import os
+
 import numpy as np
-from .stats import calc_stat
+
+import pyximport
+pyximport.install(
+    language_level = 3,
+    setup_args     = { "include_dirs" : [ np.get_include() ] }
+)
+
+# pylint: disable=import-error,wrong-import-position
+from .stats            import calc_stat
+from .binned_stats_opt import CBinnedStats, c_fill_many
+
+DEF_COMPRESSION = 100
+STATS_MAGIC     = b'LSTMEEBS_SET'
+
+class BinnedStats:
+    """A streaming accumulator of weighted statistics of `y` in bins of `x`.
+
+    `BinnedStats` is filled by chunks of (x, y, weights) values in a single
+    pass, so that the statistics can be calculated over datasets that do not
+    fit in memory. It is backed by a native accumulator (c.f.
+    `lstm_ee/eval/native/BinnedStats.h`) that keeps weighted sums of
+    deviations from a shift for the moments and t-digest sketches for the
+    quantiles. Accumulators with the
+    same bins can be merged, e.g. to combine results calculated over
+    different files.
+
+    Apart from the statistics in each bin, the statistics of all values
+    (regardless of `x`) are accumulated as well (c.f. `get_total_stat`).
+
+    Parameters
+    ----------
+    bins_x : list of float
+        List of bin edges. Bins follow the `np.digitize` convention.
+    compression : float, optional
+        Compression of the quantile sketches. Larger values give more accurate
+        quantiles at the cost of memory. Default: 100.
+    workers : int or None, optional
+        Number of threads used to fill large chunks. If None, the number of
+        threads will be equal to the number of CPUs. Default: None.
+
+    Notes
+    -----
+    Values with non finite x, y or weights are skipped. Like in `calc_stat`,
+    values with zero or negative weights contribute to the moments, but
+    they are not added to the quantile sketches.
+
+    Moments ("mean", "rms", "stdev", "stderr") match the ones calculated by
+    `calc_stat` up to the floating point round off. Quantiles (e.g. "median")
+    are approximate. Use `calc_binned_stats` if the exact statistics of
+    the in-memory arrays are required.
+    """
+
+    def __init__(self, bins_x, compression = DEF_COMPRESSION, workers = None):
+        self._stats   = CBinnedStats(bins_x, compression)
+        self._workers = workers or os.cpu_count() or 1
+
+    @property
+    def bins_x(self):
+        """Bin edges"""
+        return self._stats.edges
+
+    def fill(self, x, y, weights = None):
+        """Accumulate a chunk of values.
+
+        Parameters
+        ----------
+        x : ndarray, shape (N,)
+            Coordinates of data points that determine the bin indices.
+        y : ndarray, shape (N,)
+            Values for which the statistics are calculated.
+        weights : ndarray, shape (N,) or None, optional
+            Weight of each data point. If None, unit weights are used.
+        """
+        (x, y), weights = _as_chunk([ x, y ], weights)
+        self._stats.fill(x, y, weights, self._workers)
+
+    def merge(self, other):
+        """Merge values accumulated by `other` into this accumulator"""
+        # pylint: disable=protected-access
+        self._stats.merge(other._stats)
+        return self
+
+    def __iadd__(self, other):
+        return self.merge(other)
+
+    def _calc_moment_stats(self):
+        m = self._stats.moments()
+
+        with np.errstate(divide = 'ignore', invalid = 'ignore'):
+            empty = (m['count'] == 0)
+
+            x1var  = m['m2'] / m['sum_w']
+            x2var  = m['mean_y4'] - m['mean_y2']**2
+            w2norm = m['sum_w2'] / m['sum_w']**2
+
+            # sum w^2 (y - mean)^2 / (sum w)^2, c.f. `calc_stderr`
+            stderr2 = (
+                m['m2_u'] + m['sum_w2'] * (m['mean_u'] - m['mean'])**2
+            ) / m['sum_w']**2
+
+            stderr2 = np.where(
+                m['count'] > 1, stderr2 * m['count'] / (m['count'] - 1),
+                stderr2
+            )
+
+            result = {
+                'mean'   : m['mean'],
+                'rms'    : np.sqrt(m['mean_y2']),
+                'stdev'  : np.sqrt(np.maximum(x1var, 0)),
+                'stderr' : np.sqrt(stderr2),
+                'm1'     : m['mean'],
+                'm2'     : m['mean_y2'],
+                'm4'     : m['mean_y4'],
+                'x1var'  : x1var,
+                'x2var'  : x2var,
+                'm1var'  : w2norm * x1var,
+                'm2var'  : w2norm * x2var,
+                'count'  : m['count'],
+                'sum_w'  : m['sum_w'],
+            }
+
+        for k in result:
+            if k not in [ 'count', 'sum_w' ]:
+                result[k] = np.where(empty, np.nan, result[k])
+
+        result['std'] = result['stdev']
+
+        return result
+
+    def _get_cells(self, stat):
+        if stat == 'median':
+            return self._stats.quantile(0.5)
+
+        stats = self._calc_moment_stats()
+
+        if stat not in stats:
+            raise ValueError("Unknown stat: %s" % stat)
+
+        return stats[stat]
+
+    def quantile(self, q):
+        """Return estimates of the quantile `q` in each bin"""
+        return self._stats.quantile(q)[:-1]
+
+    def get_stat(self, stat):
+        """Return values of statistics `stat` in each bin.
+
+        Parameters
+        ----------
+        stat : str
+            One of 'mean', 'rms', 'stdev' (or 'std'), 'stderr', 'median',
+            'count', 'sum_w' or the moments returned by `calc_all_stats`.
+            'sum_w' gives the weighted histogram of `x`.
+
+        Returns
+        -------
+        ndarray, shape (len(bins_x) - 1,)
+            Value of statistics `stat` in each bin. NaN for empty bins.
+        """
+        return self._get_cells(stat)[:-1]
+
+    def get_total_stat(self, stat):
+        """Return value of statistics `stat` over all accumulated values"""
+        return self._get_cells(stat)[-1]
+
+    def get_all_stats(self):
+        """Return statistics of all accumulated values.
+
+        Returns
+        -------
+        dict
+            Dictionary of statistics with the same keys as returned by
+            `calc_all_stats`. Note that, like in `calc_all_stats`, "stderr"
+            here is the biased standard error.
+        """
+        stats  = self._calc_moment_stats()
+        result = { k : v[-1] for (k, v) in stats.items() }
+
+        result['stderr'] = np.sqrt(result['m1var'])
+        result['median'] = self._stats.quantile(0.5)[-1]
+
+        for k in [ 'count', 'sum_w', 'std' ]:
+            del result[k]
+
+        return result
+
+    def serialize(self):
+        """Serialize accumulated values into bytes"""
+        return self._stats.serialize()
+
+    @staticmethod
+    def deserialize(state, workers = None):
+        """Restore `BinnedStats` from bytes created by `serialize`"""
+        result = BinnedStats.__new__(BinnedStats)
+        result.__setstate__({ 'state' : state, 'workers' : workers })
+
+        return result
+
+    def __getstate__(self):
+        return { 'state' : self.serialize(), 'workers' : self._workers }
+
+    def __setstate__(self, state):
+        self._stats   = CBinnedStats(state = state['state'])
+        self._workers = state['workers'] or os.cpu_count() or 1
+
+def _as_chunk(arrays, weights):
+    """Convert chunk `arrays` and `weights` to contiguous float64 arrays"""
+    arrays = [
+        np.ascontiguousarray(x, dtype = np.float64).ravel() for x in arrays
+    ]
+
+    if weights is not None:
+        weights = np.ascontiguousarray(weights, dtype = np.float64).ravel()
+        arrays_and_weights = arrays + [ weights ]
+    else:
+        arrays_and_weights = arrays
+
+    if any(len(x) != len(arrays[0]) for x in arrays_and_weights):
+        raise ValueError("Lengths of x, y and weights differ")
+
+    return (arrays, weights)
+
+class BinnedStatsSet:
+    """A collection of named `BinnedStats` accumulators.
+
+    `BinnedStatsSet` is convenient to accumulate statistics for multiple
+    binnings and energy labels in a single pass over the data, and to save
+    and merge them as a whole.
+
+    Parameters
+    ----------
+    bins : dict
+        Dictionary where keys are names of the accumulators and values are
+        their bin edges.
+    compression : float, optional
+        Compression of the quantile sketches. Default: 100.
+    workers : int or None, optional
+        Number of threads used to fill large chunks. Default: None.
+
+    Examples
+    --------
+    >>> stats = BinnedStatsSet({ 'total' : bins, 'primary' : bins })
+    >>> for (true, pred, weights) in chunks:
+    ...     stats.fill({
+    ...         k : (true[k], (pred[k] - true[k]) / true[k]) for k in stats
+    ...     }, weights)
+    >>> stats.save('stats.lbs')
+    """
+
+    def __init__(self, bins, compression = DEF_COMPRESSION, workers = None):
+        self._workers = workers or os.cpu_count() or 1
+        self._stats   = {
+            k : BinnedStats(v, compression, workers) for (k, v) in bins.items()
+        }
+
+    def __getitem__(self, key):
+        return self._stats[key]
+
+    def __iter__(self):
+        return iter(self._stats)
+
+    def __len__(self):
+        return len(self._stats)
+
+    def items(self):
+        """Return pairs of (name, `BinnedStats`)"""
+        return self._stats.items()
+
+    def fill(self, values, weights = None):
+        """Accumulate a chunk of values.
+
+        All accumulators are filled in a single pass over the rows of the
+        chunk.
+
+        Parameters
+        ----------
+        values : dict
+            Dictionary where keys are names of the accumulators and values
+            are pairs (x, y) of arrays to be accumulated. All arrays should
+            have the same length.
+        weights : ndarray or None, optional
+            Weights of the data points, shared by all accumulators.
+        """
+        if not values:
+            return
+
+        keys = list(values.keys())
+        arrays, weights = _as_chunk(
+            [ a for k in keys for a in values[k] ], weights
+        )
+
+        # pylint: disable=protected-access
+        c_fill_many(
+            [ self._stats[k]._stats for k in keys ],
+            arrays[0::2], arrays[1::2], weights, self._workers
+        )
+
+    def merge(self, other):
+        """Merge values accumulated by `other` into this collection"""
+        if set(self._stats) != set(other):
+            raise ValueError("Cannot merge sets of different accumulators")
+
+        for (k, v) in self._stats.items():
+            v.merge(other[k])
+
+        return self
+
+    def __iadd__(self, other):
+        return self.merge(other)
+
+    def save(self, path):
+        """Save accumulated values into a file `path`"""
+        with open(path, 'wb') as f:
+            f.write(STATS_MAGIC)
+            f.write(len(self._stats).to_bytes(8, 'little'))
+
+            for (k, v) in self._stats.items():
+                name  = k.encode('utf-8')
+                state = v.serialize()
+
+                f.write(len(name).to_bytes(8, 'little'))
+                f.write(name)
+                f.write(len(state).to_bytes(8, 'little'))
+                f.write(state)
+
+    @staticmethod
+    def load(path, workers = None):
+        """Load `BinnedStatsSet` saved by `save`"""
+        result = BinnedStatsSet({}, workers = workers)
+
+        with open(path, 'rb') as f:
+            if f.read(len(STATS_MAGIC)) != STATS_MAGIC:
+                raise RuntimeError("Not a binned stats file: %s" % path)
+
+            for _ in range(int.from_bytes(f.read(8), 'little')):
+                name  = f.read(int.from_bytes(f.read(8), 'little'))
+                state = f.read(int.from_bytes(f.read(8), 'little'))
+
+                # pylint: disable=protected-access
+                result._stats[name.decode('utf-8')] = BinnedStats.deserialize(
+                    state, workers
+                )
+
+        return result
+
+def merge_binned_stats(paths, workers = None):
+    """Load `BinnedStatsSet` files `paths` and merge them together"""
+    result = None
+
+    for path in paths:
+        stats = BinnedStatsSet.load(path, workers)
+
+        if result is None:
+            result = stats
+        else:
+            result.merge(stats)
+
+    return result
 
 def calc_binned_stats(x, y, weights, bins_x, stat = 'mean'):
     """Calculate binned statistics for the data.
@@ -27,6 +386,17 @@ def calc_binned_stats(x, y, weights, bins_x, stat = 'mean'):
     -------
     ndarray, shape (len(bins_x) - 1,)
         Value of statistics `stat` for each bin defined by `bins_x`.
+
+    Notes
+    -----
+    This function calculates exact statistics of the in-memory arrays.
+    For the samples that do not fit in memory use `BinnedStats`, which
+    calculates statistics in a single streaming pass, but only approximates
+    the quantiles.
+
+    See Also
+    --------
+    BinnedStats
     """
 
     bin_idx = np.digitize(x, bins = bins_x)
@@ -42,4 +412,3 @@ def calc_binned_stats(x, y, weights, bins_x, stat = 'mean'):
         results.append(value)
 
     return np.array(results)
-
@@ -0,0 +1,213 @@
+# distutils: language = c++
+#cython: infer_types=True
+#cython: profile=False
+#cython: linetrace=False
+#cython: nonecheck=False
+#cython: initializedcheck=False
+
+cimport cython
+
+import  numpy as np
+cimport numpy as cnp
+
+from libc.stdint   cimport uint64_t
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+
+cdef extern from "BinnedStats.h" namespace "lstm_ee" nogil:
+    cdef cppclass Moments:
+        uint64_t count
+        double   sumW
+        double   sumW2
+
+        double mean()
+        double m2()
+        double meanY2()
+        double meanY4()
+        double meanU()
+        double m2U()
+
+    cdef cppclass BinnedStats:
+        BinnedStats(const vector[double] &edges, double compression) except +
+        BinnedStats(const string &data) except +
+
+        size_t nCells()
+        const vector[double]& edges()
+        double compression()
+
+        const Moments& moments(size_t cell) except +
+        double quantile(size_t cell, double q) except +
+
+        void fill(
+            size_t        n,
+            const double *x,
+            const double *y,
+            const double *w,
+            unsigned      nThreads
+        ) except +
+
+        void merge(const BinnedStats &other) except +
+
+        @staticmethod
+        void fillMany(
+            const vector[BinnedStats *] &stats,
+            size_t                       n,
+            const vector[const double *] &x,
+            const vector[const double *] &y,
+            const double                *w,
+            unsigned                     nThreads
+        ) except +
+
+        string serialize() except +
+
+MOMENT_FIELDS = [
+    'count', 'sum_w', 'sum_w2', 'mean', 'm2', 'mean_y2', 'mean_y4',
+    'mean_u', 'm2_u'
+]
+
+cdef class CBinnedStats:
+    """Thin wrapper around the native `lstm_ee::BinnedStats`.
+
+    Parameters
+    ----------
+    edges : list of float or None
+        Bin edges. If None, the accumulator is restored from `state`.
+    compression : float
+        Compression of the quantile sketches.
+    state : bytes or None
+        Serialized accumulator, as returned by `serialize`.
+    """
+
+    cdef BinnedStats *_stats
+
+    def __cinit__(self, edges = None, double compression = 100, state = None):
+        cdef vector[double] c_edges
+        cdef string         c_state
+
+        if state is None:
+            c_edges     = [ float(x) for x in edges ]
+            self._stats = new BinnedStats(c_edges, compression)
+        else:
+            c_state     = state
+            self._stats = new BinnedStats(c_state)
+
+    def __dealloc__(self):
+        del self._stats
+
+    @property
+    def edges(self):
+        return np.array(self._stats.edges())
+
+    @property
+    def compression(self):
+        return self._stats.compression()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def fill(
+        self,
+        const double[::1] x,
+        const double[::1] y,
+        const double[::1] w,
+        unsigned          n_threads,
+    ):
+        """Accumulate values. C.f. `BinnedStats.fill`"""
+        cdef size_t n = x.shape[0]
+        cdef const double *w_ptr = NULL
+
+        if n == 0:
+            return
+
+        if w is not None:
+            w_ptr = &w[0]
+
+        with nogil:
+            self._stats.fill(n, &x[0], &y[0], w_ptr, n_threads)
+
+    def merge(self, CBinnedStats other):
+        """Merge accumulated values of `other` into this accumulator"""
+        self._stats.merge(other._stats[0])
+
+    def moments(self):
+        """Return dict of moments of each cell (bins followed by total)"""
+        cdef size_t n_cells = self._stats.nCells()
+        cdef size_t cell
+
+        result = {
+            k : np.zeros(n_cells, dtype = np.float64) for k in MOMENT_FIELDS
+        }
+
+        for cell in range(n_cells):
+            m = self._stats.moments(cell)
+
+            result['count'][cell]   = m.count
+            result['sum_w'][cell]   = m.sumW
+            result['sum_w2'][cell]  = m.sumW2
+
+            if m.count == 0:
+                continue
+
+            result['mean'][cell]    = m.mean()
+            result['m2'][cell]      = m.m2()
+            result['mean_y2'][cell] = m.meanY2()
+            result['mean_y4'][cell] = m.meanY4()
+            result['mean_u'][cell]  = m.meanU()
+            result['m2_u'][cell]    = m.m2U()
+
+        return result
+
+    def quantile(self, double q):
+        """Return quantile `q` estimates of each cell (bins followed by total)"""
+        cdef size_t n_cells = self._stats.nCells()
+        cdef size_t cell
+
+        cdef cnp.ndarray[cnp.float64_t, ndim=1] result = np.empty(
+            n_cells, dtype = np.float64
+        )
+
+        for cell in range(n_cells):
+            result[cell] = self._stats.quantile(cell, q)
+
+        return result
+
+    def serialize(self):
+        """Serialize accumulator into bytes"""
+        return self._stats.serialize()
+
+def c_fill_many(list stats, list x, list y, w, unsigned n_threads):
+    """Fill `stats[i]` by (`x[i]`, `y[i]`, `w`) in a single pass over rows.
+
+    All arrays should be contiguous float64 arrays of the same length.
+    """
+    cdef vector[BinnedStats *]   c_stats
+    cdef vector[const double *] c_x
+    cdef vector[const double *] c_y
+    cdef const double[::1]      view
+    cdef const double          *w_ptr = NULL
+    cdef size_t                 n     = 0
+    cdef CBinnedStats           s
+
+    if not stats:
+        return
+
+    n = len(x[0])
+
+    if n == 0:
+        return
+
+    for i in range(len(stats)):
+        s = stats[i]
+        c_stats.push_back(s._stats)
+
+        view = x[i]
+        c_x.push_back(&view[0])
+
+        view = y[i]
+        c_y.push_back(&view[0])
+
+    if w is not None:
+        view  = w
+        w_ptr = &view[0]
+
+    with nogil:
+        BinnedStats.fillMany(c_stats, n, c_x, c_y, w_ptr, n_threads)
@@ -3,16 +3,35 @@ Function to calculate basic evaluation metrics for the `lstm_ee` networks.
 """
 
 import logging
+import os
+
+import numpy  as np
 import pandas as pd
 
+from cafplot.rhist import RHist1D
+
 from lstm_ee.eval.predict import (
-    predict_energies,get_base_energies,get_true_energies
+    predict_energies, predict_energies_batch, get_base_energies,
+    get_true_energies
 )
-from lstm_ee.eval.fom   import calc_fom_stats, calc_fom_hist
-from lstm_ee.eval.gauss import fit_gaussian
+from lstm_ee.eval.binned_stats import BinnedStatsSet, merge_binned_stats
+from lstm_ee.eval.fom          import calc_fom_stats, calc_fom_hist
+from lstm_ee.eval.gauss        import fit_gaussian
 
 LOGGER = logging.getLogger('lstm_ee.eval')
 
+FOM_STATS_FNAME      = 'fom_stats.lbs'
+FOM_STATS_BASE_FNAME = 'fom_stats_base.lbs'
+
+def _add_gaussian_fit(stats, rhist, margin, label):
+    """Fit gaussian to the `rhist` peak and add its parameters to `stats`"""
+    try:
+        x = (rhist.bins_x[1:] + rhist.bins_x[:-1]) / 2
+        stats.update(fit_gaussian(x, rhist.hist, margin))
+    except RuntimeError:
+        LOGGER.warning("Failed to fit gaussian for: %s", label)
+        stats.update({ 'a' : 0, 'mu' : 0, 'sigma' : 0 })
+
 def calc_fom_stats_hists(pred_dict, true_dict, weights, fom_specs, margin):
     """
     Calculate relative energy resolution stats and hists for each energy type.
@@ -78,12 +97,7 @@ def calc_fom_stats_hists(pred_dict, true_dict, weights, fom_specs, margin):
         )
         rhist_dict[k] = rhist
 
-        try:
-            x = (rhist.bins_x[1:] + rhist.bins_x[:-1]) / 2
-            stats_dict[k].update(fit_gaussian(x, rhist.hist, margin))
-        except RuntimeError:
-            LOGGER.warning("Failed to fit gaussian for: %s", k)
-            stats_dict[k].update({ 'a' : 0, 'mu' : 0, 'sigma' : 0 })
+        _add_gaussian_fit(stats_dict[k], rhist, margin, k)
 
     return stats_dict, rhist_dict
 
@@ -237,6 +251,242 @@ def evaluate(
         (stats_base_dict , rhist_base_dict),
     )
 
+def get_fom_bins(spec):
+    """Return bin edges of the relative energy resolution histogram `spec`"""
+    if np.ndim(spec.bins_x) == 0:
+        return np.linspace(spec.range_x[0], spec.range_x[1], spec.bins_x + 1)
+
+    return np.asarray(spec.bins_x, dtype = np.float64)
+
+def create_fom_accumulators(labels, fom_specs, workers = None):
+    """Create accumulators of the relative energy resolution stats and hists.
+
+    Parameters
+    ----------
+    labels : list of str
+        Energy labels to create accumulators for.
+    fom_specs : dict
+        Dictionary where keys are energy labels and values are the `PlotSpec`
+        objects that parametrize histograms of the relative energy resolution.
+    workers : int or None, optional
+        Number of threads used by the accumulators. Default: None.
+
+    Returns
+    -------
+    BinnedStatsSet
+        Set of accumulators. For each energy label LABEL it holds accumulator
+        "LABEL:hist", which bins are the histogram bins, and accumulator
+        "LABEL:stats" that accumulates statistics of the values inside the
+        histogram range.
+    """
+    bins = {}
+
+    for k in labels:
+        bins['%s:hist'  % k] = get_fom_bins(fom_specs[k])
+        bins['%s:stats' % k] = fom_specs[k].range_x
+
+    return BinnedStatsSet(bins, workers = workers)
+
+def fill_fom_accumulators(stats, pred_dict, true_dict, weights):
+    """Accumulate relative energy resolution of a chunk of predictions.
+
+    Parameters
+    ----------
+    stats : BinnedStatsSet
+        Accumulators created by `create_fom_accumulators`.
+    pred_dict : dict
+        Dictionary of the predicted energies of the chunk.
+    true_dict : dict
+        Dictionary of the true energies of the chunk.
+    weights : ndarray, shape (N,)
+        Weights of the chunk.
+    """
+    values = {}
+
+    for k in pred_dict.keys():
+        if '%s:hist' % k not in stats:
+            continue
+
+        fom = (pred_dict[k] - true_dict[k]) / true_dict[k]
+        lo, hi = stats['%s:stats' % k].bins_x[[0, -1]]
+
+        # Like `calc_fom_stats`, the stats are calculated only in (lo, hi)
+        values['%s:hist'  % k] = (fom, fom)
+        values['%s:stats' % k] = (
+            fom, np.where((fom > lo) & (fom < hi), fom, np.nan)
+        )
+
+    stats.fill(values, weights)
+
+def calc_fom_stats_hists_binned(stats, margin = 0.5):
+    """
+    Calculate relative energy resolution stats and hists from accumulators.
+
+    This is a streaming counterpart of `calc_fom_stats_hists`. Moments are
+    the same up to the floating point round off, but the "median" is only an
+    estimate of the quantile sketches.
+
+    Parameters
+    ----------
+    stats : BinnedStatsSet
+        Accumulators filled by `fill_fom_accumulators`.
+    margin : float
+        Fraction of the height of the peak of energy resolution histogram
+        (Reco - True) / True, that will be used to fit a gaussian curve.
+
+    Returns
+    -------
+    (stats_dict, rhist_dict) : (dict, dict)
+        C.f. `calc_fom_stats_hists`.
+    """
+    stats_dict = {}
+    rhist_dict = {}
+
+    labels = [ k[:-len(':stats')] for k in stats if k.endswith(':stats') ]
+
+    for k in labels:
+        hist = stats['%s:hist' % k]
+        bins = hist.bins_x
+
+        # Histogram bin centers with bin contents as weights
+        rhist = RHist1D.from_data(
+            (bins[1:] + bins[:-1]) / 2, bins, hist.get_stat('sum_w')
+        )
+
+        stats_dict[k] = stats['%s:stats' % k].get_all_stats()
+        rhist_dict[k] = rhist
+
+        _add_gaussian_fit(stats_dict[k], rhist, margin, k)
+
+    return stats_dict, rhist_dict
+
+def iter_energy_chunks(dgen, model, pred_map):
+    """Predict energies batch by batch.
+
+    Parameters
+    ----------
+    dgen : IDataGenerator
+        Data generator which will be fed to the `model` to predict energies.
+    model : `keras.Model`
+        Model that will be used to predict energies.
+    pred_map : dict or None
+        Dictionary that specifies mapping between energy label and a variable
+        name in `dgen.data_loader` that holds baseline reconstructed energy.
+
+    Yields
+    ------
+    (dict, dict, dict, ndarray)
+        Energies predicted by `model`, baseline energies, true energies and
+        weights of each batch of `dgen`.
+    """
+    start = 0
+
+    for index in range(len(dgen)):
+        inputs, _, weights = dgen[index]
+
+        rows   = np.arange(start, start + len(weights[0]))
+        start += len(rows)
+
+        yield (
+            predict_energies_batch(dgen, model, inputs),
+            get_base_energies(dgen, pred_map, rows),
+            get_true_energies(dgen, rows),
+            weights[0],
+        )
+
+def _labels(energy_dict):
+    return [ k for (k, v) in energy_dict.items() if v is not None ]
+
+def evaluate_streaming(
+    dgen, model, base_map, fom_specs, fit_margin, outdir, workers = None
+):
+    """Streaming version of `evaluate`.
+
+    Unlike `evaluate`, this function does not keep energies of the whole
+    evaluation sample in memory. The relative energy resolution of each
+    batch is accumulated into `BinnedStatsSet` accumulators in a single pass,
+    so the "median" of the resulting stats is approximate. The accumulators
+    are saved into `outdir` (c.f. `FOM_STATS_FNAME` and
+    `FOM_STATS_BASE_FNAME`), so that results of the evaluations over
+    different parts of a sample can be merged by `merge_fom_stats`.
+
+    Parameters
+    ----------
+    dgen : IDataGenerator
+        DataGenerator on which network will be evaluated.
+    model : keras.Model
+        Network to be evaluated.
+    base_map : dict
+        C.f. `evaluate`.
+    fom_specs : dict
+        C.f. `evaluate`.
+    fit_margin : float
+        C.f. `evaluate`.
+    outdir : str
+        Directory where evaluation statistics will be saved.
+    workers : int or None, optional
+        Number of threads used by the accumulators. Default: None.
+
+    Returns
+    -------
+    C.f. `evaluate`.
+    """
+    # pylint: disable=too-many-arguments
+    stats_model = None
+    stats_base  = None
+
+    for (pred, base, true, weights) in iter_energy_chunks(
+        dgen, model, base_map
+    ):
+        if stats_model is None:
+            stats_model = create_fom_accumulators(
+                _labels(pred), fom_specs, workers
+            )
+            stats_base  = create_fom_accumulators(
+                _labels(base), fom_specs, workers
+            )
+
+        fill_fom_accumulators(stats_model, pred, true, weights)
+        fill_fom_accumulators(stats_base,  base, true, weights)
+
+    stats_model.save(os.path.join(outdir, FOM_STATS_FNAME))
+    stats_base .save(os.path.join(outdir, FOM_STATS_BASE_FNAME))
+
+    stats_model_dict, rhist_model_dict = calc_fom_stats_hists_binned(
+        stats_model, fit_margin
+    )
+    save_model_stats(stats_model_dict, outdir)
+
+    stats_base_dict, rhist_base_dict = calc_fom_stats_hists_binned(
+        stats_base, fit_margin
+    )
+    save_base_stats(stats_base_dict, outdir)
+
+    return (
+        (stats_model_dict, rhist_model_dict),
+        (stats_base_dict , rhist_base_dict),
+    )
+
+def merge_fom_stats(paths, margin = 0.5):
+    """Merge accumulators saved by `evaluate_streaming` and calculate stats.
+
+    Parameters
+    ----------
+    paths : list of str
+        Paths to the accumulator files (e.g. `FOM_STATS_FNAME`) saved by the
+        evaluations over different parts of a sample.
+    margin : float
+        C.f. `calc_fom_stats_hists_binned`.
+
+    Returns
+    -------
+    dict
+        Dictionary where keys are the energy labels and values are the
+        dictionaries of the relative energy resolution stats of the merged
+        sample.
+    """
+    return calc_fom_stats_hists_binned(merge_binned_stats(paths), margin)[0]
+
 def save_dict_as_csv(stats, fname):
     """Save dict as `pandas.DataFrame`"""
     return pd.DataFrame.from_dict(stats, orient = 'index') \
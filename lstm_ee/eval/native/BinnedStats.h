@@ -0,0 +1,683 @@
+#pragma once
+
+/*
+ * BinnedStats -- a streaming accumulator of weighted binned statistics.
+ *
+ * The accumulator is fed with chunks of (x, y, weight) values. Each value is
+ * assigned to a bin by its `x` coordinate, and the statistics of `y` are
+ * accumulated per bin in a single pass:
+ *   - weighted moments: mean and variance from shifted weighted sums,
+ *     mean of y^2 and y^4, and the moments required by the standard error
+ *   - approximate quantiles with a merging t-digest sketch
+ *
+ * In addition to the bins, an extra "total" cell accumulates statistics of
+ * all values, regardless of their `x` coordinate.
+ *
+ * Bins follow the `np.digitize` convention: value belongs to the bin `i` if
+ * edges[i] <= x < edges[i+1]. Values outside of the bins only contribute to
+ * the total. Values with non finite x, y or weight are skipped. Values with
+ * zero or negative weights contribute to the moments, but not to the
+ * quantile sketches, that require positive weights.
+ *
+ * All accumulators are mergeable, so partial results computed by different
+ * threads, or over different files, can be combined. Results can be
+ * serialized into a byte string and restored.
+ *
+ * Usage:
+ *
+ *     lstm_ee::BinnedStats stats(edges);
+ *
+ *     // Chunk of n values split among `nThreads` threads
+ *     stats.fill(n, x, y, w, nThreads);
+ *
+ *     // Same chunk of rows into several accumulators in a single pass
+ *     lstm_ee::BinnedStats::fillMany({ &a, &b }, n, { xa, xb }, { ya, yb }, w);
+ *
+ *     stats.merge(otherStats);
+ *
+ *     const lstm_ee::Moments &m = stats.moments(bin);
+ *     double median = stats.quantile(bin, 0.5);
+ *
+ *     std::string state = stats.serialize();
+ *     lstm_ee::BinnedStats restored(state);
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lstm_ee
+{
+
+/*
+ * Weighted moments of a stream of values.
+ *
+ * Like `calc_stat`, the moments accept weights of any sign, so the running
+ * sum of weights may pass through zero. Welford updates divide by that sum,
+ * therefore the moments are kept as weighted sums of deviations from a shift
+ * (the first accumulated value) instead, which keeps them well defined and
+ * precise as long as the values are not far from the shift.
+ *
+ * `m2()` is the sum of weighted squared deviations from the mean, so that
+ * the biased variance is m2() / sumW. `meanU()` and `m2U()` are the same
+ * quantities computed with squared weights (u = w^2). They are needed for
+ * the standard error: sum w^2 (y - mean)^2 = m2U + sumW2 * (meanU - mean)^2.
+ */
+struct Moments
+{
+    uint64_t count  = 0;
+    double   shift  = 0;
+    double   sumW   = 0;
+    double   sumW2  = 0;
+    double   sumWD  = 0;
+    double   sumWD2 = 0;
+    double   sumUD  = 0;
+    double   sumUD2 = 0;
+    double   sumWY2 = 0;
+    double   sumWY4 = 0;
+
+    void add(double y, double w)
+    {
+        if (count == 0) {
+            shift = y;
+        }
+
+        const double u  = w * w;
+        const double d  = y - shift;
+        const double y2 = y * y;
+
+        count  += 1;
+        sumW   += w;
+        sumW2  += u;
+        sumWD  += w * d;
+        sumWD2 += w * d * d;
+        sumUD  += u * d;
+        sumUD2 += u * d * d;
+        sumWY2 += w * y2;
+        sumWY4 += w * y2 * y2;
+    }
+
+    void merge(const Moments &other)
+    {
+        if (other.count == 0) {
+            return;
+        }
+
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+
+        /* Deviations of `other` from this shift are (d + s) */
+        const double s = other.shift - shift;
+
+        sumWD2 += other.sumWD2 + 2 * s * other.sumWD + s * s * other.sumW;
+        sumUD2 += other.sumUD2 + 2 * s * other.sumUD + s * s * other.sumW2;
+        sumWD  += other.sumWD  + s * other.sumW;
+        sumUD  += other.sumUD  + s * other.sumW2;
+
+        count  += other.count;
+        sumW   += other.sumW;
+        sumW2  += other.sumW2;
+        sumWY2 += other.sumWY2;
+        sumWY4 += other.sumWY4;
+    }
+
+    double mean()   const { return shift + sumWD / sumW; }
+    double m2()     const { return sumWD2 - sumWD * sumWD / sumW; }
+    double meanY2() const { return sumWY2 / sumW; }
+    double meanY4() const { return sumWY4 / sumW; }
+    double meanU()  const { return shift + sumUD / sumW2; }
+    double m2U()    const { return sumUD2 - sumUD * sumUD / sumW2; }
+};
+
+/*
+ * Merging t-digest (T. Dunning, O. Ertl, "Computing Extremely Accurate
+ * Quantiles Using t-Digests") with the k1 scale function.
+ *
+ * Values are buffered and periodically merged into a sorted list of
+ * centroids. The number of centroids is bounded by ~`compression`.
+ * The quantile estimates are most accurate near the tails.
+ */
+class TDigest
+{
+public:
+    struct Centroid
+    {
+        double mean;
+        double weight;
+
+        bool operator<(const Centroid &other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    explicit TDigest(double compression = 100)
+        : compression_(compression),
+          min_(std::numeric_limits<double>::infinity()),
+          max_(-std::numeric_limits<double>::infinity())
+    { }
+
+    void add(double y, double w)
+    {
+        buffer_.push_back({ y, w });
+
+        min_ = std::min(min_, y);
+        max_ = std::max(max_, y);
+
+        if (buffer_.size() >= bufferCapacity()) {
+            compress();
+        }
+    }
+
+    void merge(const TDigest &other)
+    {
+        if (other.empty()) {
+            return;
+        }
+
+        buffer_.insert(
+            buffer_.end(), other.centroids_.begin(), other.centroids_.end()
+        );
+        buffer_.insert(
+            buffer_.end(), other.buffer_.begin(), other.buffer_.end()
+        );
+
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+
+        compress();
+    }
+
+    bool empty() const
+    {
+        return centroids_.empty() && buffer_.empty();
+    }
+
+    /* Merge buffered values into the centroids */
+    void compress()
+    {
+        if (buffer_.empty()) {
+            return;
+        }
+
+        buffer_.insert(buffer_.end(), centroids_.begin(), centroids_.end());
+        std::stable_sort(buffer_.begin(), buffer_.end());
+
+        double total = 0;
+        for (const auto &c : buffer_) {
+            total += c.weight;
+        }
+
+        centroids_.clear();
+
+        Centroid current = buffer_[0];
+        double   wLeft   = 0;
+        double   kLeft   = scale(0);
+
+        for (size_t i = 1; i < buffer_.size(); i++)
+        {
+            const Centroid &next = buffer_[i];
+            const double    q    = (
+                (wLeft + current.weight + next.weight) / total
+            );
+
+            if (scale(q) - kLeft <= 1) {
+                current.weight += next.weight;
+                current.mean   += (
+                    (next.mean - current.mean) * next.weight / current.weight
+                );
+            }
+            else {
+                wLeft += current.weight;
+                kLeft  = scale(wLeft / total);
+
+                centroids_.push_back(current);
+                current = next;
+            }
+        }
+
+        centroids_.push_back(current);
+        buffer_.clear();
+    }
+
+    /* Estimate quantile `q` (0 <= q <= 1). NaN if the digest is empty */
+    double quantile(double q)
+    {
+        compress();
+
+        if (centroids_.empty()) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        if (centroids_.size() == 1) {
+            return centroids_[0].mean;
+        }
+
+        double total = 0;
+        for (const auto &c : centroids_) {
+            total += c.weight;
+        }
+
+        const double target = std::min(std::max(q, 0.0), 1.0) * total;
+
+        /* Centroid `i` is centered at cumulative weight
+         * (sum of previous weights) + weight / 2 */
+        double center = centroids_[0].weight / 2;
+
+        if (target < center) {
+            return interpolate(
+                min_, centroids_[0].mean, target / center
+            );
+        }
+
+        for (size_t i = 1; i < centroids_.size(); i++)
+        {
+            const double nextCenter = center + (
+                centroids_[i - 1].weight + centroids_[i].weight
+            ) / 2;
+
+            if (target < nextCenter) {
+                return interpolate(
+                    centroids_[i - 1].mean, centroids_[i].mean,
+                    (target - center) / (nextCenter - center)
+                );
+            }
+
+            center = nextCenter;
+        }
+
+        const double rest = total - center;
+
+        if (rest <= 0) {
+            return max_;
+        }
+
+        return interpolate(
+            centroids_.back().mean, max_, (target - center) / rest
+        );
+    }
+
+    double compression() const { return compression_; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+
+    const std::vector<Centroid>& centroids() const { return centroids_; }
+
+    /* Restore digest from the (compressed) centroids and the value range */
+    void restore(std::vector<Centroid> centroids, double min, double max)
+    {
+        centroids_ = std::move(centroids);
+        buffer_.clear();
+
+        min_ = min;
+        max_ = max;
+    }
+
+private:
+    size_t bufferCapacity() const
+    {
+        return std::max<size_t>(64, (size_t)(5 * compression_));
+    }
+
+    double scale(double q) const
+    {
+        const double pi = 3.14159265358979323846;
+        return compression_ / (2 * pi) * std::asin(2 * q - 1);
+    }
+
+    static double interpolate(double a, double b, double t)
+    {
+        return a + (b - a) * std::min(std::max(t, 0.0), 1.0);
+    }
+
+    double                compression_;
+    double                min_;
+    double                max_;
+    std::vector<Centroid> centroids_;
+    std::vector<Centroid> buffer_;
+};
+
+/*
+ * Moments and quantile sketches of `y` in bins of `x`.
+ *
+ * Cells [0, nBins()) hold the per bin statistics, cell nBins() holds the
+ * statistics of all values.
+ */
+class BinnedStats
+{
+public:
+    explicit BinnedStats(
+        const std::vector<double> &edges, double compression = 100
+    )
+        : edges_(edges),
+          compression_(compression)
+    {
+        if (edges_.size() < 2) {
+            throw std::invalid_argument("BinnedStats requires >= 2 bin edges");
+        }
+
+        if (! std::is_sorted(edges_.begin(), edges_.end())) {
+            throw std::invalid_argument("BinnedStats edges are not sorted");
+        }
+
+        moments_.resize(nCells());
+        digests_.resize(nCells(), TDigest(compression_));
+    }
+
+    /* Restore accumulator serialized by `serialize` */
+    explicit BinnedStats(const std::string &data)
+        : BinnedStats(deserialize(data))
+    { }
+
+    size_t nBins()  const { return edges_.size() - 1; }
+    size_t nCells() const { return edges_.size(); }
+
+    const std::vector<double>& edges() const { return edges_; }
+    double compression() const { return compression_; }
+
+    const Moments& moments(size_t cell) const { return moments_.at(cell); }
+    double quantile(size_t cell, double q) { return digests_.at(cell).quantile(q); }
+
+    /* Return bin of `x` or nBins() if `x` is outside of the bins */
+    size_t findBin(double x) const
+    {
+        auto it = std::upper_bound(edges_.begin(), edges_.end(), x);
+
+        if ((it == edges_.begin()) || (it == edges_.end())) {
+            return nBins();
+        }
+
+        return (size_t)(it - edges_.begin()) - 1;
+    }
+
+    void add(double x, double y, double w)
+    {
+        if (! (std::isfinite(x) && std::isfinite(y) && std::isfinite(w))) {
+            return;
+        }
+
+        const size_t bin = findBin(x);
+
+        if (bin < nBins()) {
+            moments_[bin].add(y, w);
+        }
+
+        moments_[nBins()].add(y, w);
+
+        if (w <= 0) {
+            return;
+        }
+
+        if (bin < nBins()) {
+            digests_[bin].add(y, w);
+        }
+
+        digests_[nBins()].add(y, w);
+    }
+
+    /* Accumulate chunk of `n` values. If `w` is NULL, unit weights are used.
+     * The chunk is split among `nThreads` threads, and the partial results
+     * are merged in the thread order, so the result is deterministic. */
+    void fill(
+        size_t n, const double *x, const double *y, const double *w,
+        unsigned nThreads = 1
+    )
+    {
+        std::vector<BinnedStats *> stats { this };
+        fillMany(stats, n, { x }, { y }, w, nThreads);
+    }
+
+    /* Accumulate chunk of `n` values into several accumulators at once.
+     * Accumulator stats[i] is filled by (x[i], y[i], w), so the rows of the
+     * chunk (and the shared weights) are traversed in a single pass.
+     * C.f. `fill` for the threading details. */
+    static void fillMany(
+        const std::vector<BinnedStats *> &stats, size_t n,
+        const std::vector<const double *> &x,
+        const std::vector<const double *> &y,
+        const double *w, unsigned nThreads = 1
+    )
+    {
+        const size_t minChunk = 16384;
+
+        if ((x.size() != stats.size()) || (y.size() != stats.size())) {
+            throw std::invalid_argument("BinnedStats: inconsistent inputs");
+        }
+
+        nThreads = (unsigned)std::max<size_t>(
+            1, std::min<size_t>(nThreads, n / minChunk)
+        );
+
+        if (nThreads == 1) {
+            fillRangeMany(stats, 0, n, x, y, w);
+            return;
+        }
+
+        std::vector<std::vector<BinnedStats>> partials(nThreads);
+
+        for (auto &partial : partials) {
+            for (const BinnedStats *s : stats) {
+                partial.emplace_back(s->edges_, s->compression_);
+            }
+        }
+
+        std::vector<std::thread> threads;
+
+        for (unsigned t = 0; t < nThreads; t++)
+        {
+            const size_t start = n * t / nThreads;
+            const size_t end   = n * (t + 1) / nThreads;
+
+            threads.emplace_back([&, t, start, end] () {
+                std::vector<BinnedStats *> ptrs;
+
+                for (auto &s : partials[t]) {
+                    ptrs.push_back(&s);
+                }
+
+                fillRangeMany(ptrs, start, end, x, y, w);
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        for (const auto &partial : partials) {
+            for (size_t i = 0; i < stats.size(); i++) {
+                stats[i]->merge(partial[i]);
+            }
+        }
+    }
+
+    void merge(const BinnedStats &other)
+    {
+        if (other.edges_ != edges_) {
+            throw std::invalid_argument("Cannot merge BinnedStats: bins differ");
+        }
+
+        for (size_t cell = 0; cell < nCells(); cell++) {
+            moments_[cell].merge(other.moments_[cell]);
+            digests_[cell].merge(other.digests_[cell]);
+        }
+    }
+
+    /*
+     * Serialize into a byte string. All values are little-endian:
+     *
+     *     char     magic[8]     = "LSTMEEBN"
+     *     uint32   version      = 2
+     *     uint32   reserved
+     *     double   compression
+     *     uint64   n_edges
+     *     double   edges[n_edges]
+     *     n_edges x {
+     *         uint64   count
+     *         double   shift, sumW, sumW2, sumWD, sumWD2, sumUD, sumUD2,
+     *                  sumWY2, sumWY4
+     *         double   min, max
+     *         uint64   n_centroids
+     *         n_centroids x { double mean, weight }
+     *     }
+     */
+    std::string serialize()
+    {
+        std::string result;
+
+        result.append(magic(), MAGIC_SIZE);
+        put<uint32_t>(result, (uint32_t)VERSION);
+        put<uint32_t>(result, 0);
+        put<double>  (result, compression_);
+        put<uint64_t>(result, edges_.size());
+
+        for (double edge : edges_) {
+            put<double>(result, edge);
+        }
+
+        for (size_t cell = 0; cell < nCells(); cell++)
+        {
+            const Moments &m = moments_[cell];
+            TDigest       &d = digests_[cell];
+
+            d.compress();
+
+            put<uint64_t>(result, m.count);
+            for (double v : {
+                m.shift, m.sumW, m.sumW2, m.sumWD, m.sumWD2, m.sumUD,
+                m.sumUD2, m.sumWY2, m.sumWY4, d.min(), d.max()
+            })
+            {
+                put<double>(result, v);
+            }
+
+            put<uint64_t>(result, d.centroids().size());
+            for (const auto &c : d.centroids()) {
+                put<double>(result, c.mean);
+                put<double>(result, c.weight);
+            }
+        }
+
+        return result;
+    }
+
+    static BinnedStats deserialize(const std::string &data)
+    {
+        size_t pos = 0;
+
+        if (
+               (data.size() < MAGIC_SIZE)
+            || (std::memcmp(data.data(), magic(), MAGIC_SIZE) != 0)
+        ) {
+            throw std::runtime_error("Not a serialized BinnedStats");
+        }
+
+        pos += MAGIC_SIZE;
+
+        if (get<uint32_t>(data, pos) != VERSION) {
+            throw std::runtime_error("Unsupported BinnedStats version");
+        }
+
+        get<uint32_t>(data, pos);
+
+        const double   compression = get<double>(data, pos);
+        const uint64_t nEdges      = get<uint64_t>(data, pos);
+
+        std::vector<double> edges;
+        for (uint64_t i = 0; i < nEdges; i++) {
+            edges.push_back(get<double>(data, pos));
+        }
+
+        BinnedStats result(edges, compression);
+
+        for (size_t cell = 0; cell < result.nCells(); cell++)
+        {
+            Moments &m = result.moments_[cell];
+
+            m.count  = get<uint64_t>(data, pos);
+            m.shift  = get<double>(data, pos);
+            m.sumW   = get<double>(data, pos);
+            m.sumW2  = get<double>(data, pos);
+            m.sumWD  = get<double>(data, pos);
+            m.sumWD2 = get<double>(data, pos);
+            m.sumUD  = get<double>(data, pos);
+            m.sumUD2 = get<double>(data, pos);
+            m.sumWY2 = get<double>(data, pos);
+            m.sumWY4 = get<double>(data, pos);
+
+            const double   min        = get<double>(data, pos);
+            const double   max        = get<double>(data, pos);
+            const uint64_t nCentroids = get<uint64_t>(data, pos);
+
+            std::vector<TDigest::Centroid> centroids;
+
+            for (uint64_t i = 0; i < nCentroids; i++) {
+                const double mean   = get<double>(data, pos);
+                const double weight = get<double>(data, pos);
+
+                centroids.push_back({ mean, weight });
+            }
+
+            result.digests_[cell].restore(std::move(centroids), min, max);
+        }
+
+        return result;
+    }
+
+private:
+    static const size_t   MAGIC_SIZE = 8;
+    static const uint32_t VERSION    = 2;
+
+    static const char* magic() { return "LSTMEEBN"; }
+
+    static void fillRangeMany(
+        const std::vector<BinnedStats *> &stats, size_t start, size_t end,
+        const std::vector<const double *> &x,
+        const std::vector<const double *> &y,
+        const double *w
+    )
+    {
+        for (size_t i = start; i < end; i++)
+        {
+            const double weight = (w == nullptr) ? 1.0 : w[i];
+
+            for (size_t j = 0; j < stats.size(); j++) {
+                stats[j]->add(x[j][i], y[j][i], weight);
+            }
+        }
+    }
+
+    template<typename T>
+    static void put(std::string &buf, T value)
+    {
+        buf.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    static T get(const std::string &buf, size_t &pos)
+    {
+        if (pos + sizeof(T) > buf.size()) {
+            throw std::runtime_error("Truncated BinnedStats data");
+        }
+
+        T value;
+        std::memcpy(&value, buf.data() + pos, sizeof(T));
+        pos += sizeof(T);
+
+        return value;
+    }
+
+    std::vector<double>  edges_;
+    double               compression_;
+    std::vector<Moments> moments_;
+    std::vector<TDigest> digests_;
+};
+
+}
@@ -52,6 +52,34 @@ def predict_energies(args, dgen, model):
     kwargs = get_keras_concurrency_kwargs(args)
     pred   = model.predict_generator(dgen, **kwargs)
 
+    return _unpack_predictions(dgen, pred)
+
+def predict_energies_batch(dgen, model, inputs):
+    """Calculate energies predicted by a `model` for a single batch.
+
+    Parameters
+    ----------
+    dgen : IDataGenerator
+        Data generator that has produced the batch.
+    model : `keras.Model`
+        Model that will be used to predict energies.
+    inputs : dict
+        Inputs of the batch, as returned by `dgen[index][0]`.
+
+    Returns
+    -------
+    dict
+        Dictionary of predicted energies. C.f. `predict_energies`.
+    """
+    pred = model.predict_on_batch(inputs)
+
+    if not isinstance(pred, list):
+        pred = [ pred ]
+
+    return _unpack_predictions(dgen, pred)
+
+def _unpack_predictions(dgen, pred):
+    """Convert list of model outputs `pred` into a dict of energies"""
     result = {}
     idx    = 0
 
@@ -74,13 +102,16 @@ def predict_energies(args, dgen, model):
 
     return result
 
-def get_true_energies(dgen):
+def get_true_energies(dgen, index = None):
     """Calculate true energies.
 
     Parameters
     ----------
     dgen : IDataGenerator
         Data generator which will be used to get true energies.
+    index : ndarray or None, optional
+        Indices of the rows of `dgen.data_loader` to get true energies for.
+        If None, true energies of all rows will be returned. Default: None.
 
     Returns
     -------
@@ -100,12 +131,14 @@ def get_true_energies(dgen):
     result = {}
 
     if dgen.var_target_total is not None:
-        total = dgen.data_loader.get(dgen.var_target_total).ravel()
+        total = dgen.data_loader.get(dgen.var_target_total, index).ravel()
     else:
         total = None
 
     if dgen.var_target_primary is not None:
-        primary = dgen.data_loader.get(dgen.var_target_primary).ravel()
+        primary = dgen.data_loader.get(
+            dgen.var_target_primary, index
+        ).ravel()
     else:
         primary = None
 
@@ -116,7 +149,7 @@ def get_true_energies(dgen):
 
     return result
 
-def get_base_energies(dgen, pred_map):
+def get_base_energies(dgen, pred_map, index = None):
     """Calculate baseline energies.
 
     Parameters
@@ -127,6 +160,9 @@ def get_base_energies(dgen, pred_map):
     pred_map : dict
         Dictionary that specifies mapping between energy label and a variable
         name in `dgen.data_loader` that holds baseline reconstructed energy.
+    index : ndarray or None, optional
+        Indices of the rows of `dgen.data_loader` to get baseline energies
+        for. If None, energies of all rows will be returned. Default: None.
 
     Returns
     -------
@@ -142,7 +178,8 @@ def get_base_energies(dgen, pred_map):
         }
 
     result = {
-        k : dgen.data_loader.get(v).ravel() for k,v in pred_map.items()
+        k : dgen.data_loader.get(v, index).ravel()
+            for k,v in pred_map.items()
     }
     _calc_secondary(result)
 
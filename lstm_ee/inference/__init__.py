@@ -0,0 +1,6 @@
+"""
+Native inference of the `lstm_ee` networks without `keras`.
+"""
+
+from .flat_model   import FlatModel, FlatLayer, InputSpec
+from .native_model import NativeModel
@@ -0,0 +1,316 @@
+"""
+Definition of a `FlatModel` -- a framework independent representation of
+`lstm_ee` networks that is evaluated by the native inference engine.
+"""
+
+import struct
+from collections import namedtuple
+
+import numpy as np
+
+FLAT_MAGIC   = b'LSTMEENN'
+FLAT_VERSION = 1
+
+INPUT_SLICE = 0
+INPUT_PNG3D = 1
+INPUT_PNG2D = 2
+
+INPUT_NAMES = {
+    'input_slice' : INPUT_SLICE,
+    'input_png3d' : INPUT_PNG3D,
+    'input_png2d' : INPUT_PNG2D,
+}
+
+LAYER_INPUT       = 0
+LAYER_MASKING     = 1
+LAYER_DENSE       = 2
+LAYER_SCALE       = 3
+LAYER_LSTM        = 4
+LAYER_CONCATENATE = 5
+LAYER_ADD         = 6
+LAYER_ACTIVATION  = 7
+
+ACTIVATIONS = {
+    'linear'       : 0,
+    'relu'         : 1,
+    'sigmoid'      : 2,
+    'hard_sigmoid' : 3,
+    'tanh'         : 4,
+    'elu'          : 5,
+    'softplus'     : 6,
+}
+
+FlatLayer = namedtuple(
+    'FlatLayer', [ 'type', 'name', 'inputs', 'params', 'tensors' ]
+)
+FlatLayer.__doc__ = """Layer of a `FlatModel`.
+
+Parameters
+----------
+type : int
+    Layer type (one of LAYER_*).
+name : str
+    Layer name.
+inputs : list of int
+    Indices of the input layers. Input layers must precede this layer.
+params : list of int
+    Integer layer parameters. The meaning depends on the layer type:
+      - LAYER_INPUT : [ input kind (one of INPUT_*) ]
+      - LAYER_DENSE, LAYER_ACTIVATION : [ activation ]
+      - LAYER_LSTM : [ units, activation, recurrent_activation,
+                       go_backwards, return_sequences, reverse_output ]
+      - others : []
+tensors : list of ndarray
+    Layer weights. The meaning depends on the layer type:
+      - LAYER_MASKING : [ mask_value ]
+      - LAYER_DENSE : [ kernel (N_IN, N_OUT), bias (N_OUT) ]
+      - LAYER_SCALE : [ scale (N), shift (N) ]
+      - LAYER_LSTM : [ kernel (N_IN, 4 * units),
+                       recurrent_kernel (units, 4 * units),
+                       bias (4 * units) ]
+      - others : []
+"""
+
+InputSpec = namedtuple('InputSpec', [ 'vars', 'sort_var_idx', 'ascending' ])
+InputSpec.__doc__ = """Preprocessing specification of a `FlatModel` input.
+
+Parameters
+----------
+vars : list of str
+    Names of input variables.
+sort_var_idx : int or None
+    Index of the variable in `vars` that prongs are sorted by.
+    If None, prongs are not sorted.
+ascending : bool
+    Whether prongs are sorted in the ascending order.
+"""
+
+HEADER_STRUCT = struct.Struct('<8sIfi')
+INPUT_STRUCT  = struct.Struct('<IiII')
+
+class FlatModel:
+    """A framework independent representation of `lstm_ee` networks.
+
+    `FlatModel` holds a list of layers in the topological order, together
+    with their weights and the configuration of the input preprocessing.
+    `FlatModel` is saved into a flat binary file, that is evaluated by the
+    native inference engine `lstm_ee/inference/native/LSTMEEModel.h`.
+
+    The file layout is (all values are little-endian):
+
+    ::
+
+        char     magic[8]     = "LSTMEENN"
+        uint32   version      = 1
+        float32  mask_value
+        int32    max_prongs   (-1 for no limit)
+        3 x {                 (slice, 3D prong, 2D prong inputs)
+            uint32   present
+            int32    sort_var_idx (-1 for no sorting)
+            uint32   ascending
+            uint32   n_vars
+            n_vars x string
+        }
+        int32    output_total   (layer index, -1 if absent)
+        int32    output_primary (layer index, -1 if absent)
+        uint32   n_layers
+        n_layers x {
+            uint32   type
+            string   name
+            uint32   n_inputs
+            int32    inputs[n_inputs]
+            uint32   n_params
+            int32    params[n_params]
+            uint32   n_tensors
+            n_tensors x {
+                uint32   ndim
+                uint32   shape[ndim]
+                float32  data[prod(shape)]  (C order)
+            }
+        }
+
+    where `string` is stored as uint32 length followed by the utf-8 bytes.
+
+    Parameters
+    ----------
+    layers : list of FlatLayer
+        Network layers in the topological order.
+    inputs : dict
+        Dictionary of the form { INPUT_* : InputSpec } of the network inputs.
+    outputs : dict
+        Dictionary of the form { 'target_total' : int,
+        'target_primary' : int } of the output layer indices.
+    max_prongs : int or None, optional
+        Limit on the number of prongs. Default: None.
+    mask_value : float, optional
+        Value that replaces NaN inputs. Default: 0.
+
+    See Also
+    --------
+    lstm_ee.keras.export.export_flat_model
+    """
+
+    def __init__(
+        self, layers, inputs, outputs, max_prongs = None, mask_value = 0.
+    ):
+        self.layers     = layers
+        self.inputs     = inputs
+        self.outputs    = outputs
+        self.max_prongs = max_prongs
+        self.mask_value = mask_value
+
+    def add_layer(self, layer_type, name, inputs, params = None, tensors = None):
+        """Append a new layer to the model. Return its index."""
+        self.layers.append(FlatLayer(
+            layer_type, name, list(inputs), list(params or []),
+            [ np.asarray(x, dtype = np.float32) for x in (tensors or []) ]
+        ))
+
+        return len(self.layers) - 1
+
+    def save(self, path):
+        """Save model into a flat binary file `path`"""
+        with open(path, 'wb') as f:
+            f.write(HEADER_STRUCT.pack(
+                FLAT_MAGIC, FLAT_VERSION, self.mask_value,
+                -1 if self.max_prongs is None else self.max_prongs
+            ))
+
+            for kind in [ INPUT_SLICE, INPUT_PNG3D, INPUT_PNG2D ]:
+                spec = self.inputs.get(kind, None)
+
+                if spec is None:
+                    f.write(INPUT_STRUCT.pack(0, -1, 0, 0))
+                    continue
+
+                sort_var_idx = spec.sort_var_idx
+                f.write(INPUT_STRUCT.pack(
+                    1, -1 if sort_var_idx is None else sort_var_idx,
+                    int(bool(spec.ascending)), len(spec.vars)
+                ))
+
+                for var in spec.vars:
+                    _write_string(f, var)
+
+            for output in [ 'target_total', 'target_primary' ]:
+                f.write(struct.pack('<i', self.outputs.get(output, -1)))
+
+            f.write(struct.pack('<I', len(self.layers)))
+
+            for layer in self.layers:
+                _write_layer(f, layer)
+
+    @staticmethod
+    def load(path):
+        """Load `FlatModel` from a flat binary file `path`"""
+        with open(path, 'rb') as f:
+            buf = f.read()
+
+        magic, version, mask_value, max_prongs \
+            = HEADER_STRUCT.unpack_from(buf, 0)
+        pos = HEADER_STRUCT.size
+
+        if magic != FLAT_MAGIC:
+            raise RuntimeError("Not a flat lstm_ee model")
+
+        if version != FLAT_VERSION:
+            raise RuntimeError("Unsupported flat model version: %d" % version)
+
+        inputs = {}
+
+        for kind in [ INPUT_SLICE, INPUT_PNG3D, INPUT_PNG2D ]:
+            present, sort_var_idx, ascending, n_vars \
+                = INPUT_STRUCT.unpack_from(buf, pos)
+            pos += INPUT_STRUCT.size
+
+            variables = []
+            for _ in range(n_vars):
+                var, pos = _read_string(buf, pos)
+                variables.append(var)
+
+            if present:
+                inputs[kind] = InputSpec(
+                    variables,
+                    None if sort_var_idx < 0 else sort_var_idx,
+                    bool(ascending)
+                )
+
+        outputs = {}
+        for output in [ 'target_total', 'target_primary' ]:
+            (idx,) = struct.unpack_from('<i', buf, pos)
+            pos += 4
+
+            if idx >= 0:
+                outputs[output] = idx
+
+        (n_layers,) = struct.unpack_from('<I', buf, pos)
+        pos += 4
+
+        layers = []
+        for _ in range(n_layers):
+            layer, pos = _read_layer(buf, pos)
+            layers.append(layer)
+
+        return FlatModel(
+            layers, inputs, outputs,
+            None if max_prongs < 0 else max_prongs, mask_value
+        )
+
+def _write_string(f, value):
+    data = value.encode('utf-8')
+    f.write(struct.pack('<I', len(data)))
+    f.write(data)
+
+def _read_string(buf, pos):
+    (size,) = struct.unpack_from('<I', buf, pos)
+    pos += 4
+
+    return (buf[pos:pos + size].decode('utf-8'), pos + size)
+
+def _read_array(buf, pos, fmt):
+    (size,) = struct.unpack_from('<I', buf, pos)
+    pos += 4
+
+    return (list(struct.unpack_from('<%d%s' % (size, fmt), buf, pos)),
+            pos + 4 * size)
+
+def _write_layer(f, layer):
+    f.write(struct.pack('<I', layer.type))
+    _write_string(f, layer.name)
+
+    f.write(struct.pack('<I%di' % len(layer.inputs), len(layer.inputs),
+                        *layer.inputs))
+    f.write(struct.pack('<I%di' % len(layer.params), len(layer.params),
+                        *layer.params))
+
+    f.write(struct.pack('<I', len(layer.tensors)))
+
+    for tensor in layer.tensors:
+        tensor = np.ascontiguousarray(tensor, dtype = '<f4')
+
+        f.write(struct.pack('<I%dI' % tensor.ndim, tensor.ndim, *tensor.shape))
+        f.write(tensor.tobytes())
+
+def _read_layer(buf, pos):
+    (layer_type,) = struct.unpack_from('<I', buf, pos)
+    pos += 4
+
+    name,   pos = _read_string(buf, pos)
+    inputs, pos = _read_array(buf, pos, 'i')
+    params, pos = _read_array(buf, pos, 'i')
+
+    (n_tensors,) = struct.unpack_from('<I', buf, pos)
+    pos += 4
+
+    tensors = []
+    for _ in range(n_tensors):
+        shape, pos = _read_array(buf, pos, 'I')
+        size       = int(np.prod(shape, dtype = np.int64))
+
+        tensors.append(
+            np.frombuffer(buf, dtype = '<f4', count = size, offset = pos)
+                .reshape(shape).astype(np.float32)
+        )
+        pos += 4 * size
+
+    return (FlatLayer(layer_type, name, inputs, params, tensors), pos)
@@ -0,0 +1,1087 @@
+#pragma once
+
+/*
+ * LSTMEEModel -- a dependency free inference engine for the `lstm_ee`
+ * networks.
+ *
+ * The engine evaluates networks exported by `scripts/tf/export_native.py`
+ * into a flat binary file (c.f. `lstm_ee.inference.FlatModel` for the
+ * description of the file layout). The file holds a list of layers in the
+ * topological order together with their weights, and the input
+ * preprocessing configuration:
+ *   - names of the slice, 3D prong and 2D prong input variables
+ *   - limit on the number of prongs
+ *   - prong sorting specifications
+ *   - value that replaces NaN inputs (mask value)
+ *
+ * The inputs are preprocessed exactly as during the training: prongs are
+ * truncated to `max_prongs`, then sorted, then NaNs are replaced by the mask
+ * value. Therefore, the engine expects raw (unsorted) prongs, as they come
+ * from the exporter variables.
+ *
+ * Supported layers:
+ *   - Input, Masking
+ *   - Dense (plain or TimeDistributed)
+ *   - Scale (BatchNormalization folded at export time)
+ *   - LSTM (forward, backward, parts of Bidirectional)
+ *   - Concatenate, Add, Activation
+ *
+ * Dropout layers are dropped at export time.
+ *
+ * Usage:
+ *
+ *     lstm_ee::Model model("model.bin");
+ *
+ *     // Single slice. Prongs are stored prong-major:
+ *     //   png3d[prong * model.varsPng3d().size() + var]
+ *     lstm_ee::Prediction pred = model.predict(slice, png3d, png2d);
+ *
+ *     // Batch of slices. Prongs of the slice `i` are located at rows
+ *     // [offsets[i], offsets[i+1]) of the prong-major arrays.
+ *     model.predict(
+ *         nSlices, slice, offsets3d, png3d, offsets2d, png2d,
+ *         total, primary, nThreads
+ *     );
+ *
+ * Dense and LSTM kernels are vectorized with AVX/FMA, SSE or NEON
+ * intrinsics, depending on the target architecture.
+ *
+ * The file format is little-endian, so is the host expected to be.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace lstm_ee
+{
+
+namespace kernels
+{
+
+/* y[i] += a * x[i] */
+inline void axpy(size_t n, float a, const float *x, float *y)
+{
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 va8 = _mm256_set1_ps(a);
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256 vx = _mm256_loadu_ps(x + i);
+        __m256       vy = _mm256_loadu_ps(y + i);
+#if defined(__FMA__)
+        vy = _mm256_fmadd_ps(va8, vx, vy);
+#else
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(va8, vx));
+#endif
+        _mm256_storeu_ps(y + i, vy);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128 va4 = _mm_set1_ps(a);
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128 vx = _mm_loadu_ps(x + i);
+        const __m128 vy = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(y + i, _mm_add_ps(vy, _mm_mul_ps(va4, vx)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t vx = vld1q_f32(x + i);
+        const float32x4_t vy = vld1q_f32(y + i);
+        vst1q_f32(y + i, vmlaq_n_f32(vy, vx, a));
+    }
+#endif
+
+    for (; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+/*
+ * y[nOut] = bias[nOut] + x[nIn] * W[nIn][nOut]
+ *
+ * W is stored row-major as in keras, so that the inner loop runs over the
+ * contiguous outputs.
+ */
+inline void affine(
+    const float *W, const float *bias, size_t nIn, size_t nOut,
+    const float *x, float *y
+)
+{
+    if (bias != nullptr) {
+        std::memcpy(y, bias, nOut * sizeof(float));
+    }
+    else {
+        std::fill(y, y + nOut, 0.f);
+    }
+
+    for (size_t i = 0; i < nIn; i++) {
+        if (x[i] != 0.f) {
+            axpy(nOut, x[i], W + i * nOut, y);
+        }
+    }
+}
+
+/* y[i] = y[i] * scale[i] + shift[i] */
+inline void scaleShift(size_t n, const float *scale, const float *shift, float *y)
+{
+    for (size_t i = 0; i < n; i++) {
+        y[i] = y[i] * scale[i] + shift[i];
+    }
+}
+
+}
+
+enum Activation : int32_t
+{
+    kLinear      = 0,
+    kRelu        = 1,
+    kSigmoid     = 2,
+    kHardSigmoid = 3,
+    kTanh        = 4,
+    kElu         = 5,
+    kSoftplus    = 6,
+};
+
+enum LayerType : uint32_t
+{
+    kInput       = 0,
+    kMasking     = 1,
+    kDense       = 2,
+    kScale       = 3,
+    kLSTM        = 4,
+    kConcatenate = 5,
+    kAdd         = 6,
+    kActivation  = 7,
+};
+
+enum InputKind : int32_t
+{
+    kInputSlice = 0,
+    kInputPng3d = 1,
+    kInputPng2d = 2,
+};
+
+inline void activate(int32_t activation, size_t n, float *x)
+{
+    switch (activation) {
+    case kLinear:
+        break;
+    case kRelu:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = (x[i] > 0.f) ? x[i] : 0.f;
+        }
+        break;
+    case kSigmoid:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = 1.f / (1.f + std::exp(-x[i]));
+        }
+        break;
+    case kHardSigmoid:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = std::min(1.f, std::max(0.f, 0.2f * x[i] + 0.5f));
+        }
+        break;
+    case kTanh:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = std::tanh(x[i]);
+        }
+        break;
+    case kElu:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = (x[i] > 0.f) ? x[i] : std::expm1(x[i]);
+        }
+        break;
+    case kSoftplus:
+        for (size_t i = 0; i < n; i++) {
+            x[i] = std::log1p(std::exp(x[i]));
+        }
+        break;
+    default:
+        throw std::runtime_error(
+            "lstm_ee::Model: unknown activation " + std::to_string(activation)
+        );
+    }
+}
+
+struct Prediction
+{
+    /* NaN if the model does not predict the corresponding energy */
+    float total;
+    float primary;
+};
+
+struct Tensor
+{
+    std::vector<uint32_t> shape;
+    std::vector<float>    data;
+};
+
+struct Layer
+{
+    uint32_t             type;
+    std::string          name;
+    std::vector<int32_t> inputs;
+    std::vector<int32_t> params;
+    std::vector<Tensor>  tensors;
+
+    /* Filled by Model after loading */
+    size_t width;
+    bool   sequence;
+};
+
+struct InputSpec
+{
+    bool                     present;
+    int32_t                  sortVar;
+    bool                     ascending;
+    std::vector<std::string> vars;
+};
+
+/*
+ * Scratch buffers used during evaluation. Each thread should use its own
+ * Workspace.
+ */
+class Workspace
+{
+public:
+    Workspace() { }
+
+private:
+    friend class Model;
+
+    std::vector<std::vector<float>>   values;
+    std::vector<std::vector<uint8_t>> masks;
+    std::vector<size_t>               lengths;
+
+    std::vector<float> inputs[3];
+    size_t             nPngs[3];
+
+    std::vector<std::pair<float, size_t>> keys;
+
+    std::vector<float> xw;
+    std::vector<float> gates;
+    std::vector<float> h;
+    std::vector<float> c;
+    std::vector<float> tmp;
+};
+
+class Model
+{
+public:
+    static const char* magic() { return "LSTMEENN"; }
+    static constexpr uint32_t VERSION = 1;
+
+    explicit Model(const std::string &path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        if (! f) {
+            throw std::runtime_error("lstm_ee::Model: failed to open " + path);
+        }
+
+        std::vector<char> buffer(
+            (std::istreambuf_iterator<char>(f)),
+            std::istreambuf_iterator<char>()
+        );
+
+        parse(buffer);
+        validate();
+    }
+
+    const std::vector<std::string>& varsSlice() const
+        { return fInputs[kInputSlice].vars; }
+    const std::vector<std::string>& varsPng3d() const
+        { return fInputs[kInputPng3d].vars; }
+    const std::vector<std::string>& varsPng2d() const
+        { return fInputs[kInputPng2d].vars; }
+
+    bool    hasTotal()   const { return fOutputTotal   >= 0; }
+    bool    hasPrimary() const { return fOutputPrimary >= 0; }
+    int32_t maxProngs()  const { return fMaxProngs; }
+    float   maskValue()  const { return fMaskValue; }
+
+    const std::vector<Layer>& layers() const { return fLayers; }
+
+    /*
+     * Evaluate a single slice.
+     *
+     * `slice` holds varsSlice().size() values. `png3d` (`png2d`) holds
+     * nPng3d (nPng2d) prongs of varsPng3d().size() (varsPng2d().size())
+     * values each, prong-major. Pointers of unused inputs may be null.
+     */
+    Prediction predict(
+        const float *slice,
+        const float *png3d, size_t nPng3d,
+        const float *png2d, size_t nPng2d,
+        Workspace   &ws
+    ) const
+    {
+        const float *pngs[3] = { slice, png3d, png2d };
+        const size_t ns[3]   = { 1, nPng3d, nPng2d };
+
+        for (int kind = 0; kind < 3; kind++) {
+            prepareInput(kind, pngs[kind], ns[kind], ws);
+        }
+
+        return evaluate(ws);
+    }
+
+    /*
+     * Evaluate a single slice. A convenience wrapper for CAFAna Vars.
+     * Thread safe, since it uses a thread local Workspace.
+     */
+    Prediction predict(
+        const std::vector<float> &slice,
+        const std::vector<float> &png3d,
+        const std::vector<float> &png2d
+    ) const
+    {
+        thread_local Workspace ws;
+
+        return predict(
+            slice.data(),
+            png3d.data(), countProngs(kInputPng3d, png3d.size()),
+            png2d.data(), countProngs(kInputPng2d, png2d.size()),
+            ws
+        );
+    }
+
+    /*
+     * Evaluate a batch of `nSlices` slices.
+     *
+     * `slice` is an array of shape [nSlices][varsSlice().size()].
+     * Prongs of the slice `i` are located at rows [offsets[i], offsets[i+1])
+     * of the prong-major `png` array of shape [N_PRONGS][N_VARS].
+     * Predictions are saved into `total` and `primary` (may be null).
+     * Batch is split among `nThreads` threads.
+     */
+    void predict(
+        size_t          nSlices,
+        const float    *slice,
+        const uint64_t *offsets3d,
+        const float    *png3d,
+        const uint64_t *offsets2d,
+        const float    *png2d,
+        float          *total,
+        float          *primary,
+        unsigned        nThreads = 1
+    ) const
+    {
+        auto worker = [&] (size_t start, size_t end)
+        {
+            Workspace ws;
+
+            for (size_t i = start; i < end; i++) {
+                const Prediction pred = predict(
+                    rowPtr(kInputSlice, slice, nullptr, i),
+                    rowPtr(kInputPng3d, png3d, offsets3d, i),
+                    rowCount(offsets3d, i),
+                    rowPtr(kInputPng2d, png2d, offsets2d, i),
+                    rowCount(offsets2d, i),
+                    ws
+                );
+
+                if (total   != nullptr) { total[i]   = pred.total;   }
+                if (primary != nullptr) { primary[i] = pred.primary; }
+            }
+        };
+
+        nThreads = std::max(1u, std::min<unsigned>(nThreads, nSlices));
+
+        if (nThreads == 1) {
+            worker(0, nSlices);
+            return;
+        }
+
+        std::vector<std::thread>        threads;
+        std::vector<std::exception_ptr> errors(nThreads);
+
+        for (unsigned t = 0; t < nThreads; t++) {
+            const size_t start = (nSlices * t)       / nThreads;
+            const size_t end   = (nSlices * (t + 1)) / nThreads;
+
+            threads.emplace_back([&, t, start, end] () {
+                try {
+                    worker(start, end);
+                }
+                catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        for (auto &e : errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+    }
+
+private:
+    class Reader
+    {
+    public:
+        explicit Reader(const std::vector<char> &buffer)
+          : fBuffer(buffer), fPos(0)
+        { }
+
+        template<typename T>
+        T read()
+        {
+            T result;
+            readBytes(&result, sizeof(T));
+            return result;
+        }
+
+        std::string readString()
+        {
+            const uint32_t size = read<uint32_t>();
+            std::string result(size, '\0');
+            readBytes(&result[0], size);
+            return result;
+        }
+
+        template<typename T>
+        std::vector<T> readArray(size_t size)
+        {
+            std::vector<T> result(size);
+            readBytes(result.data(), size * sizeof(T));
+            return result;
+        }
+
+        void readBytes(void *dst, size_t size)
+        {
+            if (size > fBuffer.size() - fPos) {
+                throw std::runtime_error("lstm_ee::Model: truncated file");
+            }
+
+            if (size > 0) {
+                std::memcpy(dst, fBuffer.data() + fPos, size);
+            }
+
+            fPos += size;
+        }
+
+    private:
+        const std::vector<char> &fBuffer;
+        size_t                   fPos;
+    };
+
+    void parse(const std::vector<char> &buffer)
+    {
+        Reader reader(buffer);
+
+        char magic[8];
+        reader.readBytes(magic, 8);
+
+        if (std::memcmp(magic, Model::magic(), 8) != 0) {
+            throw std::runtime_error("lstm_ee::Model: not a lstm_ee model");
+        }
+
+        const uint32_t version = reader.read<uint32_t>();
+        if (version != VERSION) {
+            throw std::runtime_error(
+                "lstm_ee::Model: unsupported version "
+                + std::to_string(version)
+            );
+        }
+
+        fMaskValue = reader.read<float>();
+        fMaxProngs = reader.read<int32_t>();
+
+        for (auto &input : fInputs) {
+            input.present   = (reader.read<uint32_t>() != 0);
+            input.sortVar   = reader.read<int32_t>();
+            input.ascending = (reader.read<uint32_t>() != 0);
+
+            const uint32_t nVars = reader.read<uint32_t>();
+            for (uint32_t i = 0; i < nVars; i++) {
+                input.vars.push_back(reader.readString());
+            }
+        }
+
+        fOutputTotal   = reader.read<int32_t>();
+        fOutputPrimary = reader.read<int32_t>();
+
+        const uint32_t nLayers = reader.read<uint32_t>();
+
+        for (uint32_t i = 0; i < nLayers; i++) {
+            Layer layer;
+
+            layer.type = reader.read<uint32_t>();
+            layer.name = reader.readString();
+
+            layer.inputs  = reader.readArray<int32_t>(reader.read<uint32_t>());
+            layer.params  = reader.readArray<int32_t>(reader.read<uint32_t>());
+
+            const uint32_t nTensors = reader.read<uint32_t>();
+
+            for (uint32_t j = 0; j < nTensors; j++) {
+                Tensor tensor;
+                tensor.shape = reader.readArray<uint32_t>(
+                    reader.read<uint32_t>()
+                );
+
+                size_t size = 1;
+                for (uint32_t dim : tensor.shape) {
+                    size *= dim;
+                }
+
+                tensor.data = reader.readArray<float>(size);
+                layer.tensors.push_back(std::move(tensor));
+            }
+
+            fLayers.push_back(std::move(layer));
+        }
+    }
+
+    [[noreturn]] static void fail(const Layer &layer, const std::string &msg)
+    {
+        throw std::runtime_error(
+            "lstm_ee::Model: invalid layer '" + layer.name + "': " + msg
+        );
+    }
+
+    static void checkParams(const Layer &layer, size_t n)
+    {
+        if (layer.params.size() != n) {
+            fail(layer, "wrong number of parameters");
+        }
+    }
+
+    static void checkTensor(
+        const Layer &layer, size_t idx, const std::vector<uint32_t> &shape
+    )
+    {
+        if ((layer.tensors.size() <= idx) || (layer.tensors[idx].shape != shape))
+        {
+            fail(layer, "wrong weights shape");
+        }
+    }
+
+    void validate()
+    {
+        for (size_t l = 0; l < fLayers.size(); l++) {
+            Layer &layer = fLayers[l];
+
+            for (int32_t input : layer.inputs) {
+                if ((input < 0) || ((size_t)input >= l)) {
+                    fail(layer, "layers are not topologically sorted");
+                }
+            }
+
+            if ((layer.type == kInput) != layer.inputs.empty()) {
+                fail(layer, "wrong number of inputs");
+            }
+
+            const Layer *prev = layer.inputs.empty()
+                ? nullptr : &fLayers[layer.inputs[0]];
+
+            switch (layer.type) {
+            case kInput:
+            {
+                checkParams(layer, 1);
+                const int32_t kind = layer.params[0];
+
+                if ((kind < 0) || (kind > 2) || (! fInputs[kind].present)) {
+                    fail(layer, "unknown input");
+                }
+
+                layer.width    = fInputs[kind].vars.size();
+                layer.sequence = (kind != kInputSlice);
+                break;
+            }
+            case kMasking:
+                checkTensor(layer, 0, { 1 });
+                if (! prev->sequence) {
+                    fail(layer, "masking of non-sequential input");
+                }
+                layer.width    = prev->width;
+                layer.sequence = true;
+                break;
+            case kDense:
+            {
+                checkParams(layer, 1);
+                const uint32_t nOut = layer.tensors.empty()
+                    ? 0 : layer.tensors[0].shape.back();
+
+                checkTensor(layer, 0, { (uint32_t)prev->width, nOut });
+                checkTensor(layer, 1, { nOut });
+
+                layer.width    = nOut;
+                layer.sequence = prev->sequence;
+                break;
+            }
+            case kScale:
+                checkTensor(layer, 0, { (uint32_t)prev->width });
+                checkTensor(layer, 1, { (uint32_t)prev->width });
+                layer.width    = prev->width;
+                layer.sequence = prev->sequence;
+                break;
+            case kLSTM:
+            {
+                checkParams(layer, 6);
+                const uint32_t units = layer.params[0];
+
+                checkTensor(layer, 0, { (uint32_t)prev->width, 4 * units });
+                checkTensor(layer, 1, { units, 4 * units });
+                checkTensor(layer, 2, { 4 * units });
+
+                if (! prev->sequence) {
+                    fail(layer, "LSTM of non-sequential input");
+                }
+
+                layer.width    = units;
+                layer.sequence = (layer.params[4] != 0);
+                break;
+            }
+            case kConcatenate:
+            case kAdd:
+                layer.width    = 0;
+                layer.sequence = prev->sequence;
+
+                for (int32_t input : layer.inputs) {
+                    const Layer &x = fLayers[input];
+
+                    if (x.sequence != layer.sequence) {
+                        fail(layer, "mixed sequential and flat inputs");
+                    }
+
+                    if (layer.type == kConcatenate) {
+                        layer.width += x.width;
+                    }
+                    else if (x.width != prev->width) {
+                        fail(layer, "inputs of different sizes");
+                    }
+                }
+
+                if (layer.type == kAdd) {
+                    layer.width = prev->width;
+                }
+                break;
+            case kActivation:
+                checkParams(layer, 1);
+                layer.width    = prev->width;
+                layer.sequence = prev->sequence;
+                break;
+            default:
+                fail(layer, "unknown layer type " + std::to_string(layer.type));
+            }
+        }
+
+        for (int32_t output : { fOutputTotal, fOutputPrimary }) {
+            if (output < 0) {
+                continue;
+            }
+
+            if (
+                   ((size_t)output >= fLayers.size())
+                || (fLayers[output].width != 1)
+                || fLayers[output].sequence
+            ) {
+                throw std::runtime_error("lstm_ee::Model: invalid output");
+            }
+        }
+    }
+
+    size_t countProngs(int kind, size_t size) const
+    {
+        const size_t nVars = fInputs[kind].vars.size();
+
+        if (nVars == 0) {
+            return 0;
+        }
+
+        if (size % nVars != 0) {
+            throw std::runtime_error(
+                "lstm_ee::Model: number of prong values is not a multiple of"
+                " the number of prong variables"
+            );
+        }
+
+        return size / nVars;
+    }
+
+    const float* rowPtr(
+        int kind, const float *values, const uint64_t *offsets, size_t i
+    ) const
+    {
+        if (values == nullptr) {
+            return nullptr;
+        }
+
+        const size_t row = (offsets == nullptr) ? i : offsets[i];
+        return values + row * fInputs[kind].vars.size();
+    }
+
+    static size_t rowCount(const uint64_t *offsets, size_t i)
+    {
+        return (offsets == nullptr) ? 0 : (offsets[i + 1] - offsets[i]);
+    }
+
+    /* Truncate, sort and NaN mask inputs the same way as during training */
+    void prepareInput(int kind, const float *x, size_t n, Workspace &ws) const
+    {
+        const InputSpec    &spec  = fInputs[kind];
+        const size_t        nVars = spec.vars.size();
+        std::vector<float> &out   = ws.inputs[kind];
+
+        if (! spec.present) {
+            ws.nPngs[kind] = 0;
+            return;
+        }
+
+        if (x == nullptr) {
+            if (n > 0 || kind == kInputSlice) {
+                throw std::runtime_error("lstm_ee::Model: missing inputs");
+            }
+        }
+
+        if ((kind != kInputSlice) && (fMaxProngs >= 0)) {
+            n = std::min(n, (size_t)fMaxProngs);
+        }
+
+        out.resize(n * nVars);
+
+        if ((kind == kInputSlice) || (spec.sortVar < 0)) {
+            if (n > 0) {
+                std::memcpy(out.data(), x, n * nVars * sizeof(float));
+            }
+        }
+        else {
+            ws.keys.clear();
+
+            for (size_t p = 0; p < n; p++) {
+                const float key = x[p * nVars + spec.sortVar];
+
+                if (! std::isnan(key)) {
+                    ws.keys.emplace_back(spec.ascending ? key : -key, p);
+                }
+            }
+
+            /* ties are resolved by the original prong index */
+            std::sort(ws.keys.begin(), ws.keys.end());
+
+            /* prongs with NaN sorting keys are masked during training */
+            n = ws.keys.size();
+            out.resize(n * nVars);
+
+            for (size_t p = 0; p < n; p++) {
+                std::memcpy(
+                    out.data() + p * nVars,
+                    x + ws.keys[p].second * nVars,
+                    nVars * sizeof(float)
+                );
+            }
+        }
+
+        for (float &v : out) {
+            if (std::isnan(v)) {
+                v = fMaskValue;
+            }
+        }
+
+        ws.nPngs[kind] = n;
+    }
+
+    Prediction evaluate(Workspace &ws) const
+    {
+        const size_t nLayers = fLayers.size();
+
+        ws.values.resize(nLayers);
+        ws.masks.resize(nLayers);
+        ws.lengths.resize(nLayers);
+
+        for (size_t l = 0; l < nLayers; l++) {
+            const Layer &layer = fLayers[l];
+
+            std::vector<float>   &y    = ws.values[l];
+            std::vector<uint8_t> &mask = ws.masks[l];
+            size_t               &len  = ws.lengths[l];
+
+            const int32_t src = layer.inputs.empty() ? -1 : layer.inputs[0];
+
+            if (src >= 0) {
+                len = ws.lengths[src];
+                if (layer.sequence && fLayers[src].sequence) {
+                    mask = ws.masks[src];
+                }
+            }
+
+            switch (layer.type) {
+            case kInput:
+            {
+                const int32_t kind = layer.params[0];
+
+                y   = ws.inputs[kind];
+                len = (kind == kInputSlice) ? 1 : ws.nPngs[kind];
+                mask.assign(len, 1);
+                break;
+            }
+            case kMasking:
+            {
+                const float  maskValue = layer.tensors[0].data[0];
+                const size_t width     = layer.width;
+
+                y = ws.values[src];
+
+                for (size_t t = 0; t < len; t++) {
+                    float *row = y.data() + t * width;
+
+                    const bool valid = std::any_of(
+                        row, row + width,
+                        [maskValue] (float v) { return v != maskValue; }
+                    );
+
+                    mask[t] = mask[t] && valid;
+
+                    if (! valid) {
+                        std::fill(row, row + width, 0.f);
+                    }
+                }
+                break;
+            }
+            case kDense:
+            {
+                const Tensor &W     = layer.tensors[0];
+                const Tensor &bias  = layer.tensors[1];
+                const size_t nIn    = fLayers[src].width;
+                const size_t nOut   = layer.width;
+                const size_t nSteps = layer.sequence ? len : 1;
+
+                y.resize(nSteps * nOut);
+
+                for (size_t t = 0; t < nSteps; t++) {
+                    kernels::affine(
+                        W.data.data(), bias.data.data(), nIn, nOut,
+                        ws.values[src].data() + t * nIn, y.data() + t * nOut
+                    );
+                }
+
+                activate(layer.params[0], y.size(), y.data());
+                break;
+            }
+            case kScale:
+            {
+                const size_t width  = layer.width;
+                const size_t nSteps = layer.sequence ? len : 1;
+
+                y = ws.values[src];
+
+                for (size_t t = 0; t < nSteps; t++) {
+                    kernels::scaleShift(
+                        width,
+                        layer.tensors[0].data.data(),
+                        layer.tensors[1].data.data(),
+                        y.data() + t * width
+                    );
+                }
+                break;
+            }
+            case kLSTM:
+                evaluateLSTM(layer, src, ws);
+                break;
+            case kConcatenate:
+            {
+                const size_t nSteps = layer.sequence ? len : 1;
+                size_t       offset = 0;
+
+                y.resize(nSteps * layer.width);
+
+                for (int32_t input : layer.inputs) {
+                    const size_t width = fLayers[input].width;
+
+                    if (layer.sequence && (ws.lengths[input] != len)) {
+                        throw std::runtime_error(
+                            "lstm_ee::Model: concatenation of sequences of"
+                            " different lengths"
+                        );
+                    }
+
+                    for (size_t t = 0; t < nSteps; t++) {
+                        std::memcpy(
+                            y.data() + t * layer.width + offset,
+                            ws.values[input].data() + t * width,
+                            width * sizeof(float)
+                        );
+                    }
+
+                    offset += width;
+                    mergeMask(layer, input, ws, mask);
+                }
+                break;
+            }
+            case kAdd:
+                y = ws.values[src];
+
+                for (size_t i = 1; i < layer.inputs.size(); i++) {
+                    const std::vector<float> &x = ws.values[layer.inputs[i]];
+
+                    if (x.size() != y.size()) {
+                        throw std::runtime_error(
+                            "lstm_ee::Model: addition of sequences of"
+                            " different lengths"
+                        );
+                    }
+
+                    kernels::axpy(y.size(), 1.f, x.data(), y.data());
+                    mergeMask(layer, layer.inputs[i], ws, mask);
+                }
+                break;
+            case kActivation:
+                y = ws.values[src];
+                activate(layer.params[0], y.size(), y.data());
+                break;
+            }
+
+            if (! layer.sequence) {
+                len = 1;
+            }
+        }
+
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+
+        Prediction result;
+        result.total   = hasTotal()   ? ws.values[fOutputTotal][0]   : nan;
+        result.primary = hasPrimary() ? ws.values[fOutputPrimary][0] : nan;
+
+        return result;
+    }
+
+    void mergeMask(
+        const Layer &layer, int32_t input, const Workspace &ws,
+        std::vector<uint8_t> &mask
+    ) const
+    {
+        if (! layer.sequence) {
+            return;
+        }
+
+        const std::vector<uint8_t> &other = ws.masks[input];
+
+        for (size_t t = 0; t < mask.size(); t++) {
+            mask[t] = mask[t] && other[t];
+        }
+    }
+
+    /*
+     * LSTM with keras semantics: gates are ordered as (i, f, c, o), masked
+     * time steps do not update state and repeat the previous output.
+     *
+     * params: units, activation, recurrent_activation, go_backwards,
+     *         return_sequences, reverse_output
+     */
+    void evaluateLSTM(const Layer &layer, int32_t src, Workspace &ws) const
+    {
+        const size_t units        = layer.params[0];
+        const int32_t act         = layer.params[1];
+        const int32_t recAct      = layer.params[2];
+        const bool goBackwards    = (layer.params[3] != 0);
+        const bool returnSeq      = (layer.params[4] != 0);
+        const bool reverseOutput  = (layer.params[5] != 0);
+
+        const size_t nIn   = fLayers[src].width;
+        const size_t nGate = 4 * units;
+        const size_t len   = ws.lengths[src];
+
+        const float *W    = layer.tensors[0].data.data();
+        const float *U    = layer.tensors[1].data.data();
+        const float *bias = layer.tensors[2].data.data();
+
+        const std::vector<float>   &x    = ws.values[src];
+        const std::vector<uint8_t> &mask = ws.masks[src];
+
+        std::vector<float> &y = ws.values[&layer - fLayers.data()];
+
+        ws.xw.resize(len * nGate);
+        ws.gates.resize(nGate);
+        ws.tmp.resize(units);
+        ws.h.assign(units, 0.f);
+        ws.c.assign(units, 0.f);
+
+        /* Input projections of all time steps are independent */
+        for (size_t t = 0; t < len; t++) {
+            kernels::affine(
+                W, bias, nIn, nGate, x.data() + t * nIn, ws.xw.data() + t * nGate
+            );
+        }
+
+        y.resize(returnSeq ? (len * units) : units);
+
+        float *h = ws.h.data();
+        float *c = ws.c.data();
+        float *z = ws.gates.data();
+
+        for (size_t s = 0; s < len; s++) {
+            const size_t t = goBackwards ? (len - 1 - s) : s;
+
+            if (mask[t]) {
+                std::memcpy(z, ws.xw.data() + t * nGate, nGate * sizeof(float));
+
+                for (size_t j = 0; j < units; j++) {
+                    if (h[j] != 0.f) {
+                        kernels::axpy(nGate, h[j], U + j * nGate, z);
+                    }
+                }
+
+                activate(recAct, units,     z);
+                activate(recAct, units,     z + units);
+                activate(act,    units,     z + 2 * units);
+                activate(recAct, units,     z + 3 * units);
+
+                for (size_t j = 0; j < units; j++) {
+                    c[j] = z[units + j] * c[j] + z[j] * z[2 * units + j];
+                }
+
+                std::memcpy(ws.tmp.data(), c, units * sizeof(float));
+                activate(act, units, ws.tmp.data());
+
+                for (size_t j = 0; j < units; j++) {
+                    h[j] = z[3 * units + j] * ws.tmp[j];
+                }
+            }
+
+            if (returnSeq) {
+                const size_t pos = reverseOutput ? (len - 1 - s) : s;
+                std::memcpy(y.data() + pos * units, h, units * sizeof(float));
+            }
+        }
+
+        if (! returnSeq) {
+            std::memcpy(y.data(), h, units * sizeof(float));
+        }
+    }
+
+    float   fMaskValue;
+    int32_t fMaxProngs;
+    int32_t fOutputTotal;
+    int32_t fOutputPrimary;
+
+    InputSpec          fInputs[3];
+    std::vector<Layer> fLayers;
+};
+
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+/*
+ * LSTMEEVars -- CAFAna Vars of the energies predicted by the native `lstm_ee`
+ * inference engine (c.f. LSTMEEModel.h).
+ *
+ * Inputs of the network are looked up by name among the Vars and MultiVars
+ * used by the exporters, e.g.
+ *
+ *     const LSTMEEVars lstmVars(
+ *         "model.bin", kSliceVarDefs, kPng2dVarDefs, kPng3dVarDefs
+ *     );
+ *
+ *     const Var kLSTMETotal   = lstmVars.total();
+ *     const Var kLSTMEPrimary = lstmVars.primary();
+ *
+ * The network is evaluated once per slice: all Vars share the last
+ * prediction, as long as the input values do not change.
+ *
+ * The Vars may be evaluated concurrently. The last prediction and the
+ * scratch buffers are kept per thread, and the model itself is immutable.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CAFAna/Core/MultiVar.h"
+#include "CAFAna/Core/Var.h"
+
+#include "StandardRecord/Proxy/SRProxy.h"
+
+#include "LSTMEEModel.h"
+
+namespace ana
+{
+
+class LSTMEEVars
+{
+public:
+    LSTMEEVars(
+        const std::string                                   &path,
+        const std::vector<std::pair<std::string, Var>>      &sliceVarDefs,
+        const std::vector<std::pair<std::string, MultiVar>> &png2dVarDefs,
+        const std::vector<std::pair<std::string, MultiVar>> &png3dVarDefs
+    )
+      : fState(std::make_shared<State>(path))
+    {
+        fState->sliceVars = lookup(fState->model.varsSlice(), sliceVarDefs);
+        fState->png3dVars = lookup(fState->model.varsPng3d(), png3dVarDefs);
+        fState->png2dVars = lookup(fState->model.varsPng2d(), png2dVarDefs);
+    }
+
+    Var total() const
+    {
+        auto state = fState;
+        return Var([state] (const caf::SRProxy *sr) -> double {
+            return state->evaluate(sr).total;
+        });
+    }
+
+    Var primary() const
+    {
+        auto state = fState;
+        return Var([state] (const caf::SRProxy *sr) -> double {
+            return state->evaluate(sr).primary;
+        });
+    }
+
+    Var secondary() const
+    {
+        auto state = fState;
+        return Var([state] (const caf::SRProxy *sr) -> double {
+            const lstm_ee::Prediction pred = state->evaluate(sr);
+            return pred.total - pred.primary;
+        });
+    }
+
+private:
+    /* Inputs and the last prediction of a State in a single thread */
+    struct Cache
+    {
+        std::vector<float> slice;
+        std::vector<float> png3d;
+        std::vector<float> png2d;
+
+        std::vector<float> lastSlice;
+        std::vector<float> lastPng3d;
+        std::vector<float> lastPng2d;
+
+        bool                cached = false;
+        lstm_ee::Prediction lastPrediction;
+    };
+
+    struct State
+    {
+        explicit State(const std::string &path)
+          : model(path), id(nextId()++)
+        { }
+
+        const lstm_ee::Model  model;
+        std::vector<Var>      sliceVars;
+        std::vector<MultiVar> png3dVars;
+        std::vector<MultiVar> png2dVars;
+
+        /* Unlike the address, never reused by another State */
+        const uint64_t id;
+
+        static std::atomic<uint64_t>& nextId()
+        {
+            static std::atomic<uint64_t> result(0);
+            return result;
+        }
+
+        Cache& threadCache() const
+        {
+            thread_local std::unordered_map<uint64_t, Cache> caches;
+            return caches[id];
+        }
+
+        /* The reference is valid until the next call in the same thread */
+        const lstm_ee::Prediction& evaluate(const caf::SRProxy *sr) const
+        {
+            Cache &c = threadCache();
+
+            c.slice.clear();
+            for (const auto &var : sliceVars) {
+                c.slice.push_back(var(sr));
+            }
+
+            gatherProngs(sr, png3dVars, c.png3d);
+            gatherProngs(sr, png2dVars, c.png2d);
+
+            if (
+                   c.cached
+                && sameBits(c.slice, c.lastSlice)
+                && sameBits(c.png3d, c.lastPng3d)
+                && sameBits(c.png2d, c.lastPng2d)
+            ) {
+                return c.lastPrediction;
+            }
+
+            c.lastPrediction = model.predict(c.slice, c.png3d, c.png2d);
+
+            c.lastSlice.swap(c.slice);
+            c.lastPng3d.swap(c.png3d);
+            c.lastPng2d.swap(c.png2d);
+            c.cached = true;
+
+            return c.lastPrediction;
+        }
+
+        /* Transpose prong values into a prong-major array. Missing values
+         * are NaN padded, as in the training data. */
+        static void gatherProngs(
+            const caf::SRProxy          *sr,
+            const std::vector<MultiVar> &vars,
+            std::vector<float>          &result
+        )
+        {
+            std::vector<std::vector<double>> values;
+            size_t nPngs = 0;
+
+            for (const auto &var : vars) {
+                values.push_back(var(sr));
+                nPngs = std::max(nPngs, values.back().size());
+            }
+
+            result.assign(nPngs * vars.size(), std::nanf(""));
+
+            for (size_t v = 0; v < values.size(); v++) {
+                for (size_t p = 0; p < values[v].size(); p++) {
+                    result[p * vars.size() + v] = values[v][p];
+                }
+            }
+        }
+
+        static bool sameBits(
+            const std::vector<float> &a, const std::vector<float> &b
+        )
+        {
+            return (a.size() == b.size())
+                && (std::memcmp(a.data(), b.data(), a.size() * sizeof(float))
+                    == 0);
+        }
+    };
+
+    template<typename T>
+    static std::vector<T> lookup(
+        const std::vector<std::string>                 &names,
+        const std::vector<std::pair<std::string, T>>   &defs
+    )
+    {
+        std::map<std::string, T> defsMap(defs.begin(), defs.end());
+        std::vector<T>           result;
+
+        for (const auto &name : names) {
+            auto it = defsMap.find(name);
+
+            if (it == defsMap.end()) {
+                throw std::runtime_error(
+                    "LSTMEEVars: no definition of the input variable " + name
+                );
+            }
+
+            result.push_back(it->second);
+        }
+
+        return result;
+    }
+
+    std::shared_ptr<State> fState;
+};
+
+}
@@ -0,0 +1,166 @@
+"""
+Definition of a `NativeModel` -- python interface to the native inference
+engine.
+"""
+
+import os
+
+import numpy as np
+
+import pyximport
+pyximport.install(
+    language_level = 3,
+    setup_args     = { "include_dirs" : [ np.get_include() ] }
+)
+
+# pylint: disable=import-error,wrong-import-position
+from lstm_ee.consts import LABEL_PRIMARY, LABEL_SECONDARY, LABEL_TOTAL
+from lstm_ee.data.data_loader.funcs.funcs_csr import stack_csr
+from .native_model_opt import CModel
+
+class NativeModel:
+    """Python interface to the native `lstm_ee` inference engine.
+
+    `NativeModel` evaluates networks exported into flat binary files by
+    `scripts/tf/export_native.py` with the same C++ engine that can be used
+    from CAFAna (c.f. `lstm_ee/inference/native/LSTMEEModel.h`).
+
+    The inputs are expected to be raw: prong truncation, sorting and NaN
+    masking are performed by the engine itself.
+
+    Parameters
+    ----------
+    path : str
+        Path to the flat binary model file.
+    workers : int or None, optional
+        Number of threads to use for evaluation. If None, the number of
+        threads will be equal to the number of CPUs. Default: None.
+    """
+
+    def __init__(self, path, workers = None):
+        self._model   = CModel(path)
+        self._workers = workers or os.cpu_count() or 1
+
+    @property
+    def vars_input_slice(self):
+        """List of slice level input variables"""
+        return self._model.vars_slice
+
+    @property
+    def vars_input_png3d(self):
+        """List of 3D prong level input variables"""
+        return self._model.vars_png3d
+
+    @property
+    def vars_input_png2d(self):
+        """List of 2D prong level input variables"""
+        return self._model.vars_png2d
+
+    def predict(self, slice_values, png3d = None, png2d = None):
+        """Predict energies of a batch of slices.
+
+        Parameters
+        ----------
+        slice_values : ndarray, shape (N_SLICE, N_VARS_SLICE)
+            Slice level input values.
+        png3d : (ndarray, ndarray) or None
+            3D prong level inputs in CSR form (offsets, values).
+            `offsets` is an array of shape (N_SLICE + 1,) and values is an
+            array of shape (N_PNG3D, N_VARS_PNG3D), such that prongs of the
+            i-th slice are values[offsets[i]:offsets[i+1], :].
+        png2d : (ndarray, ndarray) or None
+            2D prong level inputs in CSR form. C.f. `png3d`.
+
+        Returns
+        -------
+        dict
+            Dictionary of predicted energies. C.f. `predict_energies`.
+        """
+        slice_values = _as_float_array(slice_values, self.vars_input_slice)
+        n_slices     = len(slice_values)
+
+        png3d = _as_csr(png3d, self.vars_input_png3d, n_slices)
+        png2d = _as_csr(png2d, self.vars_input_png2d, n_slices)
+
+        total, primary = self._model.predict(
+            n_slices, slice_values, *png3d, *png2d, self._workers
+        )
+
+        result = {
+            LABEL_TOTAL   : total   if self._model.has_total   else None,
+            LABEL_PRIMARY : primary if self._model.has_primary else None,
+        }
+
+        if self._model.has_total and self._model.has_primary:
+            result[LABEL_SECONDARY] = total - primary
+        else:
+            result[LABEL_SECONDARY] = None
+
+        return result
+
+    def predict_data_loader(self, data_loader, index = None):
+        """Predict energies of slices from a `data_loader`.
+
+        Parameters
+        ----------
+        data_loader : IDataLoader
+            DataLoader that holds input variables.
+        index : ndarray or None
+            Indices of slices to be evaluated. If None, all slices will be
+            evaluated. Default: None.
+
+        Returns
+        -------
+        dict
+            Dictionary of predicted energies. C.f. `predict_energies`.
+        """
+        if self.vars_input_slice:
+            slice_values = np.stack(
+                [ data_loader.get(v, index) for v in self.vars_input_slice ],
+                axis = 1
+            )
+        else:
+            slice_values = np.empty(
+                (len(data_loader) if index is None else len(index), 0)
+            )
+
+        pngs = [
+            stack_csr([ data_loader.get_csr(v, index) for v in variables ])
+                if variables else None
+            for variables in [ self.vars_input_png3d, self.vars_input_png2d ]
+        ]
+
+        return self.predict(slice_values, *pngs)
+
+def _as_float_array(values, variables):
+    values = np.ascontiguousarray(values, dtype = np.float32)
+
+    if values.ndim != 2 or values.shape[1] != len(variables):
+        raise ValueError(
+            "Expected inputs of shape (N, %d), got %s"
+            % (len(variables), values.shape)
+        )
+
+    return values
+
+def _as_csr(csr, variables, n_slices):
+    if not variables:
+        return (None, None)
+
+    if csr is None:
+        raise ValueError("Missing prong inputs: %s" % variables)
+
+    offsets, values = csr
+    offsets = np.ascontiguousarray(offsets, dtype = np.uint64)
+    values  = _as_float_array(values, variables)
+
+    # The native engine indexes `values` by `offsets` without bounds checks
+    if (
+           (len(offsets) != n_slices + 1)
+        or (offsets[0] != 0)
+        or (offsets[-1] > len(values))
+        or np.any(offsets[1:] < offsets[:-1])
+    ):
+        raise ValueError("Inconsistent prong offsets")
+
+    return (offsets, values)
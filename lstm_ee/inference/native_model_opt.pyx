@@ -0,0 +1,142 @@
+# distutils: language = c++
+#cython: infer_types=True
+#cython: profile=False
+#cython: linetrace=False
+#cython: nonecheck=False
+#cython: initializedcheck=False
+
+cimport cython
+
+import  numpy as np
+cimport numpy as cnp
+
+from libc.stdint   cimport uint64_t
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+
+cdef extern from "LSTMEEModel.h" namespace "lstm_ee" nogil:
+    cdef cppclass Model:
+        Model(const string &path) except +
+
+        const vector[string]& varsSlice()
+        const vector[string]& varsPng3d()
+        const vector[string]& varsPng2d()
+
+        bint hasTotal()
+        bint hasPrimary()
+
+        void predict(
+            size_t          nSlices,
+            const float    *slice,
+            const uint64_t *offsets3d,
+            const float    *png3d,
+            const uint64_t *offsets2d,
+            const float    *png2d,
+            float          *total,
+            float          *primary,
+            unsigned        nThreads
+        ) except +
+
+cdef list decode_vars(const vector[string] &variables):
+    cdef size_t i
+    return [ variables[i].decode('utf-8') for i in range(variables.size()) ]
+
+cdef class CModel:
+    """Thin wrapper around the native `lstm_ee::Model`.
+
+    Parameters
+    ----------
+    path : str
+        Path to the flat binary model file.
+    """
+
+    cdef Model *_model
+
+    def __cinit__(self, path):
+        self._model = new Model(path.encode('utf-8'))
+
+    def __dealloc__(self):
+        del self._model
+
+    @property
+    def vars_slice(self):
+        return decode_vars(self._model.varsSlice())
+
+    @property
+    def vars_png3d(self):
+        return decode_vars(self._model.varsPng3d())
+
+    @property
+    def vars_png2d(self):
+        return decode_vars(self._model.varsPng2d())
+
+    @property
+    def has_total(self):
+        return self._model.hasTotal()
+
+    @property
+    def has_primary(self):
+        return self._model.hasPrimary()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def predict(
+        self,
+        Py_ssize_t n_slices,
+        const float[:, ::1]  slice_values,
+        const uint64_t[::1]  offsets3d,
+        const float[:, ::1]  png3d,
+        const uint64_t[::1]  offsets2d,
+        const float[:, ::1]  png2d,
+        unsigned             n_threads,
+    ):
+        """Evaluate a batch of slices.
+
+        C.f. `NativeModel.predict` for the description of the arguments.
+
+        Returns
+        -------
+        (ndarray, ndarray)
+            Predicted total and primary energies.
+        """
+        cdef cnp.ndarray[cnp.float32_t, ndim=1] total   = np.full(
+            n_slices, np.nan, dtype = np.float32
+        )
+        cdef cnp.ndarray[cnp.float32_t, ndim=1] primary = np.full(
+            n_slices, np.nan, dtype = np.float32
+        )
+
+        cdef const float    *slice_ptr = NULL
+        cdef const float    *png3d_ptr = NULL
+        cdef const float    *png2d_ptr = NULL
+        cdef const uint64_t *off3d_ptr = NULL
+        cdef const uint64_t *off2d_ptr = NULL
+        cdef float          *total_ptr   = NULL
+        cdef float          *primary_ptr = NULL
+
+        if n_slices == 0:
+            return (total, primary)
+
+        if slice_values is not None and slice_values.shape[0] > 0:
+            slice_ptr = &slice_values[0, 0]
+
+        if offsets3d is not None:
+            off3d_ptr = &offsets3d[0]
+            if png3d.shape[0] > 0:
+                png3d_ptr = &png3d[0, 0]
+
+        if offsets2d is not None:
+            off2d_ptr = &offsets2d[0]
+            if png2d.shape[0] > 0:
+                png2d_ptr = &png2d[0, 0]
+
+        total_ptr   = &total[0]
+        primary_ptr = &primary[0]
+
+        with nogil:
+            self._model.predict(
+                n_slices, slice_ptr, off3d_ptr, png3d_ptr, off2d_ptr,
+                png2d_ptr, total_ptr, primary_ptr, n_threads
+            )
+
+        return (total, primary)
@@ -0,0 +1,275 @@
+"""Functions to convert `keras` models into `FlatModel`."""
+
+import numpy as np
+
+from keras.layers import (
+    Activation, Add, BatchNormalization, Bidirectional, Concatenate, Dense,
+    Dropout, InputLayer, LSTM, Masking, TimeDistributed
+)
+
+from lstm_ee.consts import DEF_MASK
+from lstm_ee.data.data_generator.funcs.prong_sorter import SingleVarProngSorter
+from lstm_ee.inference.flat_model import (
+    ACTIVATIONS, INPUT_NAMES, INPUT_PNG2D, INPUT_PNG3D, INPUT_SLICE,
+    LAYER_ACTIVATION, LAYER_ADD, LAYER_CONCATENATE, LAYER_DENSE, LAYER_INPUT,
+    LAYER_LSTM, LAYER_MASKING, LAYER_SCALE, FlatModel, InputSpec
+)
+
+def get_activation(activation):
+    """Return `FlatModel` activation code of a `keras` activation"""
+    name = getattr(activation, '__name__', activation)
+
+    if name not in ACTIVATIONS:
+        raise ValueError("Unsupported activation: '%s'" % name)
+
+    return ACTIVATIONS[name]
+
+def get_inbound_layers(layer):
+    """Return list of layers that `layer` is applied to"""
+    # pylint: disable=protected-access
+    inbound = layer._inbound_nodes[0].inbound_layers
+
+    if not isinstance(inbound, (list, tuple)):
+        inbound = [ inbound ]
+
+    return list(inbound)
+
+def get_dense_weights(layer):
+    """Return (kernel, bias) of a `keras` Dense layer"""
+    weights = layer.get_weights()
+    kernel  = weights[0]
+
+    if layer.use_bias:
+        bias = weights[1]
+    else:
+        bias = np.zeros(kernel.shape[-1], dtype = np.float32)
+
+    return (kernel, bias)
+
+def get_batchnorm_scale_shift(layer):
+    """Fold BatchNormalization weights into (scale, shift) pair"""
+    if layer.axis not in [ -1, [ -1 ] ]:
+        raise ValueError(
+            "Unsupported BatchNormalization axis: %s" % (layer.axis,)
+        )
+
+    weights = layer.get_weights()
+    idx     = 0
+
+    if layer.scale:
+        gamma = weights[idx]
+        idx  += 1
+    else:
+        gamma = 1
+
+    if layer.center:
+        beta = weights[idx]
+        idx += 1
+    else:
+        beta = 0
+
+    mean, variance = weights[idx:idx + 2]
+
+    scale = gamma / np.sqrt(variance + layer.epsilon)
+    shift = beta - mean * scale
+
+    return (scale * np.ones_like(mean), shift * np.ones_like(mean))
+
+class FlatModelConverter:
+    """Converter of `keras` layers into `FlatModel` layers.
+
+    Parameters
+    ----------
+    flat_model : FlatModel
+        Model where converted layers will be added.
+    """
+
+    def __init__(self, flat_model):
+        self._flat_model = flat_model
+        self._index      = {}
+
+    def index(self, layer_name):
+        """Return index of the `FlatModel` layer for a `keras` layer name"""
+        return self._index[layer_name]
+
+    def convert(self, model):
+        """Convert layers of a `keras` model"""
+        for layer in model.layers:
+            if isinstance(layer, InputLayer):
+                if layer.name not in INPUT_NAMES:
+                    raise ValueError("Unknown input layer: '%s'" % layer.name)
+
+                idx = self._flat_model.add_layer(
+                    LAYER_INPUT, layer.name, [], [ INPUT_NAMES[layer.name] ]
+                )
+            else:
+                inputs = [
+                    self._index[x.name] for x in get_inbound_layers(layer)
+                ]
+                idx = self._convert_layer(layer, layer.name, inputs)
+
+            self._index[layer.name] = idx
+
+    def _add_lstm(self, layer, name, input_idx, reverse_output):
+        if layer.stateful:
+            raise ValueError("Stateful LSTM '%s' is not supported" % name)
+
+        weights = layer.get_weights()
+
+        if layer.use_bias:
+            bias = weights[2]
+        else:
+            bias = np.zeros(4 * layer.units, dtype = np.float32)
+
+        params = [
+            layer.units,
+            get_activation(layer.activation),
+            get_activation(layer.recurrent_activation),
+            int(layer.go_backwards),
+            int(layer.return_sequences),
+            int(reverse_output),
+        ]
+
+        return self._flat_model.add_layer(
+            LAYER_LSTM, name, [ input_idx ], params,
+            [ weights[0], weights[1], bias ]
+        )
+
+    def _add_bidirectional(self, layer, name, input_idx):
+        if layer.merge_mode != 'concat':
+            raise ValueError(
+                "Unsupported Bidirectional merge mode: '%s'" % layer.merge_mode
+            )
+
+        forward = self._add_lstm(
+            layer.forward_layer, name + '/forward', input_idx, False
+        )
+        backward = self._add_lstm(
+            layer.backward_layer, name + '/backward', input_idx,
+            layer.return_sequences
+        )
+
+        return self._flat_model.add_layer(
+            LAYER_CONCATENATE, name, [ forward, backward ]
+        )
+
+    def _convert_layer(self, layer, name, inputs):
+        # pylint: disable=too-many-return-statements
+        if isinstance(layer, TimeDistributed):
+            return self._convert_layer(layer.layer, name, inputs)
+
+        if isinstance(layer, Dropout):
+            return inputs[0]
+
+        if isinstance(layer, Masking):
+            return self._flat_model.add_layer(
+                LAYER_MASKING, name, inputs, [], [ [ layer.mask_value ] ]
+            )
+
+        if isinstance(layer, Dense):
+            return self._flat_model.add_layer(
+                LAYER_DENSE, name, inputs,
+                [ get_activation(layer.activation) ], get_dense_weights(layer)
+            )
+
+        if isinstance(layer, BatchNormalization):
+            return self._flat_model.add_layer(
+                LAYER_SCALE, name, inputs, [],
+                get_batchnorm_scale_shift(layer)
+            )
+
+        if isinstance(layer, LSTM):
+            return self._add_lstm(layer, name, inputs[0], False)
+
+        if isinstance(layer, Bidirectional):
+            return self._add_bidirectional(layer, name, inputs[0])
+
+        if isinstance(layer, Concatenate):
+            if layer.axis != -1:
+                raise ValueError("Unsupported Concatenate axis: %d" % layer.axis)
+
+            return self._flat_model.add_layer(LAYER_CONCATENATE, name, inputs)
+
+        if isinstance(layer, Add):
+            return self._flat_model.add_layer(LAYER_ADD, name, inputs)
+
+        if isinstance(layer, Activation):
+            return self._flat_model.add_layer(
+                LAYER_ACTIVATION, name, inputs,
+                [ get_activation(layer.activation) ]
+            )
+
+        raise ValueError(
+            "Unsupported layer '%s' of type %s" % (name, type(layer).__name__)
+        )
+
+def get_input_spec(variables, prong_sorter):
+    """Create `InputSpec` of an input with a given prong sorter"""
+    if prong_sorter is None:
+        return InputSpec(list(variables), None, False)
+
+    if not isinstance(prong_sorter, str) or (prong_sorter == 'random'):
+        raise ValueError(
+            "Prong sorter '%s' is not supported by the native inference"
+            % (prong_sorter,)
+        )
+
+    sorter = SingleVarProngSorter(prong_sorter, variables)
+    return InputSpec(list(variables), sorter.var_idx, sorter.ascending)
+
+def export_flat_model(args, model):
+    """Convert `keras` model of `lstm_ee` into a `FlatModel`.
+
+    Parameters
+    ----------
+    args : Args
+        Arguments of the `model` training. Input variables, prong limit and
+        prong sorting specifications are taken from `args`.
+    model : keras.Model
+        `lstm_ee` model to be converted.
+
+    Returns
+    -------
+    FlatModel
+        Converted model.
+
+    Notes
+    -----
+    Only layers that are used in `lstm_ee.keras.models` are supported. Dropout
+    layers are dropped and BatchNormalization layers are folded into affine
+    transformations. Bidirectional LSTM is split into a pair of LSTMs.
+    """
+    flat_model = FlatModel(
+        layers     = [],
+        inputs     = {},
+        outputs    = {},
+        max_prongs = args.max_prongs,
+        mask_value = DEF_MASK,
+    )
+
+    converter = FlatModelConverter(flat_model)
+    converter.convert(model)
+
+    prong_sorters = args.prong_sorters or {}
+    layer_names   = [ x.name for x in model.layers ]
+
+    for (name, kind, variables) in [
+        ('input_slice', INPUT_SLICE, args.vars_input_slice),
+        ('input_png3d', INPUT_PNG3D, args.vars_input_png3d),
+        ('input_png2d', INPUT_PNG2D, args.vars_input_png2d),
+    ]:
+        if name not in layer_names:
+            continue
+
+        if kind == INPUT_SLICE:
+            flat_model.inputs[kind] = InputSpec(list(variables), None, False)
+        else:
+            flat_model.inputs[kind] = get_input_spec(
+                variables, prong_sorters.get(name, None)
+            )
+
+    for output in [ 'target_total', 'target_primary' ]:
+        if output in layer_names:
+            flat_model.outputs[output] = converter.index(output)
+
+    return flat_model
@@ -0,0 +1,198 @@
+"""Benchmark the data pipeline on a synthetic dataset"""
+
+import argparse
+import logging
+import os
+import sys
+
+from lstm_ee.bench import (
+    BENCHMARKS, BenchContext, compare_results, format_comparison,
+    format_results, load_results, prepare_data, run_benchmarks, save_results
+)
+from lstm_ee.bench.bench import FORMATS
+from lstm_ee.presets     import PRESETS_TRAIN
+from lstm_ee.utils.log   import setup_logging
+
+CONFIG_KEYS = [
+    'vars_input_slice', 'vars_input_png3d', 'vars_input_png2d',
+    'var_target_total', 'var_target_primary',
+]
+
+def create_parser():
+    """Create command line argument parser"""
+    parser = argparse.ArgumentParser(
+        "Benchmark the data pipeline on a synthetic dataset"
+    )
+
+    parser.add_argument(
+        '-n', '--slices',
+        help    = 'Number of slices in the synthetic dataset',
+        default = 100000,
+        dest    = 'slices',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--preset',
+        help    = 'Training preset that defines the dataset variables',
+        default = 'numu_v3',
+        dest    = 'preset',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--formats',
+        help    = 'Formats of the synthetic dataset',
+        choices = FORMATS,
+        default = FORMATS,
+        dest    = 'formats',
+        nargs   = '+',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--pipeline-format',
+        help    = 'Dataset format used by the data generator benchmarks',
+        choices = FORMATS,
+        default = None,
+        dest    = 'pipeline_format',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--only',
+        help    = 'Benchmarks to run. Default: all',
+        choices = list(BENCHMARKS),
+        default = None,
+        dest    = 'only',
+        nargs   = '+',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '-b', '--batch-size',
+        help    = 'Batch size',
+        default = 1024,
+        dest    = 'batch_size',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--max-prongs',
+        help    = 'Maximum number of prongs',
+        default = None,
+        dest    = 'max_prongs',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '-j', '--workers',
+        help    = 'Number of parallel workers. Default: number of CPU cores',
+        default = None,
+        dest    = 'workers',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '-r', '--repeat',
+        help    = 'Number of runs of each benchmark. The fastest is reported',
+        default = 1,
+        dest    = 'repeat',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--seed',
+        help    = 'Seed of the synthetic dataset',
+        default = 0,
+        dest    = 'seed',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--workdir',
+        help     = 'Directory for the synthetic datasets and temporary files',
+        dest     = 'workdir',
+        required = True,
+        type     = str,
+    )
+
+    parser.add_argument(
+        '-o', '--output',
+        help    = 'Output json file with the benchmark results',
+        default = None,
+        dest    = 'output',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--baseline',
+        help    = 'Benchmark results to compare against',
+        default = None,
+        dest    = 'baseline',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--threshold',
+        help    = 'Relative slowdown reported as a regression',
+        default = 0.1,
+        dest    = 'threshold',
+        type    = float,
+    )
+
+    return parser
+
+def main():
+    # pylint: disable=missing-function-docstring
+    cmdargs = create_parser().parse_args()
+    setup_logging(logging.INFO)
+
+    config = {
+        k : PRESETS_TRAIN[cmdargs.preset].get(k, None) for k in CONFIG_KEYS
+    }
+
+    paths = prepare_data(
+        os.path.join(cmdargs.workdir, 'data'), config, cmdargs.slices,
+        cmdargs.formats, cmdargs.seed
+    )
+
+    ctx = BenchContext(
+        paths, config, cmdargs.slices,
+        batch_size      = cmdargs.batch_size,
+        max_prongs      = cmdargs.max_prongs,
+        workers         = cmdargs.workers,
+        pipeline_format = cmdargs.pipeline_format,
+        tmpdir          = cmdargs.workdir,
+    )
+
+    benchmarks = BENCHMARKS
+
+    if cmdargs.only is not None:
+        benchmarks = {
+            k : v for (k, v) in BENCHMARKS.items() if k in cmdargs.only
+        }
+
+    results = run_benchmarks(ctx, benchmarks, cmdargs.repeat)
+    results['meta']['preset'] = cmdargs.preset
+
+    print(format_results(results))
+
+    if cmdargs.output is not None:
+        save_results(results, cmdargs.output)
+
+    if cmdargs.baseline is None:
+        return
+
+    changes = compare_results(
+        load_results(cmdargs.baseline), results, cmdargs.threshold
+    )
+
+    print()
+    print(format_comparison(changes))
+
+    if any(x['regression'] for x in changes):
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,45 @@
+"""Convert (and merge) datasets into a columnar file for `lstm_ee` training"""
+
+import argparse
+
+from lstm_ee.data.data                        import guess_data_loader
+from lstm_ee.data.data_loader.columnar_loader import save_columnar
+
+def create_parser():
+    """Create command line argument parser"""
+    parser = argparse.ArgumentParser("Convert CSV/HDF/columnar to columnar")
+
+    parser.add_argument(
+        'input',
+        help    = 'Input files. Multiple inputs will be concatenated.',
+        metavar = 'input',
+        type    = str,
+        nargs   = '+'
+    )
+
+    parser.add_argument(
+        '-o', '--output',
+        help     = 'Output File',
+        type     = str,
+        required = True
+    )
+
+    return parser
+
+def main():
+    # pylint: disable=missing-function-docstring
+    parser  = create_parser()
+    cmdargs = parser.parse_args()
+
+    loaders = []
+
+    for idx,path in enumerate(cmdargs.input):
+        print("Loading file %d of %d" % (idx + 1, len(cmdargs.input)))
+        loaders.append(guess_data_loader(path))
+
+    print("Exporting...")
+    save_columnar(cmdargs.output, loaders)
+    print("Done")
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,144 @@
+"""Run an exporter over shards of a file list in parallel and merge outputs"""
+
+import argparse
+import logging
+
+from lstm_ee.data.sharded_export import (
+    ShardedExport, read_file_list, DEFAULT_COMMAND
+)
+from lstm_ee.utils.log import setup_logging
+
+def create_parser():
+    """Create command line argument parser"""
+    parser = argparse.ArgumentParser(
+        "Export a list of files in parallel shards and merge the results"
+    )
+
+    parser.add_argument(
+        'macro',
+        help    = 'Exporter macro',
+        metavar = 'MACRO',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '-i', '--input',
+        help    = 'Input files',
+        default = [],
+        dest    = 'input',
+        metavar = 'FILE',
+        nargs   = '+',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '-l', '--file-list',
+        help    = 'Text file with a list of input files (one per line)',
+        default = [],
+        action  = 'append',
+        dest    = 'file_list',
+        metavar = 'LIST',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '-n', '--shards',
+        help    = 'Number of shards',
+        default = 16,
+        dest    = 'shards',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '-j', '--workers',
+        help    = 'Number of parallel workers. Default: number of CPU cores',
+        default = None,
+        dest    = 'workers',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--outdir',
+        help     = 'Directory for shard outputs, logs and resume state',
+        dest     = 'outdir',
+        required = True,
+        type     = str,
+    )
+
+    parser.add_argument(
+        '-o', '--output',
+        help    = 'Merged output file. If not specified, shards are not merged',
+        default = None,
+        dest    = 'output',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--command',
+        help    = 'Worker command. Placeholders: {macro}, {filelist}, '
+                  '{output}, {shard}',
+        default = DEFAULT_COMMAND,
+        dest    = 'command',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--retries',
+        help    = 'Number of retries of a failed shard',
+        default = 1,
+        dest    = 'retries',
+        type    = int,
+    )
+
+    parser.add_argument(
+        '--no-resume',
+        help    = 'Rerun all shards, even those completed previously',
+        action  = 'store_false',
+        dest    = 'resume',
+    )
+
+    parser.add_argument(
+        '--progress-interval',
+        help    = 'Interval in seconds between progress reports',
+        default = 60,
+        dest    = 'progress_interval',
+        type    = float,
+    )
+
+    return parser
+
+def main():
+    # pylint: disable=missing-function-docstring
+    parser  = create_parser()
+    cmdargs = parser.parse_args()
+
+    setup_logging(logging.INFO)
+
+    files = list(cmdargs.input)
+    for path in cmdargs.file_list:
+        files += read_file_list(path)
+
+    if not files:
+        parser.error("No input files specified")
+
+    export = ShardedExport(
+        files, cmdargs.outdir, cmdargs.shards,
+        macro             = cmdargs.macro,
+        command           = cmdargs.command,
+        workers           = cmdargs.workers,
+        retries           = cmdargs.retries,
+        progress_interval = cmdargs.progress_interval,
+    )
+
+    export.run(resume = cmdargs.resume)
+
+    if cmdargs.output is not None:
+        print("Merging %d shards into %s" % (
+            len(export.shards), cmdargs.output
+        ))
+        export.merge(cmdargs.output)
+
+    print("Done")
+
+if __name__ == '__main__':
+    main()
@@ -6,7 +6,7 @@ from lstm_ee.presets       import PRESETS_EVAL
 from lstm_ee.utils.log     import setup_logging
 from lstm_ee.utils.parsers import add_basic_eval_args, add_concurrency_parser
 from lstm_ee.utils.eval    import standard_eval_prologue
-from lstm_ee.eval.eval     import evaluate
+from lstm_ee.eval.eval     import evaluate, evaluate_streaming
 from lstm_ee.plot.fom      import plot_fom
 
 FOM_FIT_MARGIN = 0.5
@@ -17,6 +17,16 @@ def parse_cmdargs():
     add_basic_eval_args(parser, PRESETS_EVAL)
     add_concurrency_parser(parser)
 
+    parser.add_argument(
+        '--streaming',
+        help    = (
+            'Accumulate stats batch by batch instead of keeping all energies'
+            ' in memory. The median of the resulting stats is approximate.'
+        ),
+        action  = 'store_true',
+        dest    = 'streaming',
+    )
+
     return parser.parse_args()
 
 def main():
@@ -28,12 +38,20 @@ def main():
         cmdargs, PRESETS_EVAL
     )
 
-    (stats_model_dict, hCont_model_dict), (stats_base_dict, hCont_base_dict) \
-        = evaluate(
+    if cmdargs.streaming:
+        result = evaluate_streaming(
+            dgen, model, eval_specs['base_map'], eval_specs['fom'],
+            FOM_FIT_MARGIN, outdir, cmdargs.workers
+        )
+    else:
+        result = evaluate(
             args, dgen, model, eval_specs['base_map'], eval_specs['fom'],
             FOM_FIT_MARGIN, outdir
         )
 
+    (stats_model_dict, hCont_model_dict), (stats_base_dict, hCont_base_dict) \
+        = result
+
     plot_fom(
         [
             (hCont_base_dict,  stats_base_dict,  'Base ', 'left',  'C0'),
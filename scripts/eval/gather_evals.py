@@ -1,11 +1,13 @@
 """Collect results of evals of different models into a single dataset"""
 
 import argparse
+import glob
 import json
 import os
 
 import pandas as pd
-from lstm_ee.args import Args
+from lstm_ee.args      import Args
+from lstm_ee.eval.eval import merge_fom_stats
 
 def parse_cmdargs():
     # pylint: disable=missing-function-docstring
@@ -13,7 +15,11 @@ def parse_cmdargs():
 
     parser.add_argument(
         '-s', '--stat-file', dest = 'stat_file', required = True, type = str,
-        help = 'File path inside MODELS directories where stats are stored'
+        help = (
+            'File path inside MODELS directories where stats are stored.'
+            ' Accumulators saved by the streaming evaluation (*.lbs) are'
+            ' merged over all files matching the path glob.'
+        )
     )
 
     parser.add_argument(
@@ -33,6 +39,17 @@ def parse_cmdargs():
 
     return parser.parse_args()
 
+def load_binned_stats(savedir, stat_file):
+    """Merge streaming evaluation accumulators `stat_file` of `savedir`"""
+    paths = sorted(glob.glob(os.path.join(savedir, stat_file)))
+
+    if not paths:
+        raise IOError("No stat files found: %s" % stat_file)
+
+    stats = merge_fom_stats(paths)
+
+    return [ { 'energy' : k, **v } for (k, v) in stats.items() ]
+
 def load_model_stats_list(models, stat_file, var_name):
     """Load evaluation stats for `models`"""
     stats_list = []
@@ -44,7 +61,11 @@ def load_model_stats_list(models, stat_file, var_name):
         try:
             args      = Args.load(savedir)
             stat_path = os.path.join(savedir, stat_file)
-            stats     = pd.read_csv(stat_path).to_dict(orient = 'records')
+
+            if stat_file.endswith('.lbs'):
+                stats = load_binned_stats(savedir, stat_file)
+            else:
+                stats = pd.read_csv(stat_path).to_dict(orient = 'records')
 
             var = args[var_name]
 
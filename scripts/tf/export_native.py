@@ -0,0 +1,132 @@
+"""Export `keras` model into a flat binary file for the native inference.
+
+The exported file can be evaluated without `keras` or `tensorflow` by the
+C++ engine `lstm_ee/inference/native/LSTMEEModel.h` (e.g. from CAFAna), or
+by `lstm_ee.inference.NativeModel` in python.
+"""
+
+import argparse
+import os
+import sys
+
+import numpy as np
+
+from lstm_ee.consts       import LABEL_PRIMARY, LABEL_TOTAL
+from lstm_ee.data         import load_data
+from lstm_ee.eval.predict import predict_energies
+from lstm_ee.inference    import NativeModel
+from lstm_ee.keras.export import export_flat_model
+from lstm_ee.utils.io     import load_model
+
+def create_parser():
+    """Create command line argument parser"""
+    parser = argparse.ArgumentParser(
+        "Export keras model for the native inference"
+    )
+
+    parser.add_argument(
+        'outdir',
+        help    = 'Directory with saved models',
+        metavar = 'OUTDIR',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '-o', '--output',
+        default = None,
+        dest    = 'output',
+        help    = 'Output file. Default: OUTDIR/native/model.bin',
+        type    = str,
+    )
+
+    parser.add_argument(
+        '--verify',
+        action = 'store_true',
+        dest   = 'verify',
+        help   = 'Compare native predictions to keras on validation sample',
+    )
+
+    parser.add_argument(
+        '--rtol',
+        default = 1e-4,
+        dest    = 'rtol',
+        help    = 'Relative tolerance of the verification',
+        type    = float,
+    )
+
+    parser.add_argument(
+        '--atol',
+        default = 1e-5,
+        dest    = 'atol',
+        help    = 'Absolute tolerance of the verification',
+        type    = float,
+    )
+
+    return parser
+
+def verify(args, model, path, rtol, atol):
+    """Compare predictions of `keras` and native models.
+
+    Returns
+    -------
+    bool
+        True if the predictions agree within tolerances `rtol` and `atol`
+        (c.f. `np.isclose`).
+    """
+    args.config.noise = None
+
+    _, dgen = load_data(args)
+
+    pred_keras  = predict_energies(args, dgen, model)
+    pred_native = NativeModel(path).predict_data_loader(dgen.data_loader)
+    result      = True
+
+    for label in [ LABEL_TOTAL, LABEL_PRIMARY ]:
+        if pred_keras[label] is None:
+            continue
+
+        diff = np.abs(pred_native[label] - pred_keras[label])
+        rel  = diff / np.maximum(np.abs(pred_keras[label]), 1e-6)
+
+        close = np.isclose(
+            pred_native[label], pred_keras[label],
+            rtol = rtol, atol = atol, equal_nan = True
+        )
+
+        print(
+            "%-8s : max abs diff = %.3e, max rel diff = %.3e, mismatches = %d"
+            % (label, np.nanmax(diff), np.nanmax(rel), np.sum(~close))
+        )
+
+        result = result and bool(np.all(close))
+
+    return result
+
+def main():
+    # pylint: disable=missing-function-docstring
+    parser  = create_parser()
+    cmdargs = parser.parse_args()
+
+    args, model = load_model(cmdargs.outdir, compile = False)
+    flat_model  = export_flat_model(args, model)
+
+    path = cmdargs.output
+    if path is None:
+        outdir_native = os.path.join(cmdargs.outdir, "native")
+        os.makedirs(outdir_native, exist_ok = True)
+        path = os.path.join(outdir_native, "model.bin")
+
+    flat_model.save(path)
+    print("Saved native model to '%s'" % path)
+
+    if cmdargs.verify and not verify(
+        args, model, path, cmdargs.rtol, cmdargs.atol
+    ):
+        print(
+            "Native predictions differ from keras (rtol = %g, atol = %g)"
+            % (cmdargs.rtol, cmdargs.atol)
+        )
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,170 @@
+"""Test synthetic datasets and the benchmark runner"""
+
+import json
+import tempfile
+import unittest
+
+import numpy as np
+
+from lstm_ee.bench import (
+    BENCHMARKS, BenchContext, compare_results, load_results, prepare_data,
+    run_benchmarks, save_results
+)
+from lstm_ee.data.data_loader import CSVLoader, ColumnarLoader, HDFLoader
+from lstm_ee.data.synthetic import make_synthetic_data, save_synthetic_data
+
+CONFIG = {
+    'vars_input_slice'   : [ 'calE', 'nHit' ],
+    'vars_input_png3d'   : [ 'png.dir.x', 'png.len', 'png.calE' ],
+    'vars_input_png2d'   : [ 'png2d.len', 'png2d.calE' ],
+    'var_target_total'   : 'trueE',
+    'var_target_primary' : 'trueLepE',
+}
+
+LOADERS = { 'csv' : CSVLoader, 'hdf' : HDFLoader, 'lcol' : ColumnarLoader }
+
+class TestsSyntheticData(unittest.TestCase):
+    """Test structure and round trip of the synthetic datasets"""
+
+    def setUp(self):
+        self._tmpdir = tempfile.TemporaryDirectory()
+        self._data   = make_synthetic_data(500, **CONFIG, max_prongs = 10)
+
+    def tearDown(self):
+        self._tmpdir.cleanup()
+
+    def test_structure(self):
+        """Test variables and prong multiplicities of the synthetic data"""
+        self.assertEqual(
+            set(self._data),
+            set(
+                  CONFIG['vars_input_slice'] + CONFIG['vars_input_png3d']
+                + CONFIG['vars_input_png2d']
+                + [ 'trueE', 'trueLepE', 'weight' ]
+            )
+        )
+
+        for prefix in [ 'png', 'png2d' ]:
+            lengths = np.array([ len(x) for x in self._data[prefix + '.len'] ])
+            others  = [ v for v in self._data if v.startswith(prefix + '.') ]
+
+            for var in others:
+                self.assertTrue(np.array_equal(
+                    [ len(x) for x in self._data[var] ], lengths
+                ))
+
+            self.assertTrue(np.all(lengths <= 10))
+
+        n_png3d = np.array([ len(x) for x in self._data['png.len'] ])
+        self.assertTrue(np.all(n_png3d >= 1))
+        self.assertTrue(np.all(self._data['trueLepE'] <= self._data['trueE']))
+
+    def test_seed(self):
+        """Test that synthetic data are reproducible"""
+        data = make_synthetic_data(500, **CONFIG, max_prongs = 10)
+
+        for (var, values) in data.items():
+            for (x, y) in zip(values, self._data[var]):
+                self.assertTrue(np.array_equal(x, y, equal_nan = True))
+
+    def test_round_trip(self):
+        """Test that synthetic data are saved in all formats without loss"""
+        for (fmt, loader) in LOADERS.items():
+            path = '%s/data.%s' % (self._tmpdir.name, fmt)
+            save_synthetic_data(self._data, path)
+
+            data_loader = loader(path)
+            self.assertEqual(len(data_loader), 500)
+
+            for (var, null) in self._data.items():
+                test = data_loader.get(var, None)
+
+                if null.dtype != object:
+                    self.assertTrue(np.array_equal(
+                        test.astype(np.float32), null, equal_nan = True
+                    ), (fmt, var))
+                    continue
+
+                for (x, y) in zip(test, null):
+                    self.assertTrue(
+                        np.array_equal(x, y, equal_nan = True), (fmt, var)
+                    )
+
+class TestsBenchmarks(unittest.TestCase):
+    """Test the benchmark runner and result comparison"""
+
+    def setUp(self):
+        self._tmpdir = tempfile.TemporaryDirectory()
+        self._paths  = prepare_data(self._tmpdir.name, CONFIG, 300)
+        self._ctx    = BenchContext(
+            self._paths, CONFIG, 300, batch_size = 64, workers = 1,
+            tmpdir = self._tmpdir.name
+        )
+
+    def tearDown(self):
+        self._tmpdir.cleanup()
+
+    def test_prepare_data_reuse(self):
+        """Test that synthetic dataset files are reused"""
+        paths = prepare_data(self._tmpdir.name, CONFIG, 300)
+        self.assertEqual(paths, self._paths)
+
+        paths = prepare_data(self._tmpdir.name, CONFIG, 200)
+        self.assertNotEqual(paths['lcol'], self._paths['lcol'])
+
+    def _check_results(self, results, benchmarks):
+        self.assertEqual(list(results['benchmarks']), benchmarks)
+        self.assertEqual(results['meta']['n_slices'], 300)
+
+        for (name, result) in results['benchmarks'].items():
+            self.assertIn(result['status'], [ 'ok', 'skipped' ], name)
+
+            if result['status'] == 'skipped':
+                continue
+
+            self.assertGreater(len(result['stages']), 0, name)
+            self.assertGreater(result['peak_rss_mb'], 0, name)
+
+            for stage in result['stages'].values():
+                self.assertEqual(stage['slices'], 300)
+                self.assertGreater(stage['slices_per_s'], 0)
+
+    def test_all_benchmarks(self):
+        """Test that all benchmarks run in isolated processes"""
+        results = run_benchmarks(self._ctx, BENCHMARKS)
+        self._check_results(results, list(BENCHMARKS))
+
+    def test_save_compare(self):
+        """Test saving of results and comparison against a baseline"""
+        benchmarks = [ 'load_columnar', 'data_generator' ]
+        results    = run_benchmarks(
+            self._ctx, { k : BENCHMARKS[k] for k in benchmarks },
+            repeat = 2, isolate = False
+        )
+        self._check_results(results, benchmarks)
+
+        path = '%s/results.json' % self._tmpdir.name
+        save_results(results, path)
+
+        with open(path, 'rt') as f:
+            self.assertEqual(json.load(f), json.loads(json.dumps(results)))
+
+        baseline = load_results(path)
+        changes  = compare_results(baseline, results)
+
+        self.assertTrue(changes)
+        self.assertFalse(any(x['regression'] for x in changes))
+
+        stage = baseline['benchmarks']['data_generator']['stages']['batches']
+        stage['seconds'] /= 2
+
+        changes = [
+            x for x in compare_results(baseline, results) if x['regression']
+        ]
+
+        self.assertEqual(len(changes), 1)
+        self.assertEqual(changes[0]['benchmark'], 'data_generator')
+        self.assertEqual(changes[0]['stage'], 'batches')
+
+if __name__ == '__main__':
+    unittest.main()
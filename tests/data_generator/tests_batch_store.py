@@ -0,0 +1,273 @@
+"""Test `BatchStore` and the caches built on top of it"""
+
+import os
+import pickle
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+from multiprocessing import Pool
+
+import numpy as np
+
+from lstm_ee.data.data_generator import (
+    DataBatchTransform, DataDiskCache, DataGenerator, DataNANMask, DataNoise,
+    MultiprocessedCache
+)
+from lstm_ee.data.data_generator.base.batch_store import BatchStore
+from lstm_ee.data.data_generator.base.multiprocessed_cache_base import (
+    _remove_owned_stores, remove_stale_stores
+)
+from lstm_ee.data.data_loader.dict_loader import DictLoader
+
+from .tests_batch_transform import make_random_data
+
+VARS_SLICE = [ 'slice0', 'slice1', 'slice2' ]
+VARS_PNG   = [ 'png0', 'png1', 'png2' ]
+
+def _put_batches(args):
+    path, n_batches, indices, batches = args
+    store = BatchStore(path, n_batches)
+
+    for index in indices:
+        store.put(index, batches[index])
+
+class UnusableGenerator:
+    """A DataGenerator stub that fails to generate batches"""
+
+    def __init__(self, n_batches):
+        self._n_batches = n_batches
+
+    def __len__(self):
+        return self._n_batches
+
+    def __getitem__(self, index):
+        raise RuntimeError("Batch %d was not cached" % index)
+
+class TestsBatchStore(unittest.TestCase):
+    """Test that batches survive saving into and loading from `BatchStore`"""
+
+    def setUp(self):
+        self._tmpdir = tempfile.mkdtemp()
+
+        data = make_random_data(1000, 3, 6, seed = 0)
+        data['target'] = data['slice0']
+
+        self._dgen = DataGenerator(
+            DictLoader(data),
+            batch_size       = 128,
+            max_prongs       = 4,
+            vars_input_slice = VARS_SLICE,
+            vars_input_png2d = VARS_PNG,
+            vars_input_png3d = VARS_PNG[::-1],
+            var_target_total = 'target',
+        )
+
+        self._batches = [ self._dgen[i] for i in range(len(self._dgen)) ]
+
+    def tearDown(self):
+        shutil.rmtree(self._tmpdir)
+
+    def _compare_batches(self, test, null):
+        self.assertEqual(len(test), len(null))
+
+        for (part_test, part_null) in zip(test[:2], null[:2]):
+            self.assertEqual(set(part_test.keys()), set(part_null.keys()))
+
+            for (label, values) in part_null.items():
+                self.assertEqual(part_test[label].shape, values.shape)
+                self.assertTrue(np.array_equal(
+                    part_test[label], values, equal_nan = True
+                ))
+
+        if len(null) > 2:
+            self.assertEqual(len(test[2]), len(null[2]))
+
+            for (w_test, w_null) in zip(test[2], null[2]):
+                self.assertTrue(np.array_equal(w_test, w_null))
+
+    def test_roundtrip(self):
+        """Test saving and loading batches in a random order"""
+        path  = os.path.join(self._tmpdir, 'store.lbs')
+        store = BatchStore(path, len(self._batches))
+
+        indices = np.random.RandomState(0).permutation(len(self._batches))
+
+        for index in indices[:3]:
+            store.put(index, self._batches[index])
+
+        self.assertIsNone(store.get(indices[3]))
+
+        for index in indices[3:]:
+            store.put(index, self._batches[index])
+
+        # Reopen store, to make sure nothing is held in memory only
+        store = BatchStore(path, len(self._batches))
+        store = pickle.loads(pickle.dumps(store))
+
+        for (index, batch) in enumerate(self._batches):
+            loaded = store.get(index)
+
+            self._compare_batches(loaded, batch)
+            self.assertFalse(loaded[0]['input_png3d'].flags.writeable)
+
+        with self.assertRaises(RuntimeError):
+            BatchStore(path, len(self._batches) + 1)
+
+    def test_interleaved_put_get(self):
+        """Test that a growing store is remapped a few times only"""
+        path      = os.path.join(self._tmpdir, 'store.lbs')
+        n_batches = 64
+        store     = BatchStore(path, n_batches)
+        mmaps     = []
+
+        for index in range(n_batches):
+            batch = self._batches[index % len(self._batches)]
+            store.put(index, batch)
+
+            self._compare_batches(store.get(index), batch)
+
+            # pylint: disable=protected-access
+            if not any(x is store._mmap for x in mmaps):
+                mmaps.append(store._mmap)
+
+        self.assertLessEqual(len(mmaps), 8)
+
+        store = BatchStore(path, n_batches)
+
+        for index in range(n_batches):
+            self._compare_batches(
+                store.get(index), self._batches[index % len(self._batches)]
+            )
+
+    def test_concurrent_put(self):
+        """Test that concurrent processes can fill the same store"""
+        path      = os.path.join(self._tmpdir, 'store.lbs')
+        n_batches = len(self._batches)
+
+        # Every batch is put by two processes
+        with Pool(4) as pool:
+            pool.map(_put_batches, [
+                (path, n_batches, range(i, n_batches, 2), self._batches)
+                    for i in [ 0, 1, 0, 1 ]
+            ])
+
+        store = BatchStore(path, n_batches)
+
+        for (index, batch) in enumerate(self._batches):
+            self._compare_batches(store.get(index), batch)
+
+    def test_disk_cache(self):
+        """Test `DataDiskCache` persistence between instances"""
+        cache = DataDiskCache(self._dgen, self._tmpdir, batch_size = 128)
+
+        for (index, batch) in enumerate(self._batches):
+            self._compare_batches(cache[index], batch)
+
+        # Decorated DataGenerator should not be used any more
+        cache = DataDiskCache(
+            UnusableGenerator(len(self._batches)), self._tmpdir,
+            batch_size = 128
+        )
+
+        for (index, batch) in enumerate(self._batches):
+            self._compare_batches(cache[index], batch)
+
+    def test_multiprocessed_cache(self):
+        """Test `MultiprocessedCache` batches and store cleanup"""
+        cache = MultiprocessedCache(self._dgen, 3, store_dir = self._tmpdir)
+
+        for (index, batch) in enumerate(self._batches):
+            self._compare_batches(cache[index], batch)
+
+        path = cache.store.path
+        self.assertTrue(os.path.exists(path))
+
+        del cache
+        self.assertFalse(os.path.exists(path))
+
+    def test_multiprocessed_cache_exit(self):
+        """Test that `MultiprocessedCache` store is removed at exit"""
+        cache = MultiprocessedCache(self._dgen, 2, store_dir = self._tmpdir)
+        _ = cache[0]
+
+        path = cache.store.path
+        self.assertTrue(os.path.exists(path))
+
+        # Called by atexit, even if `cache` is never destroyed
+        _remove_owned_stores()
+        self.assertFalse(os.path.exists(path))
+
+        del cache
+
+    def test_multiprocessed_cache_failure(self):
+        """Test that `MultiprocessedCache` does not keep incomplete store"""
+        cache = MultiprocessedCache(
+            UnusableGenerator(len(self._batches)), 2,
+            store_dir = self._tmpdir
+        )
+
+        # Failed precomputation must be retried, not return missing batches
+        for _ in range(2):
+            with self.assertRaises(RuntimeError):
+                _ = cache[0]
+
+            self.assertIsNone(cache.store)
+            self.assertEqual(os.listdir(self._tmpdir), [])
+
+    def test_remove_stale_stores(self):
+        """Test that stores of the dead processes are removed"""
+        proc = subprocess.Popen([ 'true' ])
+        proc.wait()
+
+        stale = os.path.join(
+            self._tmpdir, 'lstm_ee_batches_%d_test.lbs' % proc.pid
+        )
+        alive = os.path.join(
+            self._tmpdir, 'lstm_ee_batches_%d_test.lbs' % os.getpid()
+        )
+
+        for path in [ stale, alive ]:
+            with open(path, 'wb'):
+                pass
+
+        self.assertEqual(remove_stale_stores(self._tmpdir), [ stale ])
+        self.assertEqual(
+            os.listdir(self._tmpdir), [ os.path.basename(alive) ]
+        )
+
+        # Stale stores are removed before precomputing batches
+        os.rename(alive, stale)
+
+        cache = MultiprocessedCache(self._dgen, 2, store_dir = self._tmpdir)
+        _ = cache[0]
+
+        self.assertEqual(
+            os.listdir(self._tmpdir), [ os.path.basename(cache.store.path) ]
+        )
+
+    def test_inplace_decorators(self):
+        """Test that inplace decorators do not modify the stored batches"""
+        cache = MultiprocessedCache(self._dgen, 2, store_dir = self._tmpdir)
+
+        noise = {
+            'noise'               : 'uniform',
+            'noise_kwargs'        : { 'a' : -0.5, 'b' : 0.5 },
+            'affected_vars_png2d' : [ 'png0' ],
+        }
+
+        dgen_chain = DataNANMask(DataNoise(cache, **noise))
+        dgen_fused = DataBatchTransform(
+            cache, prong_sorters = { 'input_png3d' : '-png1' }, noise = noise
+        )
+
+        for dgen in [ dgen_chain, dgen_fused ]:
+            for index in range(len(self._batches)):
+                _ = dgen[index]
+
+        for (index, batch) in enumerate(self._batches):
+            self._compare_batches(cache[index], batch)
+
+if __name__ == '__main__':
+    unittest.main()
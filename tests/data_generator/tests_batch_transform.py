@@ -0,0 +1,172 @@
+"""Test correctness of the fused batch kernels and `DataBatchTransform`"""
+
+import multiprocessing
+import unittest
+import numpy as np
+
+from lstm_ee.data.data_generator import (
+    DataBatchTransform, DataNANMask, DataNoise, DataProngSorter
+)
+from lstm_ee.data.data_generator.funcs import funcs_varr
+from lstm_ee.data.data_loader.data_shuffle import DataShuffle
+from lstm_ee.data.data_loader.funcs.funcs_csr import gather_csr
+
+from .tests_data_generator_base import (
+    DataGenerator, DictLoader, TestsDataGeneratorBase
+)
+
+def make_random_data(n_rows, n_vars, max_prongs, seed):
+    """Create random dataset with variable number of prongs"""
+    prg  = np.random.RandomState(seed)
+    data = {}
+
+    n_prongs = prg.randint(0, max_prongs + 1, size = n_rows)
+
+    for var_idx in range(n_vars):
+        data['slice%d' % var_idx] = list(prg.normal(size = n_rows))
+
+        data['png%d' % var_idx] = [
+            prg.normal(size = n).astype(np.float32) for n in n_prongs
+        ]
+
+    return data
+
+# DataGenerator inherited by the forked workers
+_FORKED_DGEN = None
+
+def _get_forked_batch(index):
+    return _FORKED_DGEN[index][0]
+
+class CSRDictLoader(DictLoader):
+    """`DictLoader` that pretends to hold data in CSR form"""
+
+    @property
+    def has_csr(self):
+        return True
+
+    def get_csr(self, var, index = None):
+        return gather_csr(
+            *super(CSRDictLoader, self).get_csr(var, None), index
+        )
+
+class TestsBatchTransform(TestsDataGeneratorBase, unittest.TestCase):
+    """Test fused batch kernels against the chain of decorators"""
+
+    VARS_SLICE = [ 'slice0', 'slice1', 'slice2' ]
+    VARS_PNG   = [ 'png0', 'png1', 'png2' ]
+
+    def setUp(self):
+        self._workers = funcs_varr.WORKERS
+        self._min_row = funcs_varr.MIN_PARALLEL_ROWS
+
+        funcs_varr.WORKERS           = 4
+        funcs_varr.MIN_PARALLEL_ROWS = 16
+
+    def tearDown(self):
+        funcs_varr.WORKERS           = self._workers
+        funcs_varr.MIN_PARALLEL_ROWS = self._min_row
+
+    def _make_dgen(self, data_loader, max_prongs = None):
+        return DataGenerator(
+            data_loader,
+            batch_size       = 100,
+            max_prongs       = max_prongs,
+            vars_input_slice = self.VARS_SLICE,
+            vars_input_png2d = self.VARS_PNG,
+            vars_input_png3d = self.VARS_PNG[::-1],
+        )
+
+    def _collect_batches(self, dgen, seed):
+        np.random.seed(seed)
+        return [ dgen[i][0] for i in range(len(dgen)) ]
+
+    def test_csr_join(self):
+        """Test that CSR join produces the same batches as varr join"""
+        data = make_random_data(250, 3, 12, 1)
+
+        for max_prongs in [ None, 0, 5 ]:
+            null = self._collect_batches(
+                self._make_dgen(DataShuffle(DictLoader(data), 3), max_prongs), 0
+            )
+            dgen = self._make_dgen(
+                DataShuffle(CSRDictLoader(data), 3), max_prongs
+            )
+
+            self._compare_dgen_to_batch_data(dgen, null)
+
+    def test_fused_transform(self):
+        """Test that `DataBatchTransform` matches the chain of decorators"""
+        data  = make_random_data(250, 3, 12, 2)
+        noise = [
+            {
+                'noise'               : 'uniform',
+                'noise_kwargs'        : { 'a' : -0.2, 'b' : 0.2 },
+                'affected_vars_slice' : [ 'slice0', 'slice2' ],
+                'affected_vars_png3d' : [ 'png1' ],
+            },
+            {
+                'noise'               : 'gaussian',
+                'noise_kwargs'        : { 'mu' : 0, 'sigma' : 0.1 },
+                'affected_vars_png2d' : [ 'png0', 'png2' ],
+            },
+        ]
+        sorters = { 'input_png2d' : '+png1', 'input_png3d' : '-png0' }
+
+        dgen_null = self._make_dgen(DictLoader(data), 7)
+        for k,v in sorters.items():
+            dgen_null = DataProngSorter(
+                dgen_null, v, k,
+                self.VARS_PNG if k == 'input_png2d' else self.VARS_PNG[::-1]
+            )
+        for n in noise:
+            dgen_null = DataNoise(dgen_null, **n)
+        dgen_null = DataNANMask(dgen_null)
+
+        dgen_test = DataBatchTransform(
+            self._make_dgen(DictLoader(data), 7), sorters, noise
+        )
+
+        null = self._collect_batches(dgen_null, 5)
+        test = self._collect_batches(dgen_test, 5)
+
+        for (batch_test, batch_null) in zip(test, null):
+            for k in batch_null:
+                self.assertFalse(np.any(np.isnan(batch_test[k])))
+                self.assertTrue(np.allclose(batch_test[k], batch_null[k]))
+
+    def test_fork_after_parallel_join(self):
+        """Test that forked workers do not reuse the parent thread pool"""
+        # pylint: disable=global-statement
+        global _FORKED_DGEN
+
+        _FORKED_DGEN = self._make_dgen(CSRDictLoader(make_random_data(
+            250, 3, 12, 3
+        )))
+
+        # Create thread pool in the parent
+        null = [ _FORKED_DGEN[i][0] for i in range(len(_FORKED_DGEN)) ]
+
+        with multiprocessing.get_context('fork').Pool(2) as pool:
+            test = pool.map_async(
+                _get_forked_batch, range(len(_FORKED_DGEN))
+            ).get(timeout = 60)
+
+        _FORKED_DGEN = None
+
+        for (batch_test, batch_null) in zip(test, null):
+            for k in batch_null:
+                self.assertTrue(np.array_equal(
+                    batch_test[k], batch_null[k], equal_nan = True
+                ))
+
+    def test_unsupported_sorter(self):
+        """Test that randomized prong order is rejected"""
+        self.assertFalse(
+            DataBatchTransform.supports({ 'input_png2d' : 'random' })
+        )
+        self.assertTrue(
+            DataBatchTransform.supports({ 'input_png2d' : '-png0' })
+        )
+
+if __name__ == '__main__':
+    unittest.main()
@@ -7,6 +7,7 @@ from lstm_ee.data.data_generator.funcs.weights  import (
 )
 
 from lstm_ee.data.data_loader.dict_loader import DictLoader
+from lstm_ee.data.data                    import get_weight_variables
 
 from ..data import nan_equal
 
@@ -125,6 +126,18 @@ class TestsWeights(unittest.TestCase):
 
         self.assertTrue(nan_equal(weights_test, weights_null))
 
+    def test_weight_variables(self):
+        """Test that variables used by the weights are found"""
+        self.assertEqual(get_weight_variables(None), [])
+        self.assertEqual(get_weight_variables('weight'), [ 'weight' ])
+        self.assertEqual(get_weight_variables({ 'name' : 'flat' }), [ 'trueE' ])
+        self.assertEqual(
+            get_weight_variables(
+                { 'name' : 'flat', 'kwargs' : { 'var' : 'trueLepE' } }
+            ),
+            [ 'trueLepE' ]
+        )
+
 if __name__ == '__main__':
     unittest.main()
 
@@ -0,0 +1,68 @@
+"""Test correctness of columnar files parsing with `ColumnarLoader`"""
+
+import os
+import pickle
+import unittest
+import tempfile
+
+import numpy as np
+
+from lstm_ee.data.data_loader.dict_loader     import DictLoader
+from lstm_ee.data.data_loader.columnar_loader import (
+    ColumnarLoader, save_columnar
+)
+from .tests_data_loader_base import TestsDataLoaderBase
+
+class TestsColumnarLoader(TestsDataLoaderBase, unittest.TestCase):
+    """Test `ColumnarLoader` data parsing"""
+
+    def __init__(self, *args, **kwargs):
+        unittest.TestCase.__init__(self, *args, **kwargs)
+        TestsDataLoaderBase.__init__(self)
+
+        self._to_cleanup = []
+
+    def __del__(self):
+        for fname in self._to_cleanup:
+            os.unlink(fname)
+
+    def _create_data_loader(self, data):
+
+        with tempfile.NamedTemporaryFile('wb', delete = False) as f:
+            fname = f.name
+            self._to_cleanup.append(fname)
+
+        save_columnar(fname, DictLoader(data))
+
+        return ColumnarLoader(fname)
+
+    def test_csr(self):
+        """Test correctness of CSR representation of varr variables"""
+        data        = { 'var' : [ [1, 2], [], [3], [4,5,6,7], [-1] ] }
+        data_loader = self._create_data_loader(data)
+
+        offsets, values = data_loader.get_csr('var')
+        self.assertEqual(list(offsets), [ 0, 2, 2, 3, 7, 8 ])
+        self.assertEqual(list(values), [ 1, 2, 3, 4, 5, 6, 7, -1 ])
+
+        offsets, values = data_loader.get_csr('var', [ 3, 1, 0 ])
+        self.assertEqual(list(offsets), [ 0, 4, 4, 6 ])
+        self.assertEqual(list(values), [ 4, 5, 6, 7, 1, 2 ])
+
+    def test_pickle(self):
+        """Test that `ColumnarLoader` survives pickling"""
+        data        = { 'x' : [ 1, 2, 3 ], 'y' : [ [1], [], [2, 3] ] }
+        original    = self._create_data_loader(data)
+        data_loader = pickle.loads(pickle.dumps(original))
+
+        self._compare_scalar_vars(data, data_loader, 'x')
+        self._compare_varr_vars(data, data_loader, 'y', np.array([ 2, 0 ]))
+
+        # Pickling must not unmap the original loader
+        # pylint: disable=protected-access
+        self.assertIsNotNone(original._mmap)
+        self.assertIsNotNone(original._columns)
+        self._compare_varr_vars(data, original, 'y')
+
+if __name__ == '__main__':
+    unittest.main()
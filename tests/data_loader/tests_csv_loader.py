@@ -1,10 +1,17 @@
 """Test correctness of custom csv files parsing with `CSVLoader`"""
 
 import io
+import os
+import pickle
+import tempfile
 import unittest
 
-from lstm_ee.data.data_loader.csv_loader import CSVLoader
+import numpy as np
 
+from lstm_ee.data.data_loader.csv_loader      import CSVLoader
+from lstm_ee.data.data_loader.funcs.funcs_csv import parse_csv
+
+from ..data                  import nan_equal
 from .tests_data_loader_base import TestsDataLoaderBase
 
 def create_csv_data_str(data):
@@ -38,6 +45,98 @@ class TestsCSVLoader(TestsDataLoaderBase, unittest.TestCase):
         csv_data = create_csv_data_str(data)
         return CSVLoader(csv_data)
 
+    def test_variables_selection(self):
+        """Test that unselected variables are parsed on demand"""
+        data = {
+            'x' : [ 1, 2, 3 ],
+            'y' : [ [1], [], [2, 3] ],
+            'z' : [ 4, 5, 6 ],
+        }
+        data_loader = CSVLoader(create_csv_data_str(data), [ 'y' ])
+
+        self.assertEqual(data_loader.variables(), [ 'x', 'y', 'z' ])
+        self._compare_varr_vars(data, data_loader, 'y')
+        self._compare_scalar_vars(data, data_loader, 'z', [ 2, 0 ])
+
+    def test_chunked_parsing(self):
+        """Test that parsing does not depend on the chunk size"""
+        csv_data = 'x,y\n1,"1,2"\n,""\n3,"4, 5,6"\n4,nan\n'
+
+        null = parse_csv(io.StringIO(csv_data), workers = 1)
+
+        for chunk_size in [ 1, 3, 7, 1024 ]:
+            test = parse_csv(
+                io.StringIO(csv_data), workers = 4, chunk_size = chunk_size
+            )
+
+            self.assertEqual(test[0], [ 'x', 'y' ])
+            self.assertEqual(test[1], 4)
+
+            self.assertTrue(nan_equal(test[2]['x'][0], null[2]['x'][0]))
+            self.assertTrue(nan_equal(test[2]['y'][0], [ 1, 2, 4, 5, 6, np.nan ]))
+            self.assertTrue(nan_equal(test[2]['y'][1], [ 0, 2, 2, 5, 6 ]))
+
+    def test_non_numeric_values(self):
+        """Test that values that are not numbers are reported"""
+        for (csv_data, message) in [
+            ('x,y\n1,2\n3,abc\n',        "line 3, column 'y': 'abc'"),
+            ('x,y\n1,"1, 2x"\n3,"4"\n',  "line 2, column 'y': '2x'"),
+            ('x,y\n1,2\n3,4\n5 6,7\n',   "line 4, column 'x': '5 6'"),
+        ]:
+            for chunk_size in [ 1, 1024 ]:
+                with self.assertRaises(ValueError) as ctx:
+                    parse_csv(
+                        io.StringIO(csv_data), workers = 2,
+                        chunk_size = chunk_size
+                    )
+
+                self.assertIn(message, str(ctx.exception))
+
+        # Unselected columns are not parsed
+        test = parse_csv(io.StringIO('x,y\n1,abc\n'), [ 'x' ])
+        self.assertTrue(nan_equal(test[2]['x'][0], [ 1 ]))
+
+    def test_single_prong_column(self):
+        """Test that quoted column with at most one prong per row is varr"""
+        csv_data = 'x,png\n1,"1.5"\n2,""\n3,"nan"\n'
+
+        data_loader = CSVLoader(io.StringIO(csv_data))
+        offsets, values = data_loader.get_csr('png', np.arange(3))
+
+        self.assertTrue(np.array_equal(offsets, [ 0, 1, 1, 2 ]))
+        self.assertTrue(nan_equal(values, [ 1.5, np.nan ]))
+
+        result = data_loader.get('png')
+
+        self.assertEqual([ len(x) for x in result ], [ 1, 0, 1 ])
+        self.assertTrue(nan_equal(result[0], [ 1.5 ]))
+        self.assertTrue(nan_equal(result[2], [ np.nan ]))
+
+        x = data_loader.get('x')
+        self.assertTrue(nan_equal(x, [ 1, 2, 3 ]))
+
+    def test_pickle(self):
+        """Test that pickling keeps parsed data of the original loader"""
+        data = { 'x' : [ 1, 2, 3 ], 'y' : [ [1], [], [2, 3] ] }
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            path = os.path.join(tmpdir, 'data.csv')
+
+            with open(path, 'w') as f:
+                f.write(create_csv_data_str(data).getvalue())
+
+            original    = CSVLoader(path)
+            data_loader = pickle.loads(pickle.dumps(original))
+
+            # pylint: disable=protected-access
+            self.assertIsNone(data_loader._data)
+            self.assertIsNotNone(original._data)
+            self.assertIsNotNone(original._lock)
+
+            self._compare_scalar_vars(data, data_loader, 'x')
+            self._compare_varr_vars(data, data_loader, 'y', np.array([ 2, 0 ]))
+            self._compare_varr_vars(data, original, 'y')
+
 if __name__ == '__main__':
     unittest.main()
 
@@ -1,6 +1,7 @@
 """Test correctness of hdf files parsing with `HDFLoader`"""
 
 import os
+import pickle
 import unittest
 import tempfile
 
@@ -8,6 +9,7 @@ import tables
 import numpy as np
 
 from lstm_ee.data.data_loader.hdf_loader import HDFLoader
+from lstm_ee.data.data_loader.data_shuffle import DataShuffle
 from .tests_data_loader_base import TestsDataLoaderBase
 
 def create_hdf_data_bytes(fname, data):
@@ -54,6 +56,149 @@ class TestsHDFLoader(TestsDataLoaderBase, unittest.TestCase):
 
         return HDFLoader(fname)
 
+class TestsHDFLoaderSmallBlocks(TestsHDFLoader):
+    """Test `HDFLoader` data parsing when rows span multiple blocks"""
+    # pylint: disable=protected-access
+
+    def _create_data_loader(self, data):
+        loader = super(TestsHDFLoaderSmallBlocks, self)._create_data_loader(
+            data
+        )
+
+        return HDFLoader(loader._fname, chunk_cache_size = 16, block_rows = 2)
+
+class TestsHDFLoaderChunked(unittest.TestCase):
+    """Test random access to the chunked hdf files with `HDFLoader`"""
+    # pylint: disable=protected-access
+
+    def setUp(self):
+        prg = np.random.RandomState(0)
+
+        self._n      = 1000
+        self._scalar = prg.normal(size = self._n).astype(np.float32)
+        self._varr   = [
+            prg.normal(size = prg.randint(0, 5)).astype(np.float32)
+                for _ in range(self._n)
+        ]
+
+        with tempfile.NamedTemporaryFile('wb', delete = False) as f:
+            self._fname = f.name
+
+        f = tables.open_file(self._fname, 'w')
+        filters = tables.Filters(complevel = 1)
+
+        f.create_carray(
+            '/', 'scalar', obj = self._scalar,
+            chunkshape = (64, ), filters = filters
+        )
+        node = f.create_vlarray(
+            '/', 'varr', tables.Float32Atom(shape = ()),
+            chunkshape = 32, filters = filters
+        )
+
+        for x in self._varr:
+            node.append(x)
+
+        f.close()
+
+    def tearDown(self):
+        os.unlink(self._fname)
+
+    def _compare(self, loader, index):
+        self.assertTrue(np.array_equal(
+            loader.get('scalar', index), self._scalar[index]
+        ))
+
+        offsets, values = loader.get_csr('varr', index)
+        self.assertEqual(len(offsets), len(index) + 1)
+
+        for (i, row) in enumerate(index):
+            self.assertTrue(np.array_equal(
+                values[offsets[i]:offsets[i+1]], self._varr[row]
+            ))
+
+    def test_random_access(self):
+        """Test that rows are returned in the requested order"""
+        loader = HDFLoader(self._fname, block_rows = 100)
+        prg    = np.random.RandomState(1)
+
+        self.assertTrue(loader.has_csr)
+
+        for _ in range(10):
+            index = prg.randint(0, self._n, size = 100)
+            self._compare(loader, index)
+
+        self._compare(loader, np.arange(self._n)[::-1])
+        self._compare(loader, np.array([], dtype = int))
+
+        self.assertTrue(np.array_equal(loader.get('varr', 5), self._varr[5]))
+
+    def test_cache_limit(self):
+        """Test that data are correct when cache cannot hold all blocks"""
+        loader = HDFLoader(
+            self._fname, chunk_cache_size = 1024, block_rows = 64
+        )
+
+        index = np.random.RandomState(2).permutation(self._n)
+        self._compare(loader, index)
+        self._compare(loader, index[::-1])
+
+        self.assertLessEqual(len(loader._cache), 2)
+
+    def test_sparse_access(self):
+        """Test direct reads of the rows that are sparse within blocks"""
+        loader = HDFLoader(self._fname, block_rows = 256, sparse_ratio = 64)
+        index  = np.array([ 900, 3, 517, 3, 260 ])
+
+        self._compare(loader, index)
+        self._compare(loader, index[:1])
+
+        # Sparse rows are read bypassing the cache, and are not prefetched
+        self.assertEqual(len(loader._cache), 0)
+
+        loader.prefetch(index)
+        self.assertIsNone(loader._executor)
+
+        # Dense rows are read by blocks
+        self._compare(loader, np.concatenate((index, np.arange(8))))
+        self.assertEqual(len(loader._cache), 2)
+
+        # Rows of the cached blocks are taken from the cache
+        self._compare(loader, np.array([ 5, 1 ]))
+        self.assertEqual(len(loader._cache), 2)
+
+        loader = HDFLoader(self._fname, block_rows = 256, sparse_ratio = None)
+        self._compare(loader, index)
+        self.assertEqual(len(loader._cache), 2 * 4)
+
+    def test_prefetch(self):
+        """Test read-ahead of rows through `DataShuffle`"""
+        loader  = HDFLoader(self._fname, block_rows = 64)
+        dloader = DataShuffle(loader, seed = 3)
+
+        # Nothing to read ahead before any variable is used
+        dloader.prefetch(np.arange(10))
+        self.assertEqual(len(loader._cache), 0)
+
+        _ = dloader.get('varr', np.arange(1))
+
+        dloader.prefetch(np.arange(self._n))
+        loader._executor.shutdown(wait = True)
+
+        n_blocks = -(-self._n // loader._block_rows['varr'])
+        self.assertEqual(len(loader._cache), n_blocks)
+
+    def test_pickle(self):
+        """Test that `HDFLoader` can be used after unpickling"""
+        loader = HDFLoader(self._fname, block_rows = 64)
+        index  = np.random.RandomState(4).randint(0, self._n, size = 100)
+
+        self._compare(loader, index)
+        loader.prefetch(index)
+
+        loader = pickle.loads(pickle.dumps(loader))
+        self._compare(loader, index)
+
 if __name__ == '__main__':
     unittest.main()
 
@@ -0,0 +1,218 @@
+"""Test streaming binned statistics against the in-memory calculation"""
+
+import os
+import pickle
+import tempfile
+import unittest
+
+import numpy as np
+
+from lstm_ee.eval.binned_stats import (
+    BinnedStats, BinnedStatsSet, calc_binned_stats, merge_binned_stats
+)
+from lstm_ee.eval.stats import calc_all_stats, calc_stat
+
+STATS = [ 'mean', 'rms', 'std', 'stderr', 'median' ]
+
+def make_data(n, seed = 0):
+    """Create random (x, y, weights) data"""
+    prg = np.random.RandomState(seed)
+
+    x = prg.uniform(-1, 5, size = n)
+    y = prg.normal(size = n) * (1 + np.abs(x))
+    w = prg.uniform(0.5, 2, size = n)
+
+    return (x, y, w)
+
+def calc_null_binned_stats(x, y, weights, bins_x, stat):
+    """Calculate binned statistics in memory, without `BinnedStats`"""
+    bin_idx = np.digitize(x, bins = bins_x)
+
+    return np.array([
+        calc_stat(y[bin_idx == i], weights[bin_idx == i], stat)
+            for i in range(1, len(bins_x))
+    ])
+
+class TestsBinnedStats(unittest.TestCase):
+    """Test `BinnedStats` accumulation, merging and serialization"""
+
+    def setUp(self):
+        self._bins = np.linspace(0, 4, 9)
+        self._data = make_data(20000)
+
+    def _compare(self, stats, x, y, w):
+        for stat in STATS:
+            null = calc_null_binned_stats(x, y, w, self._bins, stat)
+            test = stats.get_stat(stat)
+
+            # Quantiles are estimated by sketches
+            atol = 0.05 if stat == 'median' else 1e-10
+
+            self.assertTrue(np.allclose(test, null, atol = atol), stat)
+            self.assertTrue(np.isclose(
+                stats.get_total_stat(stat), calc_stat(y, w, stat),
+                atol = atol
+            ), stat)
+
+    def test_single_chunk(self):
+        """Test statistics accumulated from a single chunk"""
+        stats = BinnedStats(self._bins)
+        stats.fill(*self._data)
+
+        self._compare(stats, *self._data)
+        self.assertTrue(np.allclose(
+            stats.get_stat('sum_w'),
+            np.histogram(self._data[0], self._bins, weights = self._data[2])[0]
+        ))
+
+    def test_chunks_and_threads(self):
+        """Test that statistics do not depend on the chunking and threads"""
+        x, y, w = self._data
+        stats   = BinnedStats(self._bins, workers = 1)
+
+        for start in range(0, len(x), 3000):
+            stats.fill(
+                x[start:start + 3000], y[start:start + 3000],
+                w[start:start + 3000]
+            )
+
+        self._compare(stats, x, y, w)
+
+        x, y, w = make_data(200000, seed = 1)
+
+        stats_serial   = BinnedStats(self._bins, workers = 1)
+        stats_parallel = BinnedStats(self._bins, workers = 4)
+
+        stats_serial.fill(x, y, w)
+        stats_parallel.fill(x, y, w)
+
+        for stat in [ 'mean', 'rms', 'std', 'stderr' ]:
+            self.assertTrue(np.allclose(
+                stats_serial.get_stat(stat), stats_parallel.get_stat(stat)
+            ))
+
+    def test_merge(self):
+        """Test merging of partial results"""
+        x, y, w = self._data
+        half    = len(x) // 2
+
+        stats = BinnedStats(self._bins)
+        other = BinnedStats(self._bins)
+
+        stats.fill(x[:half], y[:half], w[:half])
+        other.fill(x[half:], y[half:], w[half:])
+
+        stats += pickle.loads(pickle.dumps(other))
+        self._compare(stats, x, y, w)
+
+        with self.assertRaises(ValueError):
+            stats.merge(BinnedStats(self._bins[:-1]))
+
+    def test_all_stats(self):
+        """Test total statistics against `calc_all_stats`"""
+        stats = BinnedStats(self._bins)
+        stats.fill(*self._data)
+
+        null = calc_all_stats(self._data[1], self._data[2])
+        test = stats.get_all_stats()
+
+        self.assertEqual(set(test.keys()), set(null.keys()))
+
+        for (k, v) in null.items():
+            atol = 0.05 if k == 'median' else 1e-10
+            self.assertTrue(np.isclose(test[k], v, atol = atol), k)
+
+    def test_empty_and_invalid(self):
+        """Test handling of empty bins and invalid values"""
+        stats = BinnedStats([ 0, 1, 2 ])
+        stats.fill([ 0.5, 0.5, np.nan, 0.5 ], [ 1, 3, 5, np.inf ])
+
+        self.assertTrue(np.allclose(stats.get_stat('mean')[0], 2))
+        self.assertTrue(np.isnan(stats.get_stat('mean')[1]))
+        self.assertTrue(np.isnan(stats.get_stat('median')[1]))
+
+    def test_non_positive_weights(self):
+        """Test that non-positive weights contribute to the moments"""
+        x, y, w = self._data
+        w = w - 0.7
+
+        stats = BinnedStats(self._bins)
+        stats.fill(x, y, w)
+
+        for stat in [ 'mean', 'rms', 'stderr' ]:
+            null = calc_null_binned_stats(x, y, w, self._bins, stat)
+
+            self.assertTrue(np.allclose(stats.get_stat(stat), null), stat)
+            self.assertTrue(np.isclose(
+                stats.get_total_stat(stat), calc_stat(y, w, stat)
+            ), stat)
+
+        self.assertTrue(np.allclose(
+            stats.get_stat('sum_w'), np.histogram(x, self._bins, weights = w)[0]
+        ))
+
+    def test_calc_binned_stats(self):
+        """Test that `calc_binned_stats` calculates exact statistics"""
+        x, y, w = self._data
+        w = w - 0.7
+
+        for stat in STATS:
+            self.assertTrue(np.array_equal(
+                calc_binned_stats(x, y, w, self._bins, stat),
+                calc_null_binned_stats(x, y, w, self._bins, stat),
+                equal_nan = True
+            ), stat)
+
+    def test_stats_set(self):
+        """Test saving and merging of `BinnedStatsSet` files"""
+        bins  = { 'total' : self._bins, 'primary' : self._bins[::2] }
+        x, y, w = self._data
+        paths   = []
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            for (idx, start) in enumerate(range(0, len(x), 5000)):
+                chunk = slice(start, start + 5000)
+                stats = BinnedStatsSet(bins)
+
+                stats.fill({
+                    'total'   : (x[chunk], y[chunk]),
+                    'primary' : (x[chunk], 2 * y[chunk]),
+                }, w[chunk])
+
+                paths.append(os.path.join(tmpdir, 'stats_%d.lbs' % idx))
+                stats.save(paths[-1])
+
+            stats = merge_binned_stats(paths)
+
+        self.assertEqual(set(stats), set(bins))
+        self._compare(stats['total'], x, y, w)
+
+        self.assertTrue(np.allclose(
+            stats['primary'].get_stat('mean'),
+            calc_null_binned_stats(x, 2 * y, w, self._bins[::2], 'mean')
+        ))
+
+    def test_stats_set_single_pass(self):
+        """Test that combined fill of `BinnedStatsSet` matches single fills"""
+        x, y, w = make_data(200000, seed = 2)
+
+        stats_set = BinnedStatsSet(
+            { 'a' : self._bins, 'b' : self._bins[::2] }, workers = 4
+        )
+        stats_set.fill({ 'a' : (x, y), 'b' : (y, x) }, w)
+
+        for (k, (x_null, y_null)) in [ ('a', (x, y)), ('b', (y, x)) ]:
+            null = BinnedStats(stats_set[k].bins_x, workers = 1)
+            null.fill(x_null, y_null, w)
+
+            for stat in [ 'mean', 'rms', 'std', 'stderr', 'sum_w' ]:
+                self.assertTrue(np.allclose(
+                    stats_set[k].get_stat(stat), null.get_stat(stat),
+                    equal_nan = True
+                ), stat)
+
+        with self.assertRaises(ValueError):
+            stats_set.fill({ 'a' : (x, y[:-1]) }, w)
+
+if __name__ == '__main__':
+    unittest.main()
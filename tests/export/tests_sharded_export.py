@@ -0,0 +1,204 @@
+"""Test sharding, resume and deterministic merge of `ShardedExport`"""
+
+import json
+import os
+import shlex
+import shutil
+import sys
+import tempfile
+import unittest
+
+import numpy as np
+
+from lstm_ee.data.data_loader.columnar_loader import ColumnarLoader
+from lstm_ee.data.sharded_export import ShardedExport, split_shards
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__)
+)))
+
+# Stand-in for an exporter macro: each input "CAF" file is a json list of
+# slices. Slices are exported in the file list order, like CAFAna does.
+WORKER = """
+import json, os, sys
+sys.path.insert(0, %(root)r)
+
+from lstm_ee.data.data_loader.dict_loader     import DictLoader
+from lstm_ee.data.data_loader.columnar_loader import save_columnar
+
+with open(os.environ['LSTM_EE_EXPORT_FILELIST']) as f:
+    files = [ x.strip() for x in f if x.strip() ]
+
+if any(os.path.exists(x + '.fail') for x in files):
+    sys.exit(1)
+
+with open(%(calls)r, 'a') as f:
+    f.write(sys.argv[1] + '\\n')
+
+# Macro (if any) defines a scale of the exported 'x' values
+scale = 1
+if len(sys.argv) > 2:
+    with open(sys.argv[2]) as f:
+        scale = float(f.read().split('SCALE')[1].split()[0])
+
+data = { 'x' : [], 'png' : [] }
+for fname in files:
+    with open(fname) as f:
+        for (x, png) in json.load(f):
+            data['x'].append(scale * x)
+            data['png'].append(png)
+
+save_columnar(os.environ['LSTM_EE_EXPORT_OUTPUT'], DictLoader(data))
+"""
+
+class TestsShardedExport(unittest.TestCase):
+    """Test `ShardedExport` with a stand-in worker over local files"""
+
+    def setUp(self):
+        self._tmpdir = tempfile.mkdtemp()
+        self._calls  = os.path.join(self._tmpdir, 'calls')
+        self._files  = []
+        self._slices = []
+
+        prng = np.random.default_rng(0)
+
+        for idx in range(11):
+            slices = [
+                (float(prng.normal()), prng.normal(size = n).tolist())
+                for n in prng.integers(0, 4, size = prng.integers(0, 5))
+            ]
+
+            fname = os.path.join(self._tmpdir, 'caf_%02d.json' % idx)
+            with open(fname, 'wt') as f:
+                json.dump(slices, f)
+
+            self._files.append(fname)
+            self._slices += slices
+
+        worker = os.path.join(self._tmpdir, 'worker.py')
+        with open(worker, 'wt') as f:
+            f.write(WORKER % { 'root' : REPO_ROOT, 'calls' : self._calls })
+
+        self._command = '%s %s {shard}' % (
+            shlex.quote(sys.executable), shlex.quote(worker)
+        )
+
+    def tearDown(self):
+        shutil.rmtree(self._tmpdir)
+
+    def _export(self, n_shards, files = None, macro = None):
+        command = self._command
+
+        if macro is not None:
+            command += ' {macro}'
+
+        return ShardedExport(
+            files or self._files, os.path.join(self._tmpdir, 'out'),
+            n_shards, macro = macro, command = command, workers = 3
+        )
+
+    def _calls_list(self):
+        with open(self._calls, 'rt') as f:
+            result = [ int(x) for x in f if x.strip() ]
+
+        os.remove(self._calls)
+        return sorted(result)
+
+    def _check_merged(self, path, scale = 1):
+        data_loader = ColumnarLoader(path)
+
+        self.assertEqual(len(data_loader), len(self._slices))
+        self.assertTrue(np.allclose(
+            data_loader.get('x'), [ scale * x for (x, _) in self._slices ]
+        ))
+
+        for (row, (_, png)) in zip(data_loader.get('png'), self._slices):
+            self.assertTrue(np.allclose(row, png))
+
+    def test_split_shards(self):
+        """Test that shards are contiguous and balanced"""
+        files  = list(range(11))
+        shards = split_shards(files, 4)
+
+        self.assertEqual(sum(shards, []), files)
+        self.assertEqual([ len(x) for x in shards ], [ 2, 3, 3, 3 ])
+        self.assertEqual(len(split_shards(files, 20)), 11)
+
+    def test_merge_order(self):
+        """Test that merged output does not depend on sharding or file order"""
+        for n_shards in [ 1, 4 ]:
+            export = self._export(n_shards, list(reversed(self._files)))
+            export.run(resume = False)
+
+            path = os.path.join(self._tmpdir, 'merged_%d.lcol' % n_shards)
+            export.merge(path)
+
+            self._check_merged(path)
+
+    def test_resume(self):
+        """Test that only failed shards are rerun on resume"""
+        fail_marker = self._files[3] + '.fail'
+        open(fail_marker, 'w').close()
+
+        export = self._export(4)
+
+        with self.assertRaises(RuntimeError):
+            export.run()
+
+        failed = [ x.index for x in export.shards if x.state != 'done' ]
+        self.assertEqual(failed, [ 1 ])
+        self.assertEqual(self._calls_list(), [ 0, 2, 3 ])
+
+        os.remove(fail_marker)
+        export = self._export(4)
+        export.run()
+
+        self.assertEqual(self._calls_list(), [ 1 ])
+
+        path = os.path.join(self._tmpdir, 'merged.lcol')
+        export.merge(path)
+        self._check_merged(path)
+
+        # Changing sharding invalidates the previous shard outputs
+        self._export(3).run()
+        self.assertEqual(self._calls_list(), [ 0, 1, 2 ])
+
+    def test_resume_macro_changed(self):
+        """Test that changes of the macro or its includes rerun all shards"""
+        macro  = os.path.join(self._tmpdir, 'macro', 'exporter.C')
+        header = os.path.join(self._tmpdir, 'common', 'Vars.h')
+
+        os.makedirs(os.path.dirname(macro))
+        os.makedirs(os.path.dirname(header))
+
+        def write(path, text):
+            with open(path, 'wt') as f:
+                f.write(text)
+
+        def export_merged(scale):
+            export = self._export(4, macro = macro)
+            export.run()
+
+            path = os.path.join(self._tmpdir, 'merged.lcol')
+            export.merge(path)
+            self._check_merged(path, scale)
+
+        write(header, '// x\n')
+        write(macro, '#include "../common/Vars.h"\n// SCALE 1\n')
+
+        export_merged(1)
+        self.assertEqual(self._calls_list(), [ 0, 1, 2, 3 ])
+
+        export_merged(1)
+        self.assertFalse(os.path.exists(self._calls))
+
+        write(macro, '#include "../common/Vars.h"\n// SCALE 2\n')
+        export_merged(2)
+        self.assertEqual(self._calls_list(), [ 0, 1, 2, 3 ])
+
+        write(header, '// y\n')
+        export_merged(2)
+        self.assertEqual(self._calls_list(), [ 0, 1, 2, 3 ])
+
+if __name__ == '__main__':
+    unittest.main()
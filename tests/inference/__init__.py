@@ -0,0 +1 @@
+"""Various `lstm_ee.inference` tests"""
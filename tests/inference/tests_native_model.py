@@ -0,0 +1,337 @@
+"""Test correctness of the native inference engine"""
+
+import os
+import tempfile
+import unittest
+
+import numpy as np
+
+from lstm_ee.consts import LABEL_PRIMARY, LABEL_SECONDARY, LABEL_TOTAL
+from lstm_ee.data.data_generator import DataBatchTransform, DataGenerator
+from lstm_ee.data.data_loader.dict_loader import DictLoader
+from lstm_ee.inference import FlatModel, InputSpec, NativeModel
+from lstm_ee.inference.flat_model import (
+    ACTIVATIONS, INPUT_PNG2D, INPUT_PNG3D, INPUT_SLICE,
+    LAYER_ACTIVATION, LAYER_ADD, LAYER_CONCATENATE, LAYER_DENSE, LAYER_INPUT,
+    LAYER_LSTM, LAYER_MASKING, LAYER_SCALE
+)
+
+from ..data_generator.tests_batch_transform import make_random_data
+
+VARS_SLICE = [ 'slice0', 'slice1', 'slice2' ]
+VARS_PNG   = [ 'png0', 'png1', 'png2' ]
+SORTERS    = { 'input_png3d' : '-png0', 'input_png2d' : '+png1' }
+MAX_PRONGS = 5
+
+def activate(activation, x):
+    """Apply `keras` activation `activation` to `x`"""
+    if activation == ACTIVATIONS['linear']:
+        return x
+    if activation == ACTIVATIONS['relu']:
+        return np.maximum(x, 0)
+    if activation == ACTIVATIONS['sigmoid']:
+        return 1 / (1 + np.exp(-x))
+    if activation == ACTIVATIONS['hard_sigmoid']:
+        return np.clip(0.2 * x + 0.5, 0, 1)
+    if activation == ACTIVATIONS['tanh']:
+        return np.tanh(x)
+
+    raise ValueError(activation)
+
+def eval_lstm(layer, x, mask):
+    """Evaluate LSTM on a padded batch `x` following `keras` semantics"""
+    units, act, rec_act, go_backwards, return_seq, reverse = layer.params
+    kernel, rec_kernel, bias = layer.tensors
+
+    h = np.zeros((x.shape[0], units), dtype = np.float32)
+    c = np.zeros((x.shape[0], units), dtype = np.float32)
+
+    steps   = range(x.shape[1])
+    outputs = []
+
+    for t in (reversed(steps) if go_backwards else steps):
+        z = x[:, t] @ kernel + h @ rec_kernel + bias
+        i, f, g, o = np.split(z, 4, axis = 1)
+
+        c_new = activate(rec_act, f) * c + activate(rec_act, i) * activate(act, g)
+        h_new = activate(rec_act, o) * activate(act, c_new)
+
+        valid = mask[:, t][:, np.newaxis]
+        c = np.where(valid, c_new, c)
+        h = np.where(valid, h_new, h)
+
+        outputs.append(h)
+
+    if not return_seq:
+        return h
+
+    result = np.stack(outputs, axis = 1)
+    return result[:, ::-1] if reverse else result
+
+def eval_reference(flat_model, batch):
+    """Evaluate `flat_model` on a padded batch following `keras` semantics"""
+    # pylint: disable=too-many-branches
+    values = []
+    masks  = []
+    inputs = {
+        INPUT_SLICE : 'input_slice',
+        INPUT_PNG3D : 'input_png3d',
+        INPUT_PNG2D : 'input_png2d',
+    }
+
+    for layer in flat_model.layers:
+        x    = [ values[i] for i in layer.inputs ]
+        mask = masks[layer.inputs[0]] if layer.inputs else None
+
+        if layer.type == LAYER_INPUT:
+            y = batch[inputs[layer.params[0]]]
+            if y.ndim == 3:
+                mask = np.ones(y.shape[:2], dtype = bool)
+        elif layer.type == LAYER_MASKING:
+            mask = np.any(x[0] != layer.tensors[0][0], axis = -1)
+            y    = x[0] * mask[..., np.newaxis]
+        elif layer.type == LAYER_DENSE:
+            y = activate(
+                layer.params[0], x[0] @ layer.tensors[0] + layer.tensors[1]
+            )
+        elif layer.type == LAYER_SCALE:
+            y = x[0] * layer.tensors[0] + layer.tensors[1]
+        elif layer.type == LAYER_LSTM:
+            y = eval_lstm(layer, x[0], mask)
+            if not layer.params[4]:
+                mask = None
+        elif layer.type == LAYER_CONCATENATE:
+            y = np.concatenate(x, axis = -1)
+        elif layer.type == LAYER_ADD:
+            y = np.sum(x, axis = 0)
+        elif layer.type == LAYER_ACTIVATION:
+            y = activate(layer.params[0], x[0])
+
+        if (mask is not None) and (y.ndim == 3):
+            for i in layer.inputs[1:]:
+                mask = mask & masks[i]
+
+        values.append(y)
+        masks.append(mask)
+
+    return {
+        k : values[v].ravel() for (k, v) in flat_model.outputs.items()
+    }
+
+def make_flat_model(seed, with_primary = True):
+    """Create random `FlatModel` similar to `model_lstm_v3`"""
+    # pylint: disable=too-many-locals
+    prg  = np.random.RandomState(seed)
+    act  = ACTIVATIONS
+
+    model = FlatModel(
+        layers  = [],
+        inputs  = {
+            INPUT_SLICE : InputSpec(VARS_SLICE, None, False),
+            INPUT_PNG3D : InputSpec(VARS_PNG,   0,    False),
+            INPUT_PNG2D : InputSpec(VARS_PNG,   1,    True),
+        },
+        outputs    = {},
+        max_prongs = MAX_PRONGS,
+    )
+
+    def weights(*shape):
+        return prg.normal(scale = 0.5, size = shape)
+
+    def dense(name, inputs, n_in, n_out, activation):
+        return model.add_layer(
+            LAYER_DENSE, name, inputs, [ activation ],
+            [ weights(n_in, n_out), weights(n_out) ]
+        )
+
+    def lstm(name, inputs, n_in, units, params):
+        return model.add_layer(
+            LAYER_LSTM, name, inputs, [ units ] + params,
+            [ weights(n_in, 4 * units), weights(units, 4 * units),
+              weights(4 * units) ]
+        )
+
+    def scale(name, inputs, n):
+        return model.add_layer(
+            LAYER_SCALE, name, inputs, [], [ 1 + weights(n), weights(n) ]
+        )
+
+    slc   = model.add_layer(LAYER_INPUT, 'input_slice', [], [ INPUT_SLICE ])
+    png3d = model.add_layer(LAYER_INPUT, 'input_png3d', [], [ INPUT_PNG3D ])
+    png2d = model.add_layer(LAYER_INPUT, 'input_png2d', [], [ INPUT_PNG2D ])
+
+    png3d = model.add_layer(LAYER_MASKING, 'mask3d', [ png3d ], [], [ [0] ])
+    png3d = scale('bn3d', [ png3d ], 3)
+    png3d = dense('pre3d', [ png3d ], 3, 8, act['relu'])
+    png3d = lstm(
+        'lstm3d', [ png3d ], 8, 6, [ act['tanh'], act['hard_sigmoid'], 0, 0, 0 ]
+    )
+
+    png2d = model.add_layer(LAYER_MASKING, 'mask2d', [ png2d ], [], [ [0] ])
+    png2d = dense('pre2d', [ png2d ], 3, 5, act['relu'])
+    fwd   = lstm(
+        'bidir/forward', [ png2d ], 5, 4,
+        [ act['tanh'], act['hard_sigmoid'], 0, 1, 0 ]
+    )
+    bwd   = lstm(
+        'bidir/backward', [ png2d ], 5, 4,
+        [ act['tanh'], act['hard_sigmoid'], 1, 1, 1 ]
+    )
+    png2d = model.add_layer(LAYER_CONCATENATE, 'bidir', [ fwd, bwd ])
+    png2d = lstm(
+        'lstm2d', [ png2d ], 8, 5, [ act['tanh'], act['sigmoid'], 1, 0, 0 ]
+    )
+
+    merged = model.add_layer(
+        LAYER_CONCATENATE, 'merged', [ png3d, png2d, slc ]
+    )
+    hidden = dense('post', [ merged ], 14, 10, act['relu'])
+
+    res = dense('res-fc1', [ hidden ], 10, 10, act['relu'])
+    res = scale('res-bn1', [ res ], 10)
+    res = dense('res-fc2', [ res ], 10, 10, act['linear'])
+    res = scale('res-bn2', [ res ], 10)
+    res = model.add_layer(LAYER_ADD, 'res-add', [ res, hidden ])
+    res = model.add_layer(
+        LAYER_ACTIVATION, 'res-act', [ res ], [ act['relu'] ]
+    )
+
+    model.outputs['target_total'] \
+        = dense('target_total', [ res ], 10, 1, act['linear'])
+
+    if with_primary:
+        model.outputs['target_primary'] \
+            = dense('target_primary', [ res ], 10, 1, act['linear'])
+
+    return model
+
+def make_data(seed):
+    """Create random dataset with NaN values"""
+    prg  = np.random.RandomState(seed)
+    data = make_random_data(300, 3, 9, seed)
+
+    for var in VARS_SLICE:
+        data[var] = np.array(data[var], dtype = np.float32)
+        data[var][prg.uniform(size = len(data[var])) < 0.05] = np.nan
+
+    for var in VARS_PNG:
+        for values in data[var]:
+            values[prg.uniform(size = len(values)) < 0.05] = np.nan
+
+    return data
+
+class TestsNativeModel(unittest.TestCase):
+    """Test native inference engine against a reference implementation"""
+
+    def setUp(self):
+        self._tmpdir = tempfile.TemporaryDirectory()
+        self._path   = os.path.join(self._tmpdir.name, 'model.bin')
+
+    def tearDown(self):
+        self._tmpdir.cleanup()
+
+    def _predict_reference(self, flat_model, data):
+        dgen = DataBatchTransform(
+            DataGenerator(
+                DictLoader(data),
+                batch_size       = 64,
+                max_prongs       = flat_model.max_prongs,
+                vars_input_slice = VARS_SLICE,
+                vars_input_png3d = VARS_PNG,
+                vars_input_png2d = VARS_PNG,
+            ),
+            SORTERS
+        )
+
+        preds = [ eval_reference(flat_model, dgen[i][0]) for i in range(len(dgen)) ]
+
+        return {
+            k : np.concatenate([ x[k] for x in preds ])
+                for k in flat_model.outputs
+        }
+
+    def test_flat_model_io(self):
+        """Test that saved and loaded `FlatModel` are the same"""
+        null = make_flat_model(1)
+        null.save(self._path)
+
+        test = FlatModel.load(self._path)
+
+        self.assertEqual(test.inputs,     null.inputs)
+        self.assertEqual(test.outputs,    null.outputs)
+        self.assertEqual(test.max_prongs, null.max_prongs)
+        self.assertEqual(test.mask_value, null.mask_value)
+        self.assertEqual(len(test.layers), len(null.layers))
+
+        for (layer_test, layer_null) in zip(test.layers, null.layers):
+            self.assertEqual(layer_test[:4], layer_null[:4])
+
+            for (x, y) in zip(layer_test.tensors, layer_null.tensors):
+                self.assertTrue(np.array_equal(x, y))
+
+    def _test_predict(self, workers):
+        flat_model = make_flat_model(2)
+        flat_model.save(self._path)
+
+        data = make_data(3)
+        null = self._predict_reference(flat_model, data)
+        test = NativeModel(self._path, workers).predict_data_loader(
+            DictLoader(data)
+        )
+
+        for (label, output) in [
+            (LABEL_TOTAL, 'target_total'), (LABEL_PRIMARY, 'target_primary')
+        ]:
+            self.assertTrue(np.allclose(
+                test[label], null[output], rtol = 1e-4, atol = 1e-5
+            ))
+
+        self.assertTrue(np.allclose(
+            test[LABEL_SECONDARY], test[LABEL_TOTAL] - test[LABEL_PRIMARY]
+        ))
+
+    def test_predict(self):
+        """Test native predictions against the reference implementation"""
+        self._test_predict(workers = 1)
+
+    def test_predict_multithreaded(self):
+        """Test multithreaded native predictions"""
+        self._test_predict(workers = 4)
+
+    def test_missing_target(self):
+        """Test that missing targets are not predicted"""
+        make_flat_model(4, with_primary = False).save(self._path)
+
+        test = NativeModel(self._path).predict_data_loader(
+            DictLoader(make_data(5))
+        )
+
+        self.assertIsNotNone(test[LABEL_TOTAL])
+        self.assertIsNone(test[LABEL_PRIMARY])
+        self.assertIsNone(test[LABEL_SECONDARY])
+
+    def test_invalid_file(self):
+        """Test that invalid files are rejected"""
+        with open(self._path, 'wb') as f:
+            f.write(b'not a model')
+
+        self.assertRaises(RuntimeError, NativeModel, self._path)
+
+    def test_invalid_offsets(self):
+        """Test that prong offsets out of the values bounds are rejected"""
+        make_flat_model(6).save(self._path)
+
+        model  = NativeModel(self._path)
+        slices = np.zeros((2, len(VARS_SLICE)), dtype = np.float32)
+        values = np.zeros((3, len(VARS_PNG)),   dtype = np.float32)
+
+        model.predict(slices, ([ 0, 1, 3 ], values), ([ 0, 2, 3 ], values))
+
+        for offsets in [ [ 0, 1 ], [ 1, 2, 3 ], [ 0, 2, 1 ], [ 0, 1, 4 ] ]:
+            self.assertRaises(
+                ValueError, model.predict,
+                slices, (offsets, values), ([ 0, 2, 3 ], values)
+            )
+
+if __name__ == '__main__':
+    unittest.main()
@@ -11,16 +11,27 @@ $ python -m unittest tests.run_tests.suite
 import unittest
 
 import tests.data_loader.tests_csv_loader
+import tests.data_loader.tests_columnar_loader
 import tests.data_loader.tests_hdf_loader
 import tests.data_loader.tests_dict_loader
 import tests.data_loader.tests_data_shuffle
 import tests.data_loader.tests_data_slice
 
 import tests.data_generator.tests_batch_split
+import tests.data_generator.tests_batch_store
+import tests.data_generator.tests_batch_transform
 import tests.data_generator.tests_varr_sorting
 import tests.data_generator.tests_noise
 import tests.data_generator.tests_weights
 
+import tests.eval.tests_binned_stats
+
+import tests.inference.tests_native_model
+
+import tests.export.tests_sharded_export
+
+import tests.bench.tests_bench
+
 def suite():
     """Create test suite"""
     result = unittest.TestSuite()
@@ -29,6 +40,9 @@ def suite():
     result.addTest(loader.loadTestsFromModule(
         tests.data_loader.tests_csv_loader
     ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.data_loader.tests_columnar_loader
+    ))
     result.addTest(loader.loadTestsFromModule(
         tests.data_loader.tests_hdf_loader
     ))
@@ -44,6 +58,12 @@ def suite():
     result.addTest(loader.loadTestsFromModule(
         tests.data_generator.tests_batch_split
     ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.data_generator.tests_batch_store
+    ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.data_generator.tests_batch_transform
+    ))
     result.addTest(loader.loadTestsFromModule(
         tests.data_generator.tests_varr_sorting
     ))
@@ -53,6 +73,18 @@ def suite():
     result.addTest(loader.loadTestsFromModule(
         tests.data_generator.tests_weights
     ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.eval.tests_binned_stats
+    ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.inference.tests_native_model
+    ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.export.tests_sharded_export
+    ))
+    result.addTest(loader.loadTestsFromModule(
+        tests.bench.tests_bench
+    ))
 
     return result
 